@@ -0,0 +1,626 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <vector>
+using std::vector;
+#include <string>
+using std::string;
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "cv.h"
+#include "highgui.h"
+
+#include "had.h"
+
+
+// Detection rate of all the models trained by the benchmark
+const float DETECTION_RATE = .99f;
+
+// Maximum number of training frames kept by the online training to select
+// the thresholds, as in background
+const int NB_THRESHOLD_FRAMES = 32;
+
+// Tolerance of the change gating, in mean intensity levels per tile
+const int GATE_TOLERANCE = 8;
+
+// Reduction factor of the coarse frames of the pyramid
+const int PYRAMID_FACTOR = 4;
+
+// Largest fraction of the labels of a QuantizedLCM that may differ from the
+// ones of its MultipleLCM, see QuantizedLCM
+const double MAX_QUANTIZED_DISAGREEMENT = .001;
+
+// Label file written by the benchmark, and removed at the end
+const char* LABEL_FILE = "benchmark.lbl";
+
+// Maximum number of passes over the frames before classify() must stop
+// allocating: each thread of the pool grows its workspace the first time it
+// runs a band, which may not happen during the first pass
+const int NB_ALLOCATION_PASSES = 8;
+
+
+// Calls to operator new, by all the threads, while counting_allocations is
+// set, see reportAllocations(). The operators are not inlined, so that the
+// compiler does not pair the malloc() of one with the free() of the other.
+volatile bool counting_allocations = false;
+volatile long nb_allocations = 0;
+
+
+__attribute__(( noinline ))
+void* operator new( size_t size ) throw( std::bad_alloc )
+{
+    if( counting_allocations )
+        __sync_fetch_and_add( &nb_allocations, 1 );
+    void* pointer = malloc( size > 0 ? size : 1 );
+    if( ! pointer )
+        throw std::bad_alloc();
+    return pointer;
+}
+
+
+__attribute__(( noinline ))
+void operator delete( void* pointer ) throw()
+{
+    free( pointer );
+}
+
+
+// Size of the frames of a set of measures
+struct Resolution
+{
+    string name;
+    int    width;
+    int    height;
+};
+
+
+// Parse the comma-separated list of integers of an option, ex: "1,2,4", and
+// exit with an error if it is empty or has a value that is not an integer
+// of at least min_value
+vector<int> parseList( const string& option, const string& list, int min_value )
+{
+    vector<int> values;
+    std::stringstream stream( list );
+    string value;
+    while( std::getline( stream, value, ',' ) )
+    {
+        char* end = NULL;
+        long number = strtol( value.c_str(), &end, 10 );
+        if( value.empty() || *end != '\0' || number < min_value || number > INT_MAX )
+        {
+            std::cerr << "ERROR: invalid value \"" << value << "\" for " << option
+                      << ", expected integers of at least " << min_value << std::endl;
+            exit( 1 );
+        }
+        values.push_back( (int) number );
+    }
+
+    if( values.empty() )
+    {
+        std::cerr << "ERROR: no value for " << option << std::endl;
+        exit( 1 );
+    }
+    return values;
+}
+
+
+// Resident memory of the process in MB, read from a field of
+// /proc/self/status: "VmRSS:" for the current one, "VmHWM:" for the peak
+double getResidentMemory( const string& field )
+{
+    std::ifstream status( "/proc/self/status" );
+    string line;
+    while( std::getline( status, line ) )
+    {
+        if( line.compare( 0, field.size(), field ) == 0 )
+            return atof( line.c_str() + field.size() ) / 1024.0; // the fields are in kB
+    }
+    return 0;
+}
+
+
+// Reset the peak resident memory of the process to the current one, so that
+// the next peak is the one of a single workload (Linux 4.0, see proc(5))
+void resetPeakMemory()
+{
+    std::ofstream clear_refs( "/proc/self/clear_refs" );
+    clear_refs << "5";
+}
+
+
+// Synthetic frame: smooth gradients, so that the pixels have different
+// means, with gaussian noise, so that they have different variances
+cv::Mat makeFrame( int width, int height, cv::RNG& rng )
+{
+    cv::Mat frame( height, width, CV_8UC3 );
+    for( int y = 0; y < height; ++y )
+    {
+        unsigned char* row = frame.ptr<unsigned char>( y );
+        for( int x = 0; x < width; ++x )
+        {
+            int base[ 3 ] = { 40 + 160 * x / width, 40 + 160 * y / height, 120 };
+            for( int id = 0; id < 3; ++id )
+            {
+                int value = base[ id ] + cvRound( rng.gaussian( 4 ) );
+                row[ 3 * x + id ] = (unsigned char) std::max( 0, std::min( 255, value ) );
+            }
+        }
+    }
+    return frame;
+}
+
+
+// Load the frames of the dataset from the article, if they are there
+vector<cv::Mat> loadDataset()
+{
+    vector<cv::Mat> frames;
+    for( int index = 0; ; ++index )
+    {
+        cv::Mat frame = cv::imread( had::FrameSource::formatSequence( "dataset/frame%d.jpg", index ) );
+        if( frame.empty() )
+            break;
+        frames.push_back( frame );
+    }
+    return frames;
+}
+
+
+// Result of the runs of a task
+struct Measure
+{
+    double seconds; // Best time of the runs
+    double memory;  // Resident memory added by the runs at their peak, in MB
+};
+
+
+// Run a task several times, and measure its best time and its peak memory.
+// The memory already resident before the runs (the frames, the models, the
+// buffers kept by earlier workloads) is not counted.
+Measure measure( const boost::function<void ()>& task, int nb_repeats )
+{
+    Measure result;
+    result.seconds = 0;
+    double memory_start = getResidentMemory( "VmRSS:" );
+    resetPeakMemory();
+    for( int id = 0; id < nb_repeats; ++id )
+    {
+        double time_start = (double) cv::getTickCount();
+        task();
+        double seconds = ( (double) cv::getTickCount() - time_start ) / cv::getTickFrequency();
+        if( id == 0 || seconds < result.seconds )
+            result.seconds = seconds;
+    }
+    result.memory = std::max( getResidentMemory( "VmHWM:" ) - memory_start, 0.0 );
+    return result;
+}
+
+
+void report( const string& workload, const Resolution& resolution, int nb_threads, int nb_frames, const Measure& result )
+{
+    double nb_pixels = (double) resolution.width * resolution.height * nb_frames;
+    double seconds = result.seconds;
+    std::cout << std::left  << std::setw( 20 ) << workload
+              << std::setw( 10 ) << resolution.name
+              << std::right << std::setw( 8 ) << nb_threads
+              << std::setw( 8 ) << nb_frames
+              << std::fixed << std::setprecision( 2 )
+              << std::setw( 12 ) << ( nb_pixels > 0 ? seconds * 1e9 / nb_pixels : 0 )
+              << std::setw( 12 ) << ( seconds > 0 ? nb_frames / seconds : 0 )
+              << std::setprecision( 1 )
+              << std::setw( 16 ) << result.memory
+              << std::endl;
+}
+
+
+// Number of labels that differ between two classifications
+double countDifferences( const cv::Mat& classification, const cv::Mat& other )
+{
+    double nb_differences = 0;
+    for( int y = 0; y < classification.rows; ++y )
+    {
+        const unsigned char* row = classification.ptr<unsigned char>( y );
+        const unsigned char* row_other = other.ptr<unsigned char>( y );
+        for( int x = 0; x < classification.cols; ++x )
+            nb_differences += row[ x ] != row_other[ x ];
+    }
+    return nb_differences;
+}
+
+
+// Fraction of the labels of the quantized model that differ from the ones of
+// the float model, on the frames used for the measures, which must not exceed
+// MAX_QUANTIZED_DISAGREEMENT
+void reportDisagreement( had::LCM& lcm, had::LCM& lcm_quantized, const vector<cv::Mat>& images )
+{
+    double nb_pixels = 0, nb_differences = 0;
+    cv::Mat classification, classification_quantized;
+    for( unsigned int id = 0; id < images.size(); ++id )
+    {
+        lcm.classify( images[ id ], classification );
+        lcm_quantized.classify( images[ id ], classification_quantized );
+        nb_differences += countDifferences( classification, classification_quantized );
+        nb_pixels += classification.rows * classification.cols;
+    }
+    std::cout << "# quantized labels differing from float: "
+              << std::setprecision( 4 ) << 100 * nb_differences / nb_pixels << "%" << std::endl;
+    if( nb_differences > MAX_QUANTIZED_DISAGREEMENT * nb_pixels )
+    {
+        std::cerr << "ERROR: the quantized labels differ from float by more than "
+                  << 100 * MAX_QUANTIZED_DISAGREEMENT << "%" << std::endl;
+        exit( 1 );
+    }
+}
+
+
+// Allocations per frame of the frame by frame, region and batch
+// classify(), once the buffers have grown, which must be zero. The buffers of
+// the cv::Mat are not allocated with operator new, so the classifications
+// must also keep their data.
+void reportAllocations( had::LCM& lcm, const vector<cv::Mat>& images, const vector<cv::Rect>& regions )
+{
+    cv::Mat classification, classification_regions;
+    vector<cv::Mat> classifications;
+    long nb_pass_allocations = 0;
+    for( int id_pass = 0; id_pass < NB_ALLOCATION_PASSES; ++id_pass )
+    {
+        const unsigned char* data = classification.data;
+        const unsigned char* data_regions = classification_regions.data;
+        const unsigned char* data_batch = classifications.empty() ? NULL : classifications[ 0 ].data;
+        long nb_allocations_start = nb_allocations;
+        counting_allocations = true;
+        for( unsigned int id = 0; id < images.size(); ++id )
+        {
+            lcm.classify( images[ id ], classification );
+            lcm.classify( images[ id ], regions, had::LCM::BACKGROUND, classification_regions );
+        }
+        lcm.classify( images, classifications );
+        counting_allocations = false;
+
+        nb_pass_allocations = nb_allocations - nb_allocations_start;
+        nb_pass_allocations += classification.data != data;
+        nb_pass_allocations += classification_regions.data != data_regions;
+        nb_pass_allocations += classifications[ 0 ].data != data_batch;
+        if( nb_pass_allocations == 0 )
+            break;
+    }
+    std::cout << "# allocations per frame once the buffers have grown: "
+              << std::setprecision( 3 ) << (double) nb_pass_allocations / images.size() << std::endl;
+    if( nb_pass_allocations > 0 )
+    {
+        std::cerr << "ERROR: classify() still allocates after " << NB_ALLOCATION_PASSES << " passes over the frames" << std::endl;
+        exit( 1 );
+    }
+}
+
+
+// Fraction of the blocks refined by the pyramid, and of its labels that
+// differ from the ones of the full model
+void reportPyramid( had::LCM& lcm, had::PyramidClassifier& pyramid, const vector<cv::Mat>& images )
+{
+    double nb_pixels = 0, nb_differences = 0;
+    cv::Mat classification, classification_pyramid;
+    pyramid.reset();
+    for( unsigned int id = 0; id < images.size(); ++id )
+    {
+        lcm.classify( images[ id ], classification );
+        pyramid.classify( images[ id ], classification_pyramid );
+        nb_differences += countDifferences( classification, classification_pyramid );
+        nb_pixels += classification.rows * classification.cols;
+    }
+    std::cout << "# pyramid blocks refined: " << std::setprecision( 4 ) << 100 * pyramid.getRefinedRatio() << "%"
+              << ", labels differing from full: " << 100 * nb_differences / nb_pixels << "%" << std::endl;
+}
+
+
+// Workloads, each one called several times by measure()
+
+void trainSingle( const cv::Mat* image, had::ThreadPool* pool )
+{
+    cv::Mat mask( image->size(), CV_8UC1, cv::Scalar( 1 ) );
+    had::SingleLCM lcm( *image, DETECTION_RATE, mask, pool );
+}
+
+
+void trainMultiple( const vector<cv::Mat>* images, had::ThreadPool* pool )
+{
+    had::MultipleLCM lcm( *images, DETECTION_RATE, pool );
+}
+
+
+void trainMultipleOnline( const vector<cv::Mat>* images, had::ThreadPool* pool )
+{
+    had::MultipleLCM lcm( DETECTION_RATE, NB_THRESHOLD_FRAMES, pool );
+    for( unsigned int id = 0; id < images->size(); ++id )
+        lcm.addFrame( (*images)[ id ] );
+    lcm.finalize();
+}
+
+
+void trainGlobalVariance( const vector<cv::Mat>* images, had::ThreadPool* pool )
+{
+    had::GlobalVarianceLCM lcm( *images, DETECTION_RATE, pool );
+}
+
+
+// Same selection as LCM::selectThresholdMatrix(), which is not public
+void selectThreshold( const cv::Mat* distortions )
+{
+    had::QuantileSelector selector( DETECTION_RATE );
+    while( selector.needsPass() )
+    {
+        for( int y = 0; y < distortions->rows; ++y )
+            selector.add( distortions->ptr<float>( y ), distortions->cols );
+        selector.endPass();
+    }
+}
+
+
+void classifyFrames( had::LCM* lcm, const vector<cv::Mat>* images )
+{
+    cv::Mat classification;
+    for( unsigned int id = 0; id < images->size(); ++id )
+        lcm->classify( (*images)[ id ], classification );
+}
+
+
+void classifyBatch( had::LCM* lcm, const vector<cv::Mat>* images )
+{
+    vector<cv::Mat> classifications;
+    lcm->classify( *images, classifications );
+}
+
+
+void classifyRegions( had::LCM* lcm, const vector<cv::Mat>* images, const vector<cv::Rect>* regions )
+{
+    cv::Mat classification;
+    for( unsigned int id = 0; id < images->size(); ++id )
+        lcm->classify( (*images)[ id ], *regions, had::LCM::BACKGROUND, classification );
+}
+
+
+// The first frame is classified entirely, as when a stream starts
+void classifyGated( had::LCM* lcm, const vector<cv::Mat>* images, double* out_skipped_ratio )
+{
+    had::IncrementalClassifier classifier( lcm, GATE_TOLERANCE );
+    cv::Mat classification;
+    for( unsigned int id = 0; id < images->size(); ++id )
+        classifier.classify( (*images)[ id ], classification );
+    *out_skipped_ratio = classifier.getSkippedRatio();
+}
+
+
+void classifyPyramid( had::PyramidClassifier* pyramid, const vector<cv::Mat>* images )
+{
+    cv::Mat classification;
+    for( unsigned int id = 0; id < images->size(); ++id )
+        pyramid->classify( (*images)[ id ], classification );
+}
+
+
+void classificationsToImages( had::LCM* lcm, const vector<cv::Mat>* classifications )
+{
+    cv::Mat image;
+    for( unsigned int id = 0; id < classifications->size(); ++id )
+        lcm->classificationToImage( (*classifications)[ id ], image );
+}
+
+
+void classificationsToLabels( const vector<cv::Mat>* classifications, int encoding, double* out_nb_bytes )
+{
+    had::LabelWriter labels( LABEL_FILE, (*classifications)[ 0 ].size(), encoding );
+    for( unsigned int id = 0; id < classifications->size(); ++id )
+        labels.write( (*classifications)[ id ] );
+    labels.flush();
+    *out_nb_bytes = (double) labels.getNbBytes();
+}
+
+
+// The frames are read in reverse order, to show that they do not depend on
+// each other
+void readLabels()
+{
+    had::LabelReader labels( LABEL_FILE );
+    cv::Mat classification;
+    for( int id = labels.getNbFrames() - 1; id >= 0; --id )
+        labels.read( id, classification );
+}
+
+
+// Measure all the workloads on frames of one resolution
+void runResolution( const Resolution&      resolution,
+                    const vector<cv::Mat>& frames,
+                    const vector<int>&     list_threads,
+                    const vector<int>&     list_frames,
+                    int                    nb_repeats )
+{
+    cv::RNG rng( 1 );
+    for( unsigned int id_frames = 0; id_frames < list_frames.size(); ++id_frames )
+    {
+        // The frames of the dataset are reused when more are needed
+        int nb_frames = list_frames[ id_frames ];
+        vector<cv::Mat> images;
+        for( int id = 0; id < nb_frames; ++id )
+            images.push_back( frames.empty() ? makeFrame( resolution.width, resolution.height, rng ) : frames[ id % frames.size() ] );
+
+        // The threshold selection does not use the thread pool
+        cv::Mat distortions( resolution.height, resolution.width * nb_frames, CV_32F );
+        for( int y = 0; y < distortions.rows; ++y )
+            for( int x = 0; x < distortions.cols; ++x )
+                distortions.at<float>( y, x ) = (float) rng.gaussian( 1 );
+        report( "threshold", resolution, 1, nb_frames,
+                measure( boost::bind( &selectThreshold, &distortions ), nb_repeats ) );
+        distortions = cv::Mat();
+
+        for( unsigned int id_threads = 0; id_threads < list_threads.size(); ++id_threads )
+        {
+            // One thread means no pool at all, as in background
+            boost::scoped_ptr<had::ThreadPool> pool;
+            if( list_threads[ id_threads ] != 1 )
+                pool.reset( new had::ThreadPool( list_threads[ id_threads ] ) );
+            int nb_threads = pool ? pool->getNbThreads() : 1;
+
+            report( "train-single", resolution, nb_threads, 1,
+                    measure( boost::bind( &trainSingle, &images[ 0 ], pool.get() ), nb_repeats ) );
+            report( "train-multiple", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &trainMultiple, &images, pool.get() ), nb_repeats ) );
+            report( "train-online", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &trainMultipleOnline, &images, pool.get() ), nb_repeats ) );
+            report( "train-global", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &trainGlobalVariance, &images, pool.get() ), nb_repeats ) );
+
+            had::MultipleLCM lcm( images, DETECTION_RATE, pool.get() );
+            report( "classify", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &classifyFrames, &lcm, &images ), nb_repeats ) );
+            report( "classify-batch", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &classifyBatch, &lcm, &images ), nb_repeats ) );
+
+            // A region of interest of a sixth of the frame, centered, like a
+            // doorway watched by a camera
+            vector<cv::Rect> regions( 1, cv::Rect( images[ 0 ].cols / 4, images[ 0 ].rows / 3, images[ 0 ].cols / 2, images[ 0 ].rows / 3 ) );
+            report( "classify-roi", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &classifyRegions, &lcm, &images, &regions ), nb_repeats ) );
+            reportAllocations( lcm, images, regions );
+
+            // A quiet scene: the first frame, in which a small square moves
+            vector<cv::Mat> images_quiet;
+            for( int id = 0; id < nb_frames; ++id )
+            {
+                images_quiet.push_back( images[ 0 ].clone() );
+                int side = images[ 0 ].cols / 16;
+                cv::Rect square( ( id * side / 2 ) % ( images[ 0 ].cols - side ), images[ 0 ].rows / 2, side, side );
+                cv::rectangle( images_quiet.back(), square.tl(), square.br(), cv::Scalar( 255, 0, 255 ), CV_FILLED );
+            }
+            double skipped_ratio = 0;
+            report( "classify-gated", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &classifyGated, &lcm, &images_quiet, &skipped_ratio ), nb_repeats ) );
+            std::cout << "# gated tiles skipped: " << std::setprecision( 4 ) << 100 * skipped_ratio << "%" << std::endl;
+
+            // The pyramid classifies the quiet scene with a coarse model
+            // reduced from the trained one
+            had::MultipleLCM lcm_coarse( lcm, PYRAMID_FACTOR, pool.get() );
+            had::PyramidClassifier pyramid( &lcm, &lcm_coarse, PYRAMID_FACTOR );
+            report( "classify-pyramid", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &classifyPyramid, &pyramid, &images_quiet ), nb_repeats ) );
+            reportPyramid( lcm, pyramid, images_quiet );
+
+            had::GlobalVarianceLCM lcm_global( images, DETECTION_RATE, pool.get() );
+            report( "classify-global", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &classifyFrames, &lcm_global, &images ), nb_repeats ) );
+
+            had::QuantizedLCM lcm_quantized( lcm, pool.get() );
+            report( "classify-quantized", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &classifyFrames, &lcm_quantized, &images ), nb_repeats ) );
+            reportDisagreement( lcm, lcm_quantized, images );
+
+            vector<cv::Mat> classifications;
+            lcm.classify( images, classifications );
+            report( "to-image", resolution, nb_threads, nb_frames,
+                    measure( boost::bind( &classificationsToImages, &lcm, &classifications ), nb_repeats ) );
+
+            // The label files do not use the thread pool
+            double nb_bytes_packed = 0, nb_bytes_rle = 0;
+            report( "to-labels-packed", resolution, 1, nb_frames,
+                    measure( boost::bind( &classificationsToLabels, &classifications, had::LABELS_PACKED, &nb_bytes_packed ), nb_repeats ) );
+            report( "to-labels-rle", resolution, 1, nb_frames,
+                    measure( boost::bind( &classificationsToLabels, &classifications, had::LABELS_RLE, &nb_bytes_rle ), nb_repeats ) );
+            report( "read-labels-rle", resolution, 1, nb_frames,
+                    measure( boost::bind( &readLabels ), nb_repeats ) );
+            remove( LABEL_FILE );
+            double nb_pixels = (double) resolution.width * resolution.height * nb_frames;
+            std::cout << "# label file bits per pixel: packed " << std::setprecision( 3 ) << 8 * nb_bytes_packed / nb_pixels
+                      << ", rle " << 8 * nb_bytes_rle / nb_pixels << std::endl;
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    // Options, each one followed by its value:
+    //  --threads: comma-separated numbers of threads, 0 for one per core.
+    //  --frames: comma-separated numbers of frames used to train and classify.
+    //  --resolutions: comma-separated resolutions among dataset, 720p, 1080p
+    //    and 4k.
+    //  --repeats: number of runs of each measure, of which the best is kept.
+    string option_threads = "1,0";
+    string option_frames = "4,16";
+    string option_resolutions = "dataset,720p,1080p";
+    int nb_repeats = 3;
+    for( int i = 1; i < argc; i += 2 )
+    {
+        string option = argv[ i ];
+        if( i + 1 >= argc )
+        {
+            std::cout << "usage: " << argv[0] << " [--threads 1,0] [--frames 4,16] [--resolutions dataset,720p,1080p,4k] [--repeats 3]" << std::endl;
+            exit( 0 );
+        }
+        if( option == "--threads" )
+            option_threads = argv[ i + 1 ];
+        else if( option == "--frames" )
+            option_frames = argv[ i + 1 ];
+        else if( option == "--resolutions" )
+            option_resolutions = argv[ i + 1 ];
+        else if( option == "--repeats" )
+            nb_repeats = std::max( atoi( argv[ i + 1 ] ), 1 );
+        else
+        {
+            std::cerr << "ERROR: unknown option " << option << std::endl;
+            exit( 1 );
+        }
+    }
+
+    vector<int> list_threads = parseList( "--threads", option_threads, 0 );
+    vector<int> list_frames = parseList( "--frames", option_frames, 1 );
+
+    std::cout << std::left  << std::setw( 20 ) << "workload"
+              << std::setw( 10 ) << "size"
+              << std::right << std::setw( 8 ) << "threads"
+              << std::setw( 8 ) << "frames"
+              << std::setw( 12 ) << "ns/pixel"
+              << std::setw( 12 ) << "frames/s"
+              << std::setw( 16 ) << "peak +RSS (MB)"
+              << std::endl;
+
+    std::stringstream stream( option_resolutions );
+    string name;
+    while( std::getline( stream, name, ',' ) )
+    {
+        Resolution resolution;
+        resolution.name = name;
+        vector<cv::Mat> frames;
+        if( name == "dataset" )
+        {
+            frames = loadDataset();
+            if( frames.empty() )
+            {
+                std::cerr << "WARNING: no frames in dataset/, skipped" << std::endl;
+                continue;
+            }
+            resolution.width  = frames[ 0 ].cols;
+            resolution.height = frames[ 0 ].rows;
+        }
+        else if( name == "720p" )  { resolution.width = 1280; resolution.height = 720;  }
+        else if( name == "1080p" ) { resolution.width = 1920; resolution.height = 1080; }
+        else if( name == "4k" )    { resolution.width = 3840; resolution.height = 2160; }
+        else
+        {
+            std::cerr << "ERROR: unknown resolution " << name << std::endl;
+            exit( 1 );
+        }
+
+        runResolution( resolution, frames, list_threads, list_frames, nb_repeats );
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_BOUNDED_QUEUE_HPP
+#define HAD_BOUNDED_QUEUE_HPP
+
+#include <deque>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/** 
+* @brief Thread-safe FIFO queue with a fixed capacity.
+*
+* Producers block in push() while the queue is full, and consumers block in
+* pop() while it is empty, so that the stages of a pipeline can overlap
+* without one of them running arbitrarily far ahead of the others. Once
+* close() has been called, push() is refused and pop() drains the remaining
+* items before reporting the end of the stream.
+*/
+/* ----------------------------------------------------------------------------*/
+template <typename T>
+class BoundedQueue
+{
+private:
+    std::deque<T>             _items;     //!< Items waiting to be consumed.
+    size_t                    _capacity;  //!< Maximum number of items in the queue.
+    bool                      _closed;    //!< If true, no more items will be pushed.
+    boost::mutex              _mutex;     //!< Protects all the members above.
+    boost::condition_variable _not_full;  //!< Signaled when an item is popped.
+    boost::condition_variable _not_empty; //!< Signaled when an item is pushed or the queue is closed.
+
+    BoundedQueue( const BoundedQueue& );
+    BoundedQueue& operator=( const BoundedQueue& );
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Constructor.
+    * 
+    * @param capacity Maximum number of items in the queue (at least 1).
+    */
+    /* ----------------------------------------------------------------------------*/
+    explicit BoundedQueue( size_t capacity )
+    : _capacity( capacity > 0 ? capacity : 1 ), _closed( false )
+    {
+    }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Add an item at the end of the queue, waiting for a free slot if
+    * the queue is full.
+    * 
+    * @param item Item to add.
+    * 
+    * @return False if the queue has been closed, in which case the item is
+    * dropped, true otherwise.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool push( const T& item )
+    {
+        boost::mutex::scoped_lock lock( _mutex );
+        while( _items.size() >= _capacity && ! _closed )
+            _not_full.wait( lock );
+
+        if( _closed )
+            return false;
+
+        _items.push_back( item );
+        _not_empty.notify_one();
+        return true;
+    }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Remove the item at the front of the queue, waiting for one to be
+    * pushed if the queue is empty.
+    * 
+    * @param out_item Removed item.
+    * 
+    * @return False if the queue has been closed and is empty, true otherwise.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool pop( T& out_item )
+    {
+        boost::mutex::scoped_lock lock( _mutex );
+        while( _items.empty() && ! _closed )
+            _not_empty.wait( lock );
+
+        if( _items.empty() )
+            return false;
+
+        out_item = _items.front();
+        _items.pop_front();
+        _not_full.notify_one();
+        return true;
+    }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Mark the end of the stream and wake up all the waiting threads.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void close()
+    {
+        boost::mutex::scoped_lock lock( _mutex );
+        _closed = true;
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    }
+};
+
+}
+
+#endif // HAD_BOUNDED_QUEUE_HPP
@@ -0,0 +1,686 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <algorithm>
+#include <cstring>
+
+#include "DistortionKernels.hpp"
+
+// The vectorized kernels are compiled with per-function target attributes, so
+// that a single binary contains all of them and picks one at runtime.
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define HAD_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+void computeDistortionsScalar( const had::DistortionRow& row )
+{
+    for( int x = 0; x < row.nb_pixels; ++x )
+        had::computeDistortionsPixel( row, x );
+}
+
+
+void computeQuantizedDistortionsScalar( const had::QuantizedDistortionRow& row )
+{
+    for( int x = 0; x < row.nb_pixels; ++x )
+        had::computeQuantizedDistortionsPixel( row, x );
+}
+
+
+
+// Compare the bytes [x, x_end) of two runs, for the tails of the segments
+inline void compareBytesTail( const unsigned char* values_a,
+                              const unsigned char* values_b,
+                                    int            x,
+                                    int            x_end,
+                                    int*           io_sum,
+                                    int*           io_max )
+{
+    for( ; x < x_end; ++x )
+    {
+        int difference = values_a[ x ] > values_b[ x ] ? values_a[ x ] - values_b[ x ] : values_b[ x ] - values_a[ x ];
+        *io_sum += difference;
+        *io_max = std::max( *io_max, difference );
+    }
+}
+
+
+void compareBytesScalar( const unsigned char* values_a,
+                         const unsigned char* values_b,
+                               int            nb_values,
+                               int            size_segment,
+                               int*           io_sums,
+                               int*           io_maxs )
+{
+    for( int x = 0, segment = 0; x < nb_values; x += size_segment, ++segment )
+        compareBytesTail( values_a, values_b, x, std::min( x + size_segment, nb_values ), &io_sums[ segment ], &io_maxs[ segment ] );
+}
+
+
+void accumulateBytesScalar( const unsigned char*   values,
+                                  int              nb_values,
+                                  boost::uint16_t* io_sums )
+{
+    for( int id = 0; id < nb_values; ++id )
+        io_sums[ id ] += values[ id ];
+}
+
+
+
+// Add the moments of the bytes [id, nb_values) of a run, for the tails of the
+// vectorized kernels
+inline void accumulateMomentsTail( const unsigned char*  values,
+                                         int             id,
+                                         int             nb_values,
+                                         boost::int32_t* io_sums,
+                                         boost::int32_t* io_squares,
+                                         boost::int32_t* io_products_1,
+                                         boost::int32_t* io_products_2 )
+{
+    for( ; id < nb_values; ++id )
+    {
+        int value = values[ id ];
+        io_sums[ id ] += value;
+        io_squares[ id ] += value * value;
+        if( id + 1 < nb_values ) io_products_1[ id ] += value * values[ id + 1 ];
+        if( id + 2 < nb_values ) io_products_2[ id ] += value * values[ id + 2 ];
+    }
+}
+
+
+void accumulateMomentsScalar( const unsigned char*  values,
+                                    int             nb_values,
+                                    boost::int32_t* io_sums,
+                                    boost::int32_t* io_squares,
+                                    boost::int32_t* io_products_1,
+                                    boost::int32_t* io_products_2 )
+{
+    accumulateMomentsTail( values, 0, nb_values, io_sums, io_squares, io_products_1, io_products_2 );
+}
+
+#ifdef HAD_X86_KERNELS
+
+__attribute__(( target( "sse2" ) ))
+void computeDistortionsSSE2( const had::DistortionRow& row )
+{
+    const float* const* coefficients = row.coefficients;
+    const __m128 one = _mm_set1_ps( 1.0f );
+    int x = 0;
+    for( ; x + 4 <= row.nb_pixels; x += 4 )
+    {
+        __m128 b = _mm_loadu_ps( row.pixel[ 0 ] + x );
+        __m128 g = _mm_loadu_ps( row.pixel[ 1 ] + x );
+        __m128 r = _mm_loadu_ps( row.pixel[ 2 ] + x );
+
+        __m128 bdist = _mm_mul_ps( b, _mm_loadu_ps( coefficients[ had::COEF_BRIGHTNESS ] + x ) );
+        bdist = _mm_add_ps( bdist, _mm_mul_ps( g, _mm_loadu_ps( coefficients[ had::COEF_BRIGHTNESS + 1 ] + x ) ) );
+        bdist = _mm_add_ps( bdist, _mm_mul_ps( r, _mm_loadu_ps( coefficients[ had::COEF_BRIGHTNESS + 2 ] + x ) ) );
+
+        __m128 cb = _mm_mul_ps( b, _mm_loadu_ps( coefficients[ had::COEF_SCALE ] + x ) );
+        __m128 cg = _mm_mul_ps( g, _mm_loadu_ps( coefficients[ had::COEF_SCALE + 1 ] + x ) );
+        __m128 cr = _mm_mul_ps( r, _mm_loadu_ps( coefficients[ had::COEF_SCALE + 2 ] + x ) );
+        cb = _mm_sub_ps( cb, _mm_mul_ps( bdist, _mm_loadu_ps( coefficients[ had::COEF_MEAN_SCALED ] + x ) ) );
+        cg = _mm_sub_ps( cg, _mm_mul_ps( bdist, _mm_loadu_ps( coefficients[ had::COEF_MEAN_SCALED + 1 ] + x ) ) );
+        cr = _mm_sub_ps( cr, _mm_mul_ps( bdist, _mm_loadu_ps( coefficients[ had::COEF_MEAN_SCALED + 2 ] + x ) ) );
+
+        __m128 cdist = _mm_mul_ps( cb, cb );
+        cdist = _mm_add_ps( cdist, _mm_mul_ps( cg, cg ) );
+        cdist = _mm_add_ps( cdist, _mm_mul_ps( cr, cr ) );
+
+        __m128 bdist_norm = _mm_mul_ps( _mm_sub_ps( bdist, one ), _mm_loadu_ps( coefficients[ had::COEF_INV_BDIST_VARIATION ] + x ) );
+        _mm_storeu_ps( row.out_bdist_norm + x, bdist_norm );
+        _mm_storeu_ps( row.out_cdist_norm_squared + x, cdist );
+    }
+
+    for( ; x < row.nb_pixels; ++x )
+        had::computeDistortionsPixel( row, x );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+void computeDistortionsAVX2( const had::DistortionRow& row )
+{
+    const float* const* coefficients = row.coefficients;
+    const __m256 one = _mm256_set1_ps( 1.0f );
+    int x = 0;
+    for( ; x + 8 <= row.nb_pixels; x += 8 )
+    {
+        __m256 b = _mm256_loadu_ps( row.pixel[ 0 ] + x );
+        __m256 g = _mm256_loadu_ps( row.pixel[ 1 ] + x );
+        __m256 r = _mm256_loadu_ps( row.pixel[ 2 ] + x );
+
+        __m256 bdist = _mm256_mul_ps( b, _mm256_loadu_ps( coefficients[ had::COEF_BRIGHTNESS ] + x ) );
+        bdist = _mm256_add_ps( bdist, _mm256_mul_ps( g, _mm256_loadu_ps( coefficients[ had::COEF_BRIGHTNESS + 1 ] + x ) ) );
+        bdist = _mm256_add_ps( bdist, _mm256_mul_ps( r, _mm256_loadu_ps( coefficients[ had::COEF_BRIGHTNESS + 2 ] + x ) ) );
+
+        __m256 cb = _mm256_mul_ps( b, _mm256_loadu_ps( coefficients[ had::COEF_SCALE ] + x ) );
+        __m256 cg = _mm256_mul_ps( g, _mm256_loadu_ps( coefficients[ had::COEF_SCALE + 1 ] + x ) );
+        __m256 cr = _mm256_mul_ps( r, _mm256_loadu_ps( coefficients[ had::COEF_SCALE + 2 ] + x ) );
+        cb = _mm256_sub_ps( cb, _mm256_mul_ps( bdist, _mm256_loadu_ps( coefficients[ had::COEF_MEAN_SCALED ] + x ) ) );
+        cg = _mm256_sub_ps( cg, _mm256_mul_ps( bdist, _mm256_loadu_ps( coefficients[ had::COEF_MEAN_SCALED + 1 ] + x ) ) );
+        cr = _mm256_sub_ps( cr, _mm256_mul_ps( bdist, _mm256_loadu_ps( coefficients[ had::COEF_MEAN_SCALED + 2 ] + x ) ) );
+
+        __m256 cdist = _mm256_mul_ps( cb, cb );
+        cdist = _mm256_add_ps( cdist, _mm256_mul_ps( cg, cg ) );
+        cdist = _mm256_add_ps( cdist, _mm256_mul_ps( cr, cr ) );
+
+        __m256 bdist_norm = _mm256_mul_ps( _mm256_sub_ps( bdist, one ), _mm256_loadu_ps( coefficients[ had::COEF_INV_BDIST_VARIATION ] + x ) );
+        _mm256_storeu_ps( row.out_bdist_norm + x, bdist_norm );
+        _mm256_storeu_ps( row.out_cdist_norm_squared + x, cdist );
+    }
+
+    for( ; x < row.nb_pixels; ++x )
+        had::computeDistortionsPixel( row, x );
+}
+
+
+__attribute__(( target( "avx512f" ) ))
+void computeDistortionsAVX512( const had::DistortionRow& row )
+{
+    const float* const* coefficients = row.coefficients;
+    const __m512 one = _mm512_set1_ps( 1.0f );
+    int x = 0;
+    for( ; x + 16 <= row.nb_pixels; x += 16 )
+    {
+        __m512 b = _mm512_loadu_ps( row.pixel[ 0 ] + x );
+        __m512 g = _mm512_loadu_ps( row.pixel[ 1 ] + x );
+        __m512 r = _mm512_loadu_ps( row.pixel[ 2 ] + x );
+
+        __m512 bdist = _mm512_mul_ps( b, _mm512_loadu_ps( coefficients[ had::COEF_BRIGHTNESS ] + x ) );
+        bdist = _mm512_add_ps( bdist, _mm512_mul_ps( g, _mm512_loadu_ps( coefficients[ had::COEF_BRIGHTNESS + 1 ] + x ) ) );
+        bdist = _mm512_add_ps( bdist, _mm512_mul_ps( r, _mm512_loadu_ps( coefficients[ had::COEF_BRIGHTNESS + 2 ] + x ) ) );
+
+        __m512 cb = _mm512_mul_ps( b, _mm512_loadu_ps( coefficients[ had::COEF_SCALE ] + x ) );
+        __m512 cg = _mm512_mul_ps( g, _mm512_loadu_ps( coefficients[ had::COEF_SCALE + 1 ] + x ) );
+        __m512 cr = _mm512_mul_ps( r, _mm512_loadu_ps( coefficients[ had::COEF_SCALE + 2 ] + x ) );
+        cb = _mm512_sub_ps( cb, _mm512_mul_ps( bdist, _mm512_loadu_ps( coefficients[ had::COEF_MEAN_SCALED ] + x ) ) );
+        cg = _mm512_sub_ps( cg, _mm512_mul_ps( bdist, _mm512_loadu_ps( coefficients[ had::COEF_MEAN_SCALED + 1 ] + x ) ) );
+        cr = _mm512_sub_ps( cr, _mm512_mul_ps( bdist, _mm512_loadu_ps( coefficients[ had::COEF_MEAN_SCALED + 2 ] + x ) ) );
+
+        __m512 cdist = _mm512_mul_ps( cb, cb );
+        cdist = _mm512_add_ps( cdist, _mm512_mul_ps( cg, cg ) );
+        cdist = _mm512_add_ps( cdist, _mm512_mul_ps( cr, cr ) );
+
+        __m512 bdist_norm = _mm512_mul_ps( _mm512_sub_ps( bdist, one ), _mm512_loadu_ps( coefficients[ had::COEF_INV_BDIST_VARIATION ] + x ) );
+        _mm512_storeu_ps( row.out_bdist_norm + x, bdist_norm );
+        _mm512_storeu_ps( row.out_cdist_norm_squared + x, cdist );
+    }
+
+    for( ; x < row.nb_pixels; ++x )
+        had::computeDistortionsPixel( row, x );
+}
+
+
+// The quantized kernels load the 16-bit values and the 8-bit exponents, and
+// widen them to 32-bit lanes. The unit of an exponent is built from its bits,
+// as in had::getShiftUnit().
+
+__attribute__(( target( "sse2" ) ))
+void computeQuantizedDistortionsSSE2( const had::QuantizedDistortionRow& row )
+{
+    const boost::uint16_t* const* values = row.values;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32( 127 );
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 unit_mean = _mm_set1_ps( row.unit_mean );
+    int x = 0;
+    for( ; x + 4 <= row.nb_pixels; x += 4 )
+    {
+        __m128 pixel[ 3 ];
+        __m128 value[ had::NB_QUANTIZED_VALUES ];
+        __m128 unit[ had::NB_QUANTIZED_EXPONENTS ];
+        for( int id = 0; id < 3; ++id )
+            pixel[ id ] = _mm_loadu_ps( row.pixel[ id ] + x );
+        for( int id = 0; id < had::NB_QUANTIZED_VALUES; ++id )
+            value[ id ] = _mm_cvtepi32_ps( _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i*) ( values[ id ] + x ) ), zero ) );
+        for( int id = 0; id < had::NB_QUANTIZED_EXPONENTS; ++id )
+        {
+            boost::int32_t bytes;
+            memcpy( &bytes, row.exponents[ id ] + x, sizeof( bytes ) );
+            __m128i exponent = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( bytes ), zero ), zero );
+            unit[ id ] = _mm_castsi128_ps( _mm_slli_epi32( _mm_sub_epi32( bias, exponent ), 23 ) );
+        }
+
+        // SSE2 has no 32-bit integer multiplication, but the products are
+        // below 2^24, so they are exact in float, and summed as integers
+        __m128i brightness = _mm_cvttps_epi32( _mm_mul_ps( pixel[ 0 ], value[ had::QVALUE_BRIGHTNESS ] ) );
+        brightness = _mm_add_epi32( brightness, _mm_cvttps_epi32( _mm_mul_ps( pixel[ 1 ], value[ had::QVALUE_BRIGHTNESS + 1 ] ) ) );
+        brightness = _mm_add_epi32( brightness, _mm_cvttps_epi32( _mm_mul_ps( pixel[ 2 ], value[ had::QVALUE_BRIGHTNESS + 2 ] ) ) );
+        __m128 bdist = _mm_mul_ps( _mm_cvtepi32_ps( brightness ), unit[ had::QEXPONENT_BRIGHTNESS ] );
+
+        __m128 cdist = _mm_setzero_ps();
+        for( int id = 0; id < 3; ++id )
+        {
+            __m128 mean = _mm_mul_ps( value[ had::QVALUE_MEAN + id ], unit_mean );
+            __m128 scale = _mm_mul_ps( value[ had::QVALUE_SCALE + id ], unit[ had::QEXPONENT_SCALE ] );
+            __m128 c = _mm_mul_ps( _mm_sub_ps( pixel[ id ], _mm_mul_ps( bdist, mean ) ), scale );
+            cdist = id == 0 ? _mm_mul_ps( c, c ) : _mm_add_ps( cdist, _mm_mul_ps( c, c ) );
+        }
+
+        __m128 inv_bdist_variation = _mm_mul_ps( value[ had::QVALUE_INV_BDIST_VARIATION ], unit[ had::QEXPONENT_INV_BDIST_VARIATION ] );
+        _mm_storeu_ps( row.out_bdist_norm + x, _mm_mul_ps( _mm_sub_ps( bdist, one ), inv_bdist_variation ) );
+        _mm_storeu_ps( row.out_cdist_norm_squared + x, cdist );
+    }
+
+    for( ; x < row.nb_pixels; ++x )
+        had::computeQuantizedDistortionsPixel( row, x );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+void computeQuantizedDistortionsAVX2( const had::QuantizedDistortionRow& row )
+{
+    const boost::uint16_t* const* values = row.values;
+    const __m256i bias = _mm256_set1_epi32( 127 );
+    const __m256 one = _mm256_set1_ps( 1.0f );
+    const __m256 unit_mean = _mm256_set1_ps( row.unit_mean );
+    int x = 0;
+    for( ; x + 8 <= row.nb_pixels; x += 8 )
+    {
+        __m256 pixel[ 3 ];
+        __m256i value[ had::NB_QUANTIZED_VALUES ];
+        __m256 unit[ had::NB_QUANTIZED_EXPONENTS ];
+        for( int id = 0; id < 3; ++id )
+            pixel[ id ] = _mm256_loadu_ps( row.pixel[ id ] + x );
+        for( int id = 0; id < had::NB_QUANTIZED_VALUES; ++id )
+            value[ id ] = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*) ( values[ id ] + x ) ) );
+        for( int id = 0; id < had::NB_QUANTIZED_EXPONENTS; ++id )
+        {
+            __m256i exponent = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*) ( row.exponents[ id ] + x ) ) );
+            unit[ id ] = _mm256_castsi256_ps( _mm256_slli_epi32( _mm256_sub_epi32( bias, exponent ), 23 ) );
+        }
+
+        __m256i brightness = _mm256_mullo_epi32( _mm256_cvttps_epi32( pixel[ 0 ] ), value[ had::QVALUE_BRIGHTNESS ] );
+        brightness = _mm256_add_epi32( brightness, _mm256_mullo_epi32( _mm256_cvttps_epi32( pixel[ 1 ] ), value[ had::QVALUE_BRIGHTNESS + 1 ] ) );
+        brightness = _mm256_add_epi32( brightness, _mm256_mullo_epi32( _mm256_cvttps_epi32( pixel[ 2 ] ), value[ had::QVALUE_BRIGHTNESS + 2 ] ) );
+        __m256 bdist = _mm256_mul_ps( _mm256_cvtepi32_ps( brightness ), unit[ had::QEXPONENT_BRIGHTNESS ] );
+
+        __m256 cdist = _mm256_setzero_ps();
+        for( int id = 0; id < 3; ++id )
+        {
+            __m256 mean = _mm256_mul_ps( _mm256_cvtepi32_ps( value[ had::QVALUE_MEAN + id ] ), unit_mean );
+            __m256 scale = _mm256_mul_ps( _mm256_cvtepi32_ps( value[ had::QVALUE_SCALE + id ] ), unit[ had::QEXPONENT_SCALE ] );
+            __m256 c = _mm256_mul_ps( _mm256_sub_ps( pixel[ id ], _mm256_mul_ps( bdist, mean ) ), scale );
+            cdist = id == 0 ? _mm256_mul_ps( c, c ) : _mm256_add_ps( cdist, _mm256_mul_ps( c, c ) );
+        }
+
+        __m256 inv_bdist_variation = _mm256_mul_ps( _mm256_cvtepi32_ps( value[ had::QVALUE_INV_BDIST_VARIATION ] ), unit[ had::QEXPONENT_INV_BDIST_VARIATION ] );
+        _mm256_storeu_ps( row.out_bdist_norm + x, _mm256_mul_ps( _mm256_sub_ps( bdist, one ), inv_bdist_variation ) );
+        _mm256_storeu_ps( row.out_cdist_norm_squared + x, cdist );
+    }
+
+    for( ; x < row.nb_pixels; ++x )
+        had::computeQuantizedDistortionsPixel( row, x );
+}
+
+
+__attribute__(( target( "avx512f" ) ))
+void computeQuantizedDistortionsAVX512( const had::QuantizedDistortionRow& row )
+{
+    const boost::uint16_t* const* values = row.values;
+    const __m512i bias = _mm512_set1_epi32( 127 );
+    const __m512 one = _mm512_set1_ps( 1.0f );
+    const __m512 unit_mean = _mm512_set1_ps( row.unit_mean );
+    int x = 0;
+    for( ; x + 16 <= row.nb_pixels; x += 16 )
+    {
+        __m512 pixel[ 3 ];
+        __m512i value[ had::NB_QUANTIZED_VALUES ];
+        __m512 unit[ had::NB_QUANTIZED_EXPONENTS ];
+        for( int id = 0; id < 3; ++id )
+            pixel[ id ] = _mm512_loadu_ps( row.pixel[ id ] + x );
+        for( int id = 0; id < had::NB_QUANTIZED_VALUES; ++id )
+            value[ id ] = _mm512_cvtepu16_epi32( _mm256_loadu_si256( (const __m256i*) ( values[ id ] + x ) ) );
+        for( int id = 0; id < had::NB_QUANTIZED_EXPONENTS; ++id )
+        {
+            __m512i exponent = _mm512_cvtepu8_epi32( _mm_loadu_si128( (const __m128i*) ( row.exponents[ id ] + x ) ) );
+            unit[ id ] = _mm512_castsi512_ps( _mm512_slli_epi32( _mm512_sub_epi32( bias, exponent ), 23 ) );
+        }
+
+        __m512i brightness = _mm512_mullo_epi32( _mm512_cvttps_epi32( pixel[ 0 ] ), value[ had::QVALUE_BRIGHTNESS ] );
+        brightness = _mm512_add_epi32( brightness, _mm512_mullo_epi32( _mm512_cvttps_epi32( pixel[ 1 ] ), value[ had::QVALUE_BRIGHTNESS + 1 ] ) );
+        brightness = _mm512_add_epi32( brightness, _mm512_mullo_epi32( _mm512_cvttps_epi32( pixel[ 2 ] ), value[ had::QVALUE_BRIGHTNESS + 2 ] ) );
+        __m512 bdist = _mm512_mul_ps( _mm512_cvtepi32_ps( brightness ), unit[ had::QEXPONENT_BRIGHTNESS ] );
+
+        __m512 cdist = _mm512_setzero_ps();
+        for( int id = 0; id < 3; ++id )
+        {
+            __m512 mean = _mm512_mul_ps( _mm512_cvtepi32_ps( value[ had::QVALUE_MEAN + id ] ), unit_mean );
+            __m512 scale = _mm512_mul_ps( _mm512_cvtepi32_ps( value[ had::QVALUE_SCALE + id ] ), unit[ had::QEXPONENT_SCALE ] );
+            __m512 c = _mm512_mul_ps( _mm512_sub_ps( pixel[ id ], _mm512_mul_ps( bdist, mean ) ), scale );
+            cdist = id == 0 ? _mm512_mul_ps( c, c ) : _mm512_add_ps( cdist, _mm512_mul_ps( c, c ) );
+        }
+
+        __m512 inv_bdist_variation = _mm512_mul_ps( _mm512_cvtepi32_ps( value[ had::QVALUE_INV_BDIST_VARIATION ] ), unit[ had::QEXPONENT_INV_BDIST_VARIATION ] );
+        _mm512_storeu_ps( row.out_bdist_norm + x, _mm512_mul_ps( _mm512_sub_ps( bdist, one ), inv_bdist_variation ) );
+        _mm512_storeu_ps( row.out_cdist_norm_squared + x, cdist );
+    }
+
+    for( ; x < row.nb_pixels; ++x )
+        had::computeQuantizedDistortionsPixel( row, x );
+}
+
+
+// The absolute differences of bytes are the saturated differences in both
+// directions, or-ed together, and their sums are computed by psadbw against
+// zero. The sums and maxima of a segment are reduced once, at its end.
+
+__attribute__(( target( "sse2" ) ))
+inline void reduceDifferencesSSE2( __m128i sum, __m128i max, int* io_sum, int* io_max )
+{
+    max = _mm_max_epu8( max, _mm_srli_si128( max, 8 ) );
+    max = _mm_max_epu8( max, _mm_srli_si128( max, 4 ) );
+    max = _mm_max_epu8( max, _mm_srli_si128( max, 2 ) );
+    max = _mm_max_epu8( max, _mm_srli_si128( max, 1 ) );
+    *io_sum += _mm_cvtsi128_si32( sum ) + _mm_cvtsi128_si32( _mm_srli_si128( sum, 8 ) );
+    *io_max = std::max( *io_max, _mm_cvtsi128_si32( max ) & 0xFF );
+}
+
+
+__attribute__(( target( "sse2" ) ))
+void compareBytesSSE2( const unsigned char* values_a,
+                       const unsigned char* values_b,
+                             int            nb_values,
+                             int            size_segment,
+                             int*           io_sums,
+                             int*           io_maxs )
+{
+    const __m128i zero = _mm_setzero_si128();
+    for( int x_begin = 0, segment = 0; x_begin < nb_values; x_begin += size_segment, ++segment )
+    {
+        int x_end = std::min( x_begin + size_segment, nb_values );
+        __m128i sum = zero;
+        __m128i max = zero;
+        int x = x_begin;
+        for( ; x + 16 <= x_end; x += 16 )
+        {
+            __m128i a = _mm_loadu_si128( (const __m128i*) ( values_a + x ) );
+            __m128i b = _mm_loadu_si128( (const __m128i*) ( values_b + x ) );
+            __m128i difference = _mm_or_si128( _mm_subs_epu8( a, b ), _mm_subs_epu8( b, a ) );
+            sum = _mm_add_epi64( sum, _mm_sad_epu8( difference, zero ) );
+            max = _mm_max_epu8( max, difference );
+        }
+        reduceDifferencesSSE2( sum, max, &io_sums[ segment ], &io_maxs[ segment ] );
+        compareBytesTail( values_a, values_b, x, x_end, &io_sums[ segment ], &io_maxs[ segment ] );
+    }
+}
+
+
+// The reduction and the 16-byte step are written again for AVX2, because the
+// legacy SSE encoding of the SSE2 functions would pay for the transition from
+// AVX at each call.
+
+__attribute__(( target( "avx2" ) ))
+void compareBytesAVX2( const unsigned char* values_a,
+                       const unsigned char* values_b,
+                             int            nb_values,
+                             int            size_segment,
+                             int*           io_sums,
+                             int*           io_maxs )
+{
+    const __m256i zero = _mm256_setzero_si256();
+    for( int x_begin = 0, segment = 0; x_begin < nb_values; x_begin += size_segment, ++segment )
+    {
+        int x_end = std::min( x_begin + size_segment, nb_values );
+        __m256i sum_wide = zero;
+        __m256i max_wide = zero;
+        int x = x_begin;
+        for( ; x + 32 <= x_end; x += 32 )
+        {
+            __m256i a = _mm256_loadu_si256( (const __m256i*) ( values_a + x ) );
+            __m256i b = _mm256_loadu_si256( (const __m256i*) ( values_b + x ) );
+            __m256i difference = _mm256_or_si256( _mm256_subs_epu8( a, b ), _mm256_subs_epu8( b, a ) );
+            sum_wide = _mm256_add_epi64( sum_wide, _mm256_sad_epu8( difference, zero ) );
+            max_wide = _mm256_max_epu8( max_wide, difference );
+        }
+
+        __m128i sum = _mm_add_epi64( _mm256_castsi256_si128( sum_wide ), _mm256_extracti128_si256( sum_wide, 1 ) );
+        __m128i max = _mm_max_epu8( _mm256_castsi256_si128( max_wide ), _mm256_extracti128_si256( max_wide, 1 ) );
+        if( x + 16 <= x_end )
+        {
+            __m128i a = _mm_loadu_si128( (const __m128i*) ( values_a + x ) );
+            __m128i b = _mm_loadu_si128( (const __m128i*) ( values_b + x ) );
+            __m128i difference = _mm_or_si128( _mm_subs_epu8( a, b ), _mm_subs_epu8( b, a ) );
+            sum = _mm_add_epi64( sum, _mm_sad_epu8( difference, _mm_setzero_si128() ) );
+            max = _mm_max_epu8( max, difference );
+            x += 16;
+        }
+
+        max = _mm_max_epu8( max, _mm_srli_si128( max, 8 ) );
+        max = _mm_max_epu8( max, _mm_srli_si128( max, 4 ) );
+        max = _mm_max_epu8( max, _mm_srli_si128( max, 2 ) );
+        max = _mm_max_epu8( max, _mm_srli_si128( max, 1 ) );
+        io_sums[ segment ] += _mm_cvtsi128_si32( sum ) + _mm_cvtsi128_si32( _mm_srli_si128( sum, 8 ) );
+        io_maxs[ segment ] = std::max( io_maxs[ segment ], _mm_cvtsi128_si32( max ) & 0xFF );
+        compareBytesTail( values_a, values_b, x, x_end, &io_sums[ segment ], &io_maxs[ segment ] );
+    }
+}
+
+
+// The bytes are widened to 16 bits by interleaving them with zeros.
+
+__attribute__(( target( "sse2" ) ))
+void accumulateBytesSSE2( const unsigned char*   values,
+                                int              nb_values,
+                                boost::uint16_t* io_sums )
+{
+    const __m128i zero = _mm_setzero_si128();
+    int id = 0;
+    for( ; id + 16 <= nb_values; id += 16 )
+    {
+        __m128i bytes = _mm_loadu_si128( (const __m128i*) ( values + id ) );
+        __m128i* sums = (__m128i*) ( io_sums + id );
+        _mm_storeu_si128( sums,     _mm_add_epi16( _mm_loadu_si128( sums ),     _mm_unpacklo_epi8( bytes, zero ) ) );
+        _mm_storeu_si128( sums + 1, _mm_add_epi16( _mm_loadu_si128( sums + 1 ), _mm_unpackhi_epi8( bytes, zero ) ) );
+    }
+    for( ; id < nb_values; ++id )
+        io_sums[ id ] += values[ id ];
+}
+
+
+__attribute__(( target( "avx2" ) ))
+void accumulateBytesAVX2( const unsigned char*   values,
+                                int              nb_values,
+                                boost::uint16_t* io_sums )
+{
+    int id = 0;
+    for( ; id + 16 <= nb_values; id += 16 )
+    {
+        __m256i words = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) ( values + id ) ) );
+        __m256i* sums = (__m256i*) ( io_sums + id );
+        _mm256_storeu_si256( sums, _mm256_add_epi16( _mm256_loadu_si256( sums ), words ) );
+    }
+    for( ; id < nb_values; ++id )
+        io_sums[ id ] += values[ id ];
+}
+
+
+// The products of two bytes fit in 16 bits, so they are computed on 16-bit
+// lanes and widened to 32 bits only to be added. The runs are loaded at the
+// offsets 0, 1 and 2, so the vectorized loop stops 2 bytes before the end.
+
+__attribute__(( target( "sse2" ) ))
+inline void addWordsSSE2( boost::int32_t* io_sums, __m128i words )
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i* sums = (__m128i*) io_sums;
+    _mm_storeu_si128( sums,     _mm_add_epi32( _mm_loadu_si128( sums ),     _mm_unpacklo_epi16( words, zero ) ) );
+    _mm_storeu_si128( sums + 1, _mm_add_epi32( _mm_loadu_si128( sums + 1 ), _mm_unpackhi_epi16( words, zero ) ) );
+}
+
+
+__attribute__(( target( "sse2" ) ))
+void accumulateMomentsSSE2( const unsigned char*  values,
+                                  int             nb_values,
+                                  boost::int32_t* io_sums,
+                                  boost::int32_t* io_squares,
+                                  boost::int32_t* io_products_1,
+                                  boost::int32_t* io_products_2 )
+{
+    const __m128i zero = _mm_setzero_si128();
+    int id = 0;
+    for( ; id + 18 <= nb_values; id += 16 )
+    {
+        __m128i bytes_0 = _mm_loadu_si128( (const __m128i*) ( values + id ) );
+        __m128i bytes_1 = _mm_loadu_si128( (const __m128i*) ( values + id + 1 ) );
+        __m128i bytes_2 = _mm_loadu_si128( (const __m128i*) ( values + id + 2 ) );
+        __m128i words_0[ 2 ] = { _mm_unpacklo_epi8( bytes_0, zero ), _mm_unpackhi_epi8( bytes_0, zero ) };
+        __m128i words_1[ 2 ] = { _mm_unpacklo_epi8( bytes_1, zero ), _mm_unpackhi_epi8( bytes_1, zero ) };
+        __m128i words_2[ 2 ] = { _mm_unpacklo_epi8( bytes_2, zero ), _mm_unpackhi_epi8( bytes_2, zero ) };
+        for( int half = 0; half < 2; ++half )
+        {
+            int offset = id + 8 * half;
+            addWordsSSE2( io_sums + offset,       words_0[ half ] );
+            addWordsSSE2( io_squares + offset,    _mm_mullo_epi16( words_0[ half ], words_0[ half ] ) );
+            addWordsSSE2( io_products_1 + offset, _mm_mullo_epi16( words_0[ half ], words_1[ half ] ) );
+            addWordsSSE2( io_products_2 + offset, _mm_mullo_epi16( words_0[ half ], words_2[ half ] ) );
+        }
+    }
+    accumulateMomentsTail( values, id, nb_values, io_sums, io_squares, io_products_1, io_products_2 );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+inline void addWordsAVX2( boost::int32_t* io_sums, __m256i words )
+{
+    __m256i* sums = (__m256i*) io_sums;
+    _mm256_storeu_si256( sums,     _mm256_add_epi32( _mm256_loadu_si256( sums ),     _mm256_cvtepu16_epi32( _mm256_castsi256_si128( words ) ) ) );
+    _mm256_storeu_si256( sums + 1, _mm256_add_epi32( _mm256_loadu_si256( sums + 1 ), _mm256_cvtepu16_epi32( _mm256_extracti128_si256( words, 1 ) ) ) );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+void accumulateMomentsAVX2( const unsigned char*  values,
+                                  int             nb_values,
+                                  boost::int32_t* io_sums,
+                                  boost::int32_t* io_squares,
+                                  boost::int32_t* io_products_1,
+                                  boost::int32_t* io_products_2 )
+{
+    int id = 0;
+    for( ; id + 18 <= nb_values; id += 16 )
+    {
+        __m256i words_0 = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) ( values + id ) ) );
+        __m256i words_1 = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) ( values + id + 1 ) ) );
+        __m256i words_2 = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*) ( values + id + 2 ) ) );
+        addWordsAVX2( io_sums + id,       words_0 );
+        addWordsAVX2( io_squares + id,    _mm256_mullo_epi16( words_0, words_0 ) );
+        addWordsAVX2( io_products_1 + id, _mm256_mullo_epi16( words_0, words_1 ) );
+        addWordsAVX2( io_products_2 + id, _mm256_mullo_epi16( words_0, words_2 ) );
+    }
+    accumulateMomentsTail( values, id, nb_values, io_sums, io_squares, io_products_1, io_products_2 );
+}
+
+#endif // HAD_X86_KERNELS
+
+}
+
+
+had::KernelISA had::detectKernelISA()
+{
+#ifdef HAD_X86_KERNELS
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx512f" ) ) return KERNEL_AVX512;
+    if( __builtin_cpu_supports( "avx2" ) )    return KERNEL_AVX2;
+    if( __builtin_cpu_supports( "sse2" ) )    return KERNEL_SSE2;
+#endif
+    return KERNEL_SCALAR;
+}
+
+
+had::DistortionKernel had::getDistortionKernel( KernelISA isa )
+{
+    KernelISA supported = detectKernelISA();
+    if( isa > supported ) isa = supported;
+
+    switch( isa )
+    {
+#ifdef HAD_X86_KERNELS
+        case KERNEL_AVX512: return &computeDistortionsAVX512;
+        case KERNEL_AVX2:   return &computeDistortionsAVX2;
+        case KERNEL_SSE2:   return &computeDistortionsSSE2;
+#endif
+        default:            return &computeDistortionsScalar;
+    }
+}
+
+
+had::QuantizedDistortionKernel had::getQuantizedDistortionKernel( KernelISA isa )
+{
+    KernelISA supported = detectKernelISA();
+    if( isa > supported ) isa = supported;
+
+    switch( isa )
+    {
+#ifdef HAD_X86_KERNELS
+        case KERNEL_AVX512: return &computeQuantizedDistortionsAVX512;
+        case KERNEL_AVX2:   return &computeQuantizedDistortionsAVX2;
+        case KERNEL_SSE2:   return &computeQuantizedDistortionsSSE2;
+#endif
+        default:            return &computeQuantizedDistortionsScalar;
+    }
+}
+
+
+had::DifferenceKernel had::getDifferenceKernel( KernelISA isa )
+{
+    KernelISA supported = detectKernelISA();
+    if( isa > supported ) isa = supported;
+
+    switch( isa )
+    {
+#ifdef HAD_X86_KERNELS
+        case KERNEL_AVX512:
+        case KERNEL_AVX2:   return &compareBytesAVX2;
+        case KERNEL_SSE2:   return &compareBytesSSE2;
+#endif
+        default:            return &compareBytesScalar;
+    }
+}
+
+
+had::AccumulateKernel had::getAccumulateKernel( KernelISA isa )
+{
+    KernelISA supported = detectKernelISA();
+    if( isa > supported ) isa = supported;
+
+    switch( isa )
+    {
+#ifdef HAD_X86_KERNELS
+        case KERNEL_AVX512:
+        case KERNEL_AVX2:   return &accumulateBytesAVX2;
+        case KERNEL_SSE2:   return &accumulateBytesSSE2;
+#endif
+        default:            return &accumulateBytesScalar;
+    }
+}
+
+
+had::MomentKernel had::getMomentKernel( KernelISA isa )
+{
+    KernelISA supported = detectKernelISA();
+    if( isa > supported ) isa = supported;
+
+    switch( isa )
+    {
+#ifdef HAD_X86_KERNELS
+        case KERNEL_AVX512:
+        case KERNEL_AVX2:   return &accumulateMomentsAVX2;
+        case KERNEL_SSE2:   return &accumulateMomentsSSE2;
+#endif
+        default:            return &accumulateMomentsScalar;
+    }
+}
+
+const char* had::getKernelISAName( KernelISA isa )
+{
+    switch( isa )
+    {
+        case KERNEL_AVX512: return "AVX-512";
+        case KERNEL_AVX2:   return "AVX2";
+        case KERNEL_SSE2:   return "SSE2";
+        default:            return "scalar";
+    }
+}
@@ -0,0 +1,359 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_DISTORTION_KERNELS_HPP
+#define HAD_DISTORTION_KERNELS_HPP
+
+#include <boost/cstdint.hpp>
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Instruction sets for which a distortion kernel is available, from the
+* least to the most capable.
+*/
+/* ----------------------------------------------------------------------------*/
+enum KernelISA
+{
+    KERNEL_SCALAR = 0,  //!< Portable C++ code.
+    KERNEL_SSE2   = 1,  //!< 4 pixels per instruction.
+    KERNEL_AVX2   = 2,  //!< 8 pixels per instruction.
+    KERNEL_AVX512 = 3   //!< 16 pixels per instruction.
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Per-pixel coefficients of a trained model, as consumed by the
+* distortion kernels.
+*
+* The coefficients are baked at training time so that the kernels only
+* multiply and add, as suggested in Horprasert et al., 1999, Section 7:
+*
+*  - BRIGHTNESS: mean / ( denominator * stddev^2 ), see Eq. 5
+*  - SCALE: 1 / ( stddev * chromaticity distortion variation )
+*  - MEAN_SCALED: mean * SCALE
+*  - INV_BDIST_VARIATION: 1 / brightness distortion variation
+*
+* Each coefficient is stored in its own plane, the three channels of
+* BRIGHTNESS, SCALE and MEAN_SCALED being consecutive planes.
+*/
+/* ----------------------------------------------------------------------------*/
+enum DistortionCoefficient
+{
+    COEF_BRIGHTNESS          = 0,
+    COEF_SCALE               = 3,
+    COEF_MEAN_SCALED         = 6,
+    COEF_INV_BDIST_VARIATION = 9,
+    NB_COEFFICIENTS          = 10
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Arguments of a distortion kernel: a run of consecutive pixels of a row,
+* with the matching coefficients of a per-pixel model.
+*
+* All the arrays are planar (one array per channel) and hold nb_pixels values.
+*/
+/* ----------------------------------------------------------------------------*/
+struct DistortionRow
+{
+    const float* pixel[ 3 ];                        //!< B, G and R values of the input pixels.
+    const float* coefficients[ NB_COEFFICIENTS ];   //!< Coefficients of the model (see DistortionCoefficient).
+    float*       out_bdist_norm;                    //!< Computed normalized brightness distortions.
+    float*       out_cdist_norm_squared;            //!< Computed squared normalized chromaticity distortions.
+    int          nb_pixels;                         //!< Number of pixels in the run.
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Compute the normalized distortions of a run of pixels.
+*
+* See Horprasert et al., 1999, Eqs. 5, 6, 9 and 10
+*/
+/* ----------------------------------------------------------------------------*/
+typedef void (*DistortionKernel)( const DistortionRow& row );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Compute the normalized distortions of a single pixel of a run.
+*
+* This is the reference computation that all the kernels implement: the
+* vectorized kernels perform the same single-precision operations in the same
+* order, and without contraction into fused multiply-adds, so all the kernels
+* give bit-identical distortions.
+*
+* The chromaticity distortion is left squared, which saves a square root per
+* pixel: the threshold it is compared to is squared as well.
+*
+* @param row Run of pixels.
+* @param x Index of the pixel in the run.
+*/
+/* ----------------------------------------------------------------------------*/
+inline void computeDistortionsPixel( const DistortionRow& row, int x )
+{
+    float b = row.pixel[ 0 ][ x ];
+    float g = row.pixel[ 1 ][ x ];
+    float r = row.pixel[ 2 ][ x ];
+
+    // See Horprasert et al., 1999, Eq. 5
+    float bdist =   b * row.coefficients[ COEF_BRIGHTNESS     ][ x ]
+                  + g * row.coefficients[ COEF_BRIGHTNESS + 1 ][ x ]
+                  + r * row.coefficients[ COEF_BRIGHTNESS + 2 ][ x ];
+
+    // See Horprasert et al., 1999, Eqs. 6 and 10
+    float cb = b * row.coefficients[ COEF_SCALE     ][ x ] - bdist * row.coefficients[ COEF_MEAN_SCALED     ][ x ];
+    float cg = g * row.coefficients[ COEF_SCALE + 1 ][ x ] - bdist * row.coefficients[ COEF_MEAN_SCALED + 1 ][ x ];
+    float cr = r * row.coefficients[ COEF_SCALE + 2 ][ x ] - bdist * row.coefficients[ COEF_MEAN_SCALED + 2 ][ x ];
+
+    // See Horprasert et al., 1999, Eq. 9
+    row.out_bdist_norm[ x ] = ( bdist - 1 ) * row.coefficients[ COEF_INV_BDIST_VARIATION ][ x ];
+    row.out_cdist_norm_squared[ x ] = cb * cb + cg * cg + cr * cr;
+}
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Per-pixel values of a quantized model, as consumed by the quantized
+* distortion kernels (see QuantizedLCM).
+*
+* The values are 16-bit unsigned fixed-point numbers:
+*
+*  - BRIGHTNESS: mean / ( denominator * stddev^2 ), see Eq. 5, with the
+*    number of fractional bits of QEXPONENT_BRIGHTNESS
+*  - SCALE: 1 / ( stddev * chromaticity distortion variation ), with the
+*    number of fractional bits of QEXPONENT_SCALE
+*  - MEAN: mean, with the same number of fractional bits for all the pixels
+*  - INV_BDIST_VARIATION: 1 / brightness distortion variation, with the
+*    number of fractional bits of QEXPONENT_INV_BDIST_VARIATION
+*
+* Each value is stored in its own plane, the three channels of BRIGHTNESS,
+* SCALE and MEAN being consecutive planes.
+*/
+/* ----------------------------------------------------------------------------*/
+enum QuantizedValue
+{
+    QVALUE_BRIGHTNESS          = 0,
+    QVALUE_SCALE               = 3,
+    QVALUE_MEAN                = 6,
+    QVALUE_INV_BDIST_VARIATION = 9,
+    NB_QUANTIZED_VALUES        = 10
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Per-pixel numbers of fractional bits of a quantized model, each one
+* stored in its own 8-bit plane.
+*/
+/* ----------------------------------------------------------------------------*/
+enum QuantizedExponent
+{
+    QEXPONENT_BRIGHTNESS          = 0,
+    QEXPONENT_INV_BDIST_VARIATION = 1,
+    QEXPONENT_SCALE               = 2,
+    NB_QUANTIZED_EXPONENTS        = 3
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Arguments of a quantized distortion kernel: a run of consecutive
+* pixels of a row, with the matching values of a quantized model.
+*/
+/* ----------------------------------------------------------------------------*/
+struct QuantizedDistortionRow
+{
+    const float*           pixel[ 3 ];                          //!< B, G and R values of the input pixels.
+    const boost::uint16_t* values[ NB_QUANTIZED_VALUES ];       //!< Values of the model (see QuantizedValue).
+    const boost::uint8_t*  exponents[ NB_QUANTIZED_EXPONENTS ]; //!< Numbers of fractional bits of the model (see QuantizedExponent).
+    float                  unit_mean;                           //!< Value of the unit of MEAN.
+    float*                 out_bdist_norm;                      //!< Computed normalized brightness distortions.
+    float*                 out_cdist_norm_squared;              //!< Computed squared normalized chromaticity distortions.
+    int                    nb_pixels;                           //!< Number of pixels in the run.
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Compute the normalized distortions of a run of pixels from a
+* quantized model.
+*/
+/* ----------------------------------------------------------------------------*/
+typedef void (*QuantizedDistortionKernel)( const QuantizedDistortionRow& row );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Get the value of the unit of a number of fractional bits, 2^-shift.
+*
+* The float is built from its bits, as the vectorized kernels do.
+*
+* @param shift Number of fractional bits, in [0, 126].
+*/
+/* ----------------------------------------------------------------------------*/
+inline float getShiftUnit( int shift )
+{
+    union { boost::uint32_t bits; float value; } unit;
+    unit.bits = (boost::uint32_t) ( 127 - shift ) << 23;
+    return unit.value;
+}
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Compute the normalized distortions of a single pixel of a run, from
+* a quantized model.
+*
+* This is the reference computation of the quantized kernels, which give
+* bit-identical distortions, like the float ones. The brightness distortion is
+* computed exactly with integers: the products of the 16-bit brightness and of
+* the 8-bit pixels, and their sum, fit in 32 bits. The rest of the computation
+* is the one of computeDistortionsPixel(), with the values converted to float.
+*
+* @param row Run of pixels.
+* @param x Index of the pixel in the run.
+*/
+/* ----------------------------------------------------------------------------*/
+inline void computeQuantizedDistortionsPixel( const QuantizedDistortionRow& row, int x )
+{
+    const boost::uint16_t* const* values = row.values;
+    float b = row.pixel[ 0 ][ x ];
+    float g = row.pixel[ 1 ][ x ];
+    float r = row.pixel[ 2 ][ x ];
+
+    // See Horprasert et al., 1999, Eq. 5
+    boost::int32_t brightness =   (boost::int32_t) b * values[ QVALUE_BRIGHTNESS     ][ x ]
+                                + (boost::int32_t) g * values[ QVALUE_BRIGHTNESS + 1 ][ x ]
+                                + (boost::int32_t) r * values[ QVALUE_BRIGHTNESS + 2 ][ x ];
+    float bdist = (float) brightness * getShiftUnit( row.exponents[ QEXPONENT_BRIGHTNESS ][ x ] );
+
+    // See Horprasert et al., 1999, Eqs. 6 and 10
+    float unit_scale = getShiftUnit( row.exponents[ QEXPONENT_SCALE ][ x ] );
+    float cb = ( b - bdist * ( (float) values[ QVALUE_MEAN     ][ x ] * row.unit_mean ) ) * ( (float) values[ QVALUE_SCALE     ][ x ] * unit_scale );
+    float cg = ( g - bdist * ( (float) values[ QVALUE_MEAN + 1 ][ x ] * row.unit_mean ) ) * ( (float) values[ QVALUE_SCALE + 1 ][ x ] * unit_scale );
+    float cr = ( r - bdist * ( (float) values[ QVALUE_MEAN + 2 ][ x ] * row.unit_mean ) ) * ( (float) values[ QVALUE_SCALE + 2 ][ x ] * unit_scale );
+
+    // See Horprasert et al., 1999, Eq. 9
+    float inv_bdist_variation = (float) values[ QVALUE_INV_BDIST_VARIATION ][ x ] * getShiftUnit( row.exponents[ QEXPONENT_INV_BDIST_VARIATION ][ x ] );
+    row.out_bdist_norm[ x ] = ( bdist - 1 ) * inv_bdist_variation;
+    row.out_cdist_norm_squared[ x ] = cb * cb + cg * cg + cr * cr;
+}
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Compare two runs of bytes split into segments, ex: a row of two
+* images split into the rows of tiles, see IncrementalClassifier.
+*
+* @param values_a First run of bytes.
+* @param values_b Second run of bytes.
+* @param nb_values Number of bytes in each run.
+* @param size_segment Number of bytes of a segment, the last one being
+* possibly shorter.
+* @param io_sums Sums of the absolute differences of the bytes of each
+* segment, to which those of the run are added.
+* @param io_maxs Largest absolute differences of the bytes of each segment,
+* updated with those of the run.
+*/
+/* ----------------------------------------------------------------------------*/
+typedef void (*DifferenceKernel)( const unsigned char* values_a,
+                                  const unsigned char* values_b,
+                                        int            nb_values,
+                                        int            size_segment,
+                                        int*           io_sums,
+                                        int*           io_maxs );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Add a run of bytes to a run of 16-bit sums, ex: the rows of a block
+* of an image, see PyramidClassifier::downsample(). The sums wrap around past
+* 65535, so at most 257 runs can be added.
+*
+* @param values Run of bytes.
+* @param nb_values Number of bytes in the run.
+* @param io_sums Sums, to which the bytes are added.
+*/
+/* ----------------------------------------------------------------------------*/
+typedef void (*AccumulateKernel)( const unsigned char*   values,
+                                        int              nb_values,
+                                        boost::uint16_t* io_sums );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Add a run of bytes, their squares and the products of each byte with
+* the next two bytes to runs of 32-bit sums, ex: a row of a training frame,
+* see FrameStatistics::add(). For an interleaved BGR row, the products with
+* the next byte of B and G are B*G and G*R, and the product with the byte
+* after next of B is B*R. The sums do not overflow for up to 33025 runs.
+*
+* @param values Run of bytes.
+* @param nb_values Number of bytes in the run.
+* @param io_sums Sums, to which the bytes are added.
+* @param io_squares Sums, to which the squares of the bytes are added.
+* @param io_products_1 Sums, to which the products values[ i ] * values[ i + 1 ]
+* are added, for i < nb_values - 1.
+* @param io_products_2 Sums, to which the products values[ i ] * values[ i + 2 ]
+* are added, for i < nb_values - 2.
+*/
+/* ----------------------------------------------------------------------------*/
+typedef void (*MomentKernel)( const unsigned char*  values,
+                                    int             nb_values,
+                                    boost::int32_t* io_sums,
+                                    boost::int32_t* io_squares,
+                                    boost::int32_t* io_products_1,
+                                    boost::int32_t* io_products_2 );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Detect the most capable instruction set supported by the CPU.
+*/
+/* ----------------------------------------------------------------------------*/
+KernelISA detectKernelISA();
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Get the distortion kernel for an instruction set.
+*
+* @param isa Requested instruction set. If it is not supported by the CPU, the
+* most capable supported instruction set below it is used instead.
+*
+* @return The distortion kernel.
+*/
+/* ----------------------------------------------------------------------------*/
+DistortionKernel getDistortionKernel( KernelISA isa );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Get the quantized distortion kernel for an instruction set, see
+* getDistortionKernel().
+*/
+/* ----------------------------------------------------------------------------*/
+QuantizedDistortionKernel getQuantizedDistortionKernel( KernelISA isa );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Get the difference kernel for an instruction set, see
+* getDistortionKernel(). AVX-512 uses the AVX2 kernel.
+*/
+/* ----------------------------------------------------------------------------*/
+DifferenceKernel getDifferenceKernel( KernelISA isa );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Get the accumulation kernel for an instruction set, see
+* getDistortionKernel(). AVX-512 uses the AVX2 kernel.
+*/
+/* ----------------------------------------------------------------------------*/
+AccumulateKernel getAccumulateKernel( KernelISA isa );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Get the moment kernel for an instruction set, see
+* getDistortionKernel(). AVX-512 uses the AVX2 kernel.
+*/
+/* ----------------------------------------------------------------------------*/
+MomentKernel getMomentKernel( KernelISA isa );
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Get the name of an instruction set, for reporting purposes.
+*/
+/* ----------------------------------------------------------------------------*/
+const char* getKernelISAName( KernelISA isa );
+
+}
+
+#endif // HAD_DISTORTION_KERNELS_HPP
@@ -0,0 +1,288 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <cctype>
+#include <algorithm>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+#include "FrameLoader.hpp"
+#include "FrameSource.hpp"
+
+had::FrameLoader::FrameLoader( const vector<string>& names,
+                               int                   nb_threads,
+                               int                   capacity )
+: _next_job( 0 ), _next_slot( 0 ), _next_read( 0 ), _streaming( false ), _nb_finished( 0 ), _closed( false )
+{
+    for( unsigned int id = 0; id < names.size(); ++id )
+        expand( names[ id ] );
+
+    _nb_threads = nb_threads > 0 ? nb_threads : std::max( (int) boost::thread::hardware_concurrency(), 1 );
+    _capacity = capacity > 0 ? capacity : 2 * _nb_threads;
+    for( int id = 0; id < _nb_threads; ++id )
+        _threads.create_thread( boost::bind( &FrameLoader::work, this ) );
+}
+
+
+had::FrameLoader::~FrameLoader()
+{
+    {
+        boost::mutex::scoped_lock lock( _mutex );
+        _closed = true;
+        _changed.notify_all();
+    }
+    _threads.join_all();
+}
+
+
+bool had::FrameLoader::lessNatural( const string& a, const string& b )
+{
+    // The runs of digits are compared as numbers
+    size_t i = 0, j = 0;
+    while( i < a.size() && j < b.size() )
+    {
+        if( isdigit( a[ i ] ) && isdigit( b[ j ] ) )
+        {
+            size_t i_end = i, j_end = j;
+            while( i_end < a.size() && isdigit( a[ i_end ] ) ) ++i_end;
+            while( j_end < b.size() && isdigit( b[ j_end ] ) ) ++j_end;
+
+            // Without the leading zeros, the longer run is the larger number
+            size_t i_first = i, j_first = j;
+            while( i_first + 1 < i_end && a[ i_first ] == '0' ) ++i_first;
+            while( j_first + 1 < j_end && b[ j_first ] == '0' ) ++j_first;
+            if( i_end - i_first != j_end - j_first )
+                return i_end - i_first < j_end - j_first;
+
+            int compare = a.compare( i_first, i_end - i_first, b, j_first, j_end - j_first );
+            if( compare != 0 )
+                return compare < 0;
+            i = i_end;
+            j = j_end;
+        }
+        else
+        {
+            if( a[ i ] != b[ j ] )
+                return a[ i ] < b[ j ];
+            ++i;
+            ++j;
+        }
+    }
+    return a.size() - i < b.size() - j;
+}
+
+
+bool had::FrameLoader::isImageFile( const string& name )
+{
+    // Formats read by cv::imread()
+    static const char* extensions[] = { ".bmp", ".dib", ".jpeg", ".jpg", ".jpe", ".jp2", ".png",
+                                        ".pbm", ".pgm", ".ppm", ".sr", ".ras", ".tiff", ".tif" };
+    string extension = boost::filesystem::path( name ).extension().string();
+    std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+    for( unsigned int id = 0; id < sizeof( extensions ) / sizeof( extensions[ 0 ] ); ++id )
+        if( extension == extensions[ id ] )
+            return true;
+    return false;
+}
+
+
+bool had::FrameLoader::matchWildcards( const string& name, const string& pattern )
+{
+    // Greedy matching, which backtracks to the last '*' on a mismatch
+    size_t i = 0, j = 0, star = string::npos, star_i = 0;
+    while( i < name.size() )
+    {
+        if( j < pattern.size() && ( pattern[ j ] == '?' || pattern[ j ] == name[ i ] ) )
+        {
+            ++i;
+            ++j;
+        }
+        else if( j < pattern.size() && pattern[ j ] == '*' )
+        {
+            star = j++;
+            star_i = i;
+        }
+        else if( star != string::npos )
+        {
+            j = star + 1;
+            i = ++star_i;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while( j < pattern.size() && pattern[ j ] == '*' )
+        ++j;
+    return j == pattern.size();
+}
+
+
+void had::FrameLoader::expand( const string& name )
+{
+    namespace fs = boost::filesystem;
+    vector<string> files;
+    if( FrameSource::isSequencePattern( name ) )
+    {
+        // Like FrameSource, the sequence starts at 0 and stops at the first
+        // missing file
+        for( int index = 0; fs::exists( FrameSource::formatSequence( name, index ) ); ++index )
+            files.push_back( FrameSource::formatSequence( name, index ) );
+    }
+    else if( fs::is_directory( name ) || name.find_first_of( "*?" ) != string::npos )
+    {
+        fs::path directory = name;
+        string pattern = "*";
+        if( ! fs::is_directory( name ) )
+        {
+            directory = fs::path( name ).parent_path();
+            pattern = fs::path( name ).filename().string();
+        }
+
+        vector<string> entries;
+        fs::directory_iterator end;
+        for( fs::directory_iterator entry( directory.empty() ? fs::path( "." ) : directory ); entry != end; ++entry )
+        {
+            string filename = entry->path().filename().string();
+            if( fs::is_regular_file( entry->status() ) && isImageFile( filename ) && matchWildcards( filename, pattern ) )
+                entries.push_back( filename );
+        }
+        std::sort( entries.begin(), entries.end(), lessNatural );
+        for( unsigned int id = 0; id < entries.size(); ++id )
+            files.push_back( ( directory / entries[ id ] ).string() );
+    }
+    else
+    {
+        Job job;
+        job.name = name;
+        job.video = ! isImageFile( name );
+        _jobs.push_back( job );
+    }
+
+    for( unsigned int id = 0; id < files.size(); ++id )
+    {
+        Job job;
+        job.name = files[ id ];
+        job.video = false;
+        _jobs.push_back( job );
+    }
+}
+
+
+int had::FrameLoader::reserveSlot( boost::mutex::scoped_lock& lock )
+{
+    int slot = _next_slot++;
+    while( slot >= _next_read + _capacity && ! _closed )
+        _changed.wait( lock );
+    return _closed ? -1 : slot;
+}
+
+
+void had::FrameLoader::store( int slot, const cv::Mat& frame, const string& unreadable )
+{
+    boost::mutex::scoped_lock lock( _mutex );
+    _frames[ slot ] = frame;
+    if( frame.empty() && ! unreadable.empty() )
+        _unreadable[ slot ] = unreadable;
+    _changed.notify_all();
+}
+
+
+void had::FrameLoader::readVideo( const string& name )
+{
+    FrameSource source( name );
+    for( bool first = true; ; first = false )
+    {
+        int slot;
+        {
+            boost::mutex::scoped_lock lock( _mutex );
+            slot = reserveSlot( lock );
+        }
+        if( slot < 0 )
+            return;
+
+        // The slot is filled even after the last frame, with an empty frame
+        // that read() skips, and reported if the video has no frame at all
+        cv::Mat frame;
+        bool valid = source.read( frame );
+        store( slot, frame, first ? name : string() );
+        if( ! valid )
+            return;
+    }
+}
+
+
+void had::FrameLoader::work()
+{
+    for( ;; )
+    {
+        Job job;
+        int slot = -1;
+        {
+            boost::mutex::scoped_lock lock( _mutex );
+            while( _streaming && ! _closed )
+                _changed.wait( lock );
+
+            if( _closed || _next_job == _jobs.size() )
+                break;
+
+            job = _jobs[ _next_job++ ];
+            if( job.video )
+                _streaming = true;
+            else
+                slot = reserveSlot( lock );
+        }
+
+        if( job.video )
+        {
+            readVideo( job.name );
+            boost::mutex::scoped_lock lock( _mutex );
+            _streaming = false;
+            _changed.notify_all();
+        }
+        else if( slot >= 0 )
+        {
+            store( slot, cv::imread( job.name ), job.name );
+        }
+    }
+
+    boost::mutex::scoped_lock lock( _mutex );
+    ++_nb_finished;
+    _changed.notify_all();
+}
+
+
+bool had::FrameLoader::read( cv::Mat& out_frame )
+{
+    boost::mutex::scoped_lock lock( _mutex );
+    for( ;; )
+    {
+        // All the slots reserved have been filled once all the threads are
+        // finished
+        std::map<int, cv::Mat>::iterator frame = _frames.find( _next_read );
+        while( frame == _frames.end() && _nb_finished < _nb_threads )
+        {
+            _changed.wait( lock );
+            frame = _frames.find( _next_read );
+        }
+        if( frame == _frames.end() )
+            return false;
+
+        cv::Mat image = frame->second;
+        _frames.erase( frame );
+        std::map<int, string>::iterator unreadable = _unreadable.find( _next_read );
+        if( unreadable != _unreadable.end() )
+        {
+            std::cerr << "WARNING: cannot read " << unreadable->second << ", skipped" << std::endl;
+            _unreadable.erase( unreadable );
+        }
+        ++_next_read;
+        _changed.notify_all();
+        if( ! image.empty() )
+        {
+            out_frame = image;
+            return true;
+        }
+    }
+}
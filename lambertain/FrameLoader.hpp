@@ -0,0 +1,188 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_FRAME_LOADER_HPP
+#define HAD_FRAME_LOADER_HPP
+
+#include <map>
+#include <vector>
+using std::vector;
+#include <string>
+using std::string;
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <cv.h>
+#include <highgui.h>
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Reader of a set of frames that decodes them in parallel, ahead of
+* the caller.
+*
+* Each input is an image file, a directory (all its image files, in the order
+* of their names, see lessNatural()), a pattern with the wildcards '*' and '?'
+* in its file name (ex: "dataset/frame*.jpg"), an image sequence pattern (see
+* FrameSource), or a video file. The inputs are expanded into a list of files when the loader is
+* created, and a pool of threads then decodes the image files concurrently.
+* The frames are returned by read() in the order of the inputs, as soon as
+* they are decoded, so that the decoding overlaps with the processing of the
+* previous frames, like the training of a model.
+*
+* The threads stay at most a fixed number of frames ahead of read(), which
+* bounds the memory used whatever the number of frames. A video is read
+* sequentially by a single thread, and the inputs after it are decoded once
+* it has been read. The files that cannot be decoded are skipped by read(),
+* which prints a warning naming them on the standard error.
+*/
+/* ----------------------------------------------------------------------------*/
+class FrameLoader
+{
+private:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief File to decode.
+    */
+    /* ----------------------------------------------------------------------------*/
+    struct Job
+    {
+        string name;    //!< File name.
+        bool   video;   //!< True if the file is read as a video, false if it is an image.
+    };
+
+    vector<Job>               _jobs;         //!< Files to decode, in the order of the inputs.
+    int                       _capacity;     //!< Maximum number of frames decoded ahead of read().
+    int                       _nb_threads;   //!< Number of decoding threads.
+
+    std::map<int, cv::Mat>    _frames;       //!< Frames decoded and not read yet, by slot (empty if the file could not be decoded).
+    std::map<int, string>     _unreadable;   //!< Names of the files that could not be decoded and are not read yet, by slot.
+    unsigned int              _next_job;     //!< Index of the next job to start.
+    int                       _next_slot;    //!< Slot of the next frame to decode.
+    int                       _next_read;    //!< Slot of the next frame to return.
+    bool                      _streaming;    //!< True while a video is read, so that the next jobs wait for its last frame.
+    int                       _nb_finished;  //!< Number of threads that have no more jobs.
+    bool                      _closed;       //!< If true, the threads stop as soon as possible.
+    boost::mutex              _mutex;        //!< Protects all the members above, after the construction.
+    boost::condition_variable _changed;      //!< Signaled when a frame is decoded or read, or the state of the jobs changes.
+    boost::thread_group       _threads;      //!< Decoding threads.
+
+    FrameLoader( const FrameLoader& );
+    FrameLoader& operator=( const FrameLoader& );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Add the files of an input to the jobs.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void expand( const string& name );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Reserve the slot of the next frame, waiting while it would be too
+    * far ahead of read(). Called with the mutex locked.
+    *
+    * @return The slot, or -1 if the loader has been closed.
+    */
+    /* ----------------------------------------------------------------------------*/
+    int reserveSlot( boost::mutex::scoped_lock& lock );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Store a decoded frame in its slot.
+    *
+    * @param slot Slot of the frame.
+    * @param frame Decoded frame, empty if there is none.
+    * @param unreadable Name of the file reported by read() if the frame is
+    * empty, or an empty string if the file has simply no more frames.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void store( int slot, const cv::Mat& frame, const string& unreadable = string() );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Read all the frames of a video, in consecutive slots.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void readVideo( const string& name );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Loop of a decoding thread, which takes the jobs in order until
+    * there are none left.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void work();
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor, which expands the inputs and starts the decoding.
+    *
+    * @param names Inputs, see the description of the class.
+    * @param nb_threads Number of decoding threads (0 for one per core).
+    * @param capacity Maximum number of frames decoded ahead of read() (0 for
+    * twice the number of threads).
+    */
+    /* ----------------------------------------------------------------------------*/
+    FrameLoader( const vector<string>& names,
+                 int                   nb_threads = 0,
+                 int                   capacity = 0 );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Destructor, which stops the decoding and waits for the threads.
+    */
+    /* ----------------------------------------------------------------------------*/
+    ~FrameLoader();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Check whether a file name has the extension of an image format
+    * read by cv::imread().
+    */
+    /* ----------------------------------------------------------------------------*/
+    static bool isImageFile( const string& name );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Order of file names in which the runs of digits are compared as
+    * numbers, so that "frame2.jpg" comes before "frame10.jpg".
+    */
+    /* ----------------------------------------------------------------------------*/
+    static bool lessNatural( const string& a, const string& b );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Check whether a file name matches a pattern with the wildcards '*'
+    * (any sequence of characters) and '?' (any character).
+    */
+    /* ----------------------------------------------------------------------------*/
+    static bool matchWildcards( const string& name, const string& pattern );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of files to decode, videos counting as one.
+    */
+    /* ----------------------------------------------------------------------------*/
+    int getNbFiles() const { return _jobs.size(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the next frame, in the order of the inputs, waiting for it to
+    * be decoded. The files that cannot be decoded are skipped with a warning.
+    *
+    * @param out_frame Frame read (8-bit 3-channel image, CV_8UC3), which is
+    * not reused by the loader.
+    *
+    * @return False if all the frames have been read, true otherwise.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool read( cv::Mat& out_frame );
+};
+
+}
+
+#endif // HAD_FRAME_LOADER_HPP
@@ -0,0 +1,78 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <cstdio>
+#include <cctype>
+#include <vector>
+
+#include "FrameSource.hpp"
+
+had::FrameSource::FrameSource( const string& name, int first_index )
+: _name( name ), _sequence( isSequencePattern( name ) ), _index( first_index )
+{
+    if( ! _sequence )
+        _capture.open( name );
+}
+
+
+bool had::FrameSource::isSequencePattern( const string& name )
+{
+    // Look for a conversion such as %d, %04d or %5i, and ignore escaped %%
+    for( size_t i = 0; i < name.size(); ++i )
+    {
+        if( name[ i ] != '%' )
+            continue;
+
+        if( i + 1 < name.size() && name[ i + 1 ] == '%' )
+        {
+            ++i;
+            continue;
+        }
+
+        size_t j = i + 1;
+        while( j < name.size() && isdigit( name[ j ] ) )
+            ++j;
+
+        if( j < name.size() && ( name[ j ] == 'd' || name[ j ] == 'i' ) )
+            return true;
+    }
+    return false;
+}
+
+
+string had::FrameSource::formatSequence( const string& pattern, int index )
+{
+    std::vector<char> buffer( pattern.size() + 32 );
+    snprintf( &buffer[ 0 ], buffer.size(), pattern.c_str(), index );
+    return string( &buffer[ 0 ] );
+}
+
+
+bool had::FrameSource::isOpened()
+{
+    if( _sequence )
+        return true;
+    return _capture.isOpened();
+}
+
+
+bool had::FrameSource::read( cv::Mat& out_frame )
+{
+    if( _sequence )
+    {
+        out_frame = cv::imread( formatSequence( _name, _index ) );
+    }
+    else
+    {
+        // The capture may reuse its internal buffer, so the frame is cloned
+        // to allow the caller to keep it while the next one is read.
+        cv::Mat frame;
+        _capture >> frame;
+        out_frame = frame.clone();
+    }
+
+    if( out_frame.empty() )
+        return false;
+
+    ++_index;
+    return true;
+}
@@ -0,0 +1,89 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_FRAME_SOURCE_HPP
+#define HAD_FRAME_SOURCE_HPP
+
+#include <string>
+using std::string;
+
+#include <cv.h>
+#include <highgui.h>
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/** 
+* @brief Sequential reader of frames from a video file or a numbered image
+* sequence.
+*
+* If the name contains a printf-style integer conversion (ex:
+* "dataset/frame%d.jpg"), it is considered as an image sequence, which is read
+* from the first index until a file cannot be loaded. Otherwise, the name is
+* opened as a video file with cv::VideoCapture.
+*/
+/* ----------------------------------------------------------------------------*/
+class FrameSource
+{
+private:
+    string           _name;      //!< Video file name or image sequence pattern.
+    bool             _sequence;  //!< True if _name is an image sequence pattern.
+    int              _index;     //!< Index of the next frame to read.
+    cv::VideoCapture _capture;   //!< Video reader, used only if _sequence is false.
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Constructor.
+    * 
+    * @param name Video file name, or image sequence pattern.
+    * @param first_index Index of the first image of a sequence (ignored for
+    * video files).
+    */
+    /* ----------------------------------------------------------------------------*/
+    FrameSource( const string& name, int first_index = 0 );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Check whether the name is an image sequence pattern.
+    * 
+    * @param name File name.
+    * 
+    * @return True if name contains a printf-style integer conversion.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static bool isSequencePattern( const string& name );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Format an image sequence pattern with a frame index.
+    * 
+    * @param pattern Image sequence pattern (ex: "out/class%04d.jpg").
+    * @param index Frame index.
+    * 
+    * @return The formatted file name.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static string formatSequence( const string& pattern, int index );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Check if the source could be opened.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool isOpened();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Read the next frame.
+    * 
+    * @param out_frame Frame read (8-bit 3-channel image, CV_8UC3).
+    * 
+    * @return False if the end of the source has been reached, true otherwise.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool read( cv::Mat& out_frame );
+};
+
+}
+
+#endif // HAD_FRAME_SOURCE_HPP
@@ -0,0 +1,206 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include "FrameStatistics.hpp"
+
+const int had::FrameStatistics::MAX_BATCH_FRAMES;
+
+void had::FrameStatistics::addRows( const cv::Mat& image,
+                                          int      y_begin,
+                                          int      y_end )
+{
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        const unsigned char* row_image = image.ptr<unsigned char>( y );
+        double* sum[ NB_MOMENTS ];
+        for( int id = 0; id < NB_MOMENTS; ++id )
+            sum[ id ] = _sums[ id ].ptr<double>( y );
+
+        for( int x = 0; x < image.cols; ++x )
+        {
+            double b = row_image[ 3 * x ];
+            double g = row_image[ 3 * x + 1 ];
+            double r = row_image[ 3 * x + 2 ];
+            sum[ MOMENT_SUM         ][ x ] += b;
+            sum[ MOMENT_SUM + 1     ][ x ] += g;
+            sum[ MOMENT_SUM + 2     ][ x ] += r;
+            sum[ MOMENT_SUM_SQUARED     ][ x ] += b * b;
+            sum[ MOMENT_SUM_SQUARED + 1 ][ x ] += g * g;
+            sum[ MOMENT_SUM_SQUARED + 2 ][ x ] += r * r;
+            sum[ MOMENT_SUM_CROSS     ][ x ] += b * g;
+            sum[ MOMENT_SUM_CROSS + 1 ][ x ] += b * r;
+            sum[ MOMENT_SUM_CROSS + 2 ][ x ] += g * r;
+        }
+    }
+}
+
+
+void had::FrameStatistics::addBatchRows( const vector<cv::Mat>& images,
+                                          int              y_begin,
+                                          int              y_end )
+{
+    int cols = images[ 0 ].cols;
+    int nb_values = 3 * cols;
+    vector<boost::int32_t> sums( nb_values ), squares( nb_values ), products_1( nb_values ), products_2( nb_values );
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        double* sum[ NB_MOMENTS ];
+        for( int id = 0; id < NB_MOMENTS; ++id )
+            sum[ id ] = _sums[ id ].ptr<double>( y );
+
+        for( unsigned int first = 0; first < images.size(); first += MAX_BATCH_FRAMES )
+        {
+            unsigned int last = std::min( first + MAX_BATCH_FRAMES, (unsigned int) images.size() );
+            std::fill( sums.begin(), sums.end(), 0 );
+            std::fill( squares.begin(), squares.end(), 0 );
+            std::fill( products_1.begin(), products_1.end(), 0 );
+            std::fill( products_2.begin(), products_2.end(), 0 );
+            for( unsigned int id_image = first; id_image < last; ++id_image )
+                _kernel( images[ id_image ].ptr<unsigned char>( y ), nb_values, &sums[ 0 ], &squares[ 0 ], &products_1[ 0 ], &products_2[ 0 ] );
+
+            // The products of B with the next value and the one after are
+            // B*G and B*R, and the product of G with the next value is G*R
+            for( int x = 0; x < cols; ++x )
+            {
+                for( int id = 0; id < 3; ++id )
+                {
+                    sum[ MOMENT_SUM + id ][ x ]         += sums[ 3 * x + id ];
+                    sum[ MOMENT_SUM_SQUARED + id ][ x ] += squares[ 3 * x + id ];
+                }
+                sum[ MOMENT_SUM_CROSS     ][ x ] += products_1[ 3 * x ];
+                sum[ MOMENT_SUM_CROSS + 1 ][ x ] += products_2[ 3 * x ];
+                sum[ MOMENT_SUM_CROSS + 2 ][ x ] += products_1[ 3 * x + 1 ];
+            }
+        }
+    }
+}
+
+
+void had::FrameStatistics::prepare( const cv::Mat& image )
+{
+    CV_Assert( image.type() == CV_8UC3 );
+
+    if( _sums.empty() )
+    {
+        _sums.resize( NB_MOMENTS );
+        for( int id = 0; id < NB_MOMENTS; ++id )
+            _sums[ id ] = cv::Mat( image.size(), CV_64F, cv::Scalar::all( 0 ) );
+    }
+    CV_Assert( image.size() == _sums[ 0 ].size() );
+}
+
+
+void had::FrameStatistics::add( const cv::Mat& image, ThreadPool* pool )
+{
+    prepare( image );
+    if( pool )
+        pool->parallelFor( 0, image.rows, boost::bind( &FrameStatistics::addRows, this, boost::cref( image ), _1, _2 ) );
+    else
+        addRows( image, 0, image.rows );
+    ++_nb_frames;
+    addToSample( image );
+}
+
+
+void had::FrameStatistics::add( const vector<cv::Mat>& images, ThreadPool* pool )
+{
+    if( images.empty() )
+        return;
+
+    for( unsigned int id_image = 0; id_image < images.size(); ++id_image )
+        prepare( images[ id_image ] );
+
+    int rows = _sums[ 0 ].rows;
+    if( pool )
+        pool->parallelFor( 0, rows, boost::bind( &FrameStatistics::addBatchRows, this, boost::cref( images ), _1, _2 ) );
+    else
+        addBatchRows( images, 0, rows );
+
+    for( unsigned int id_image = 0; id_image < images.size(); ++id_image )
+    {
+        ++_nb_frames;
+        addToSample( images[ id_image ] );
+    }
+}
+
+
+void had::FrameStatistics::addToSample( const cv::Mat& image )
+{
+    // Reservoir sampling: after n frames, each of them is in the sample with
+    // the same probability. The frames are cloned, as the caller may reuse
+    // its buffer for the next one.
+    if( (int) _sample.size() < _sample_size )
+    {
+        _sample.push_back( image.clone() );
+    }
+    else
+    {
+        int id = _rng.uniform( 0, _nb_frames );
+        if( id < _sample_size )
+            _sample[ id ] = image.clone();
+    }
+}
+
+
+void had::FrameStatistics::clear()
+{
+    _sums.clear();
+    _sample.clear();
+    _nb_frames = 0;
+}
+
+
+void had::FrameStatistics::getPixelSums( int    y,
+                                         int    x,
+                                         double out_sum[ 3 ],
+                                         double out_cross[ 3 ][ 3 ] ) const
+{
+    for( int id = 0; id < 3; ++id )
+    {
+        out_sum[ id ] = _sums[ MOMENT_SUM + id ].at<double>( y, x );
+        out_cross[ id ][ id ] = _sums[ MOMENT_SUM_SQUARED + id ].at<double>( y, x );
+    }
+    out_cross[ 0 ][ 1 ] = out_cross[ 1 ][ 0 ] = _sums[ MOMENT_SUM_CROSS     ].at<double>( y, x );
+    out_cross[ 0 ][ 2 ] = out_cross[ 2 ][ 0 ] = _sums[ MOMENT_SUM_CROSS + 1 ].at<double>( y, x );
+    out_cross[ 1 ][ 2 ] = out_cross[ 2 ][ 1 ] = _sums[ MOMENT_SUM_CROSS + 2 ].at<double>( y, x );
+}
+
+
+void had::FrameStatistics::computeDistortionSums( const double  sum[ 3 ],
+                                                  const double  cross[ 3 ][ 3 ],
+                                                        double  nb_frames,
+                                                  const double  mean[ 3 ],
+                                                  const double  stddev[ 3 ],
+                                                  const double  brightness[ 3 ],
+                                                        double* out_bdist_sum,
+                                                        double* out_cdist_sum )
+{
+    // With k the brightness coefficients and w = mean / stddev^2, the sum of
+    // the squared chromaticity distortions is
+    // sum( p^2 / stddev^2 ) - 2 * sum( ( k.p ) ( w.p ) ) + |mean / stddev|^2 sum( ( k.p )^2 )
+    double w[ 3 ];
+    double bdist_sum = 0, mean_norm_squared = 0, pixel_norm_squared_sum = 0;
+    for( int id = 0; id < 3; ++id )
+    {
+        w[ id ] = mean[ id ] / ( stddev[ id ] * stddev[ id ] );
+        bdist_sum += brightness[ id ] * sum[ id ];
+        mean_norm_squared += mean[ id ] * w[ id ];
+        pixel_norm_squared_sum += cross[ id ][ id ] / ( stddev[ id ] * stddev[ id ] );
+    }
+
+    double bdist_squared_sum = 0, bdist_cross_sum = 0;
+    for( int i = 0; i < 3; ++i )
+    {
+        for( int j = 0; j < 3; ++j )
+        {
+            bdist_squared_sum += brightness[ i ] * brightness[ j ] * cross[ i ][ j ];
+            bdist_cross_sum   += brightness[ i ] * w[ j ] * cross[ i ][ j ];
+        }
+    }
+
+    *out_bdist_sum = std::max( bdist_squared_sum - 2 * bdist_sum + nb_frames, 0.0 );
+    *out_cdist_sum = std::max( pixel_norm_squared_sum - 2 * bdist_cross_sum + mean_norm_squared * bdist_squared_sum, 0.0 );
+}
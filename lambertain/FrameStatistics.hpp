@@ -0,0 +1,210 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_FRAME_STATISTICS_HPP
+#define HAD_FRAME_STATISTICS_HPP
+
+#include <vector>
+using std::vector;
+
+#include <cv.h>
+
+#include "ThreadPool.hpp"
+#include "DistortionKernels.hpp"
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Per-pixel running sums of a set of training frames, which are added
+* one at a time.
+*
+* The sums of the channels and of their products are enough to compute the
+* mean and standard deviation of each pixel, and the sums of its squared
+* brightness and chromaticity distortions for any model (see
+* computeDistortionSums()). The memory used does not depend on the number of
+* frames, except for an optional uniform random sample of the frames, which
+* the models use to select their thresholds.
+*
+* A batch of frames is added band of rows by band of rows: the values of a
+* row are summed over all the frames in 32-bit integers, which are exact, and
+* only then added to the planes, so the sums do not depend on the number of
+* threads and are the same as adding the frames one at a time.
+*/
+/* ----------------------------------------------------------------------------*/
+class FrameStatistics
+{
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Running sums, each one stored in its own CV_64F plane. The pixel
+    * values are integers, so the sums are exact.
+    */
+    /* ----------------------------------------------------------------------------*/
+    enum Moment
+    {
+        MOMENT_SUM         = 0, //!< Sums of B, G and R.
+        MOMENT_SUM_SQUARED = 3, //!< Sums of B*B, G*G and R*R.
+        MOMENT_SUM_CROSS   = 6, //!< Sums of B*G, B*R and G*R.
+        NB_MOMENTS         = 9
+    };
+
+    static const int MAX_BATCH_FRAMES = 32768;  //!< Largest number of frames whose sums fit in 32-bit integers.
+
+private:
+    vector<cv::Mat> _sums;          //!< Planes of running sums (see Moment).
+    int             _nb_frames;     //!< Number of frames added.
+    vector<cv::Mat> _sample;        //!< Uniform random sample of the frames added.
+    int             _sample_size;   //!< Maximum number of frames in _sample.
+    cv::RNG         _rng;           //!< Random generator used to sample the frames.
+    MomentKernel    _kernel;        //!< Kernel used to sum the rows of the frames.
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Add a band of rows of a frame to the running sums, see add().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void addRows( const cv::Mat& image, int y_begin, int y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Add a band of rows of a batch of frames to the running sums, see
+    * add().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void addBatchRows( const vector<cv::Mat>& images, int y_begin, int y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Allocate the running sums for the size of a first frame, and check
+    * the type and size of a frame.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void prepare( const cv::Mat& image );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Offer a frame to the sample, after it has been added to the sums.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void addToSample( const cv::Mat& image );
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor.
+    *
+    * @param sample_size Maximum number of frames kept in the sample, 0 to keep
+    * only the running sums.
+    */
+    /* ----------------------------------------------------------------------------*/
+    explicit FrameStatistics( int sample_size = 0 )
+    : _nb_frames( 0 ), _sample_size( sample_size ), _kernel( getMomentKernel( detectKernelISA() ) )
+    {
+    }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Add a frame to the running sums, and possibly to the sample.
+    *
+    * @param image Frame (8-bit 3-channel image, CV_8UC3), of the same size as
+    * the previous ones.
+    * @param pool Thread pool used to process the rows in parallel (NULL to use
+    * the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    void add( const cv::Mat& image, ThreadPool* pool = NULL );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Add a batch of frames to the running sums, and possibly to the
+    * sample, with the same result as adding them one at a time. The rows are
+    * read once from each frame, and the sums of a band of rows are kept in the
+    * cache while the frames are added.
+    *
+    * @param images Frames (8-bit 3-channel images, CV_8UC3), of the same size
+    * as the previous ones.
+    * @param pool Thread pool used to process the bands of rows in parallel
+    * (NULL to use the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    void add( const vector<cv::Mat>& images, ThreadPool* pool = NULL );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Remove all the frames, and release the memory.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void clear();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of frames added.
+    */
+    /* ----------------------------------------------------------------------------*/
+    int getNbFrames() const { return _nb_frames; }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the size of the frames, or an empty size if no frame has been
+    * added.
+    */
+    /* ----------------------------------------------------------------------------*/
+    cv::Size getSize() const { return _sums.empty() ? cv::Size() : _sums[ 0 ].size(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the sample of the frames added.
+    */
+    /* ----------------------------------------------------------------------------*/
+    const vector<cv::Mat>& getSample() const { return _sample; }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the running sums of a pixel.
+    *
+    * @param y Row of the pixel.
+    * @param x Column of the pixel.
+    * @param out_sum Sums of B, G and R.
+    * @param out_cross Sums of the products of the channels: out_cross[ i ][ j ]
+    * is the sum of the products of the channels i and j.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void getPixelSums( int    y,
+                       int    x,
+                       double out_sum[ 3 ],
+                       double out_cross[ 3 ][ 3 ] ) const;
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Compute the sums of the squared distortions of the values of a
+    * pixel in all the frames, with respect to a model of this pixel.
+    *
+    * The brightness distortion of a value p is a linear form k.p, so the sums
+    * of the squared distortions over the frames only depend on the running
+    * sums of p and of the products of its channels.
+    *
+    * See Horprasert et al., 1999, Eqs. 5 to 8
+    *
+    * @param sum Sums of B, G and R, see getPixelSums().
+    * @param cross Sums of the products of the channels, see getPixelSums().
+    * @param nb_frames Number of frames.
+    * @param mean Mean of the model.
+    * @param stddev Standard deviation of the model (not null).
+    * @param brightness Brightness coefficients k of the model.
+    * @param out_bdist_sum Sum of ( bdist - 1 )^2.
+    * @param out_cdist_sum Sum of cdist^2.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static void computeDistortionSums( const double  sum[ 3 ],
+                                       const double  cross[ 3 ][ 3 ],
+                                             double  nb_frames,
+                                       const double  mean[ 3 ],
+                                       const double  stddev[ 3 ],
+                                       const double  brightness[ 3 ],
+                                             double* out_bdist_sum,
+                                             double* out_cdist_sum );
+};
+
+}
+
+#endif // HAD_FRAME_STATISTICS_HPP
@@ -0,0 +1,296 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <boost/bind.hpp>
+
+#include "GlobalVarianceLCM.hpp"
+
+had::GlobalVarianceLCM::GlobalVarianceLCM( const vector<cv::Mat>& images,
+                                           const float            detection_rate,
+                                           ThreadPool*            pool )
+: LCM( detection_rate, pool )
+{
+    CV_Assert( ! images.empty() );
+
+    // The frames are only needed for the running sums, which are released
+    // once the model is computed
+    _statistics.add( images, _pool );
+    computeModel();
+    _statistics.clear();
+
+    // See Horprasert et al., 1999, Section 4.3
+    selectThresholds( images );
+}
+
+
+void had::GlobalVarianceLCM::computeModel()
+{
+    // See Horprasert et al., 1999, Sections 4.1 and 7
+    HAD_STATS_LOCAL( stats );
+    HAD_STAGE_CLOCK( stats );
+    cv::Size size = _statistics.getSize();
+    double nb_pixels = (double) size.width * size.height;
+    double nb_values = _statistics.getNbFrames() * nb_pixels;
+
+    _planes.resize( NB_PLANES );
+    for( int id = 0; id < NB_PLANES; ++id )
+        _planes[ id ] = cv::Mat( size, CV_32F );
+
+    // The global variance of each channel is the average of the variances of
+    // the pixels. The sums are kept per row, and added in a fixed order, so
+    // that the model does not depend on the number of threads.
+    vector<double> variance_sums( 3 * size.height, 0 );
+    parallelRows( 0,
+                  size.height,
+                  boost::bind( &GlobalVarianceLCM::computeVarianceRows, this, boost::ref( variance_sums ), _1, _2 ) );
+
+    for( int id = 0; id < 3; ++id )
+    {
+        double variance_sum = 0;
+        for( int y = 0; y < size.height; ++y )
+            variance_sum += variance_sums[ 3 * y + id ];
+        double variance = variance_sum / nb_pixels;
+        _stddev[ id ] = variance > 0 ? sqrt( variance ) : 1;
+    }
+
+    // See Horprasert et al., 1999, Eqs. 7 and 8, with the sums over all the
+    // pixels instead of a single one
+    vector<double> distortion_sums( 2 * size.height, 0 );
+    parallelRows( 0,
+                  size.height,
+                  boost::bind( &GlobalVarianceLCM::computePlanesRows, this, boost::ref( distortion_sums ), _1, _2 ) );
+
+    double bdist_sum = 0, cdist_sum = 0;
+    for( int y = 0; y < size.height; ++y )
+    {
+        bdist_sum += distortion_sums[ 2 * y ];
+        cdist_sum += distortion_sums[ 2 * y + 1 ];
+    }
+    _bdist_variation = sqrt( bdist_sum / nb_values );
+    _cdist_variation = sqrt( cdist_sum / nb_values );
+
+    computeCoefficients();
+    HAD_STAGE_SPLIT( STAGE_TRAINING );
+    HAD_COUNT( stats, COUNTER_TRAINING_FRAMES, _statistics.getNbFrames() );
+    HAD_STATS_MERGE( stats );
+}
+
+
+void had::GlobalVarianceLCM::computeVarianceRows( vector<double>& out_variance_sums,
+                                                  int             y_begin,
+                                                  int             y_end )
+{
+    double nb_frames = _statistics.getNbFrames();
+
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        for( int x = 0; x < _planes[ 0 ].cols; ++x )
+        {
+            double sum[ 3 ], cross[ 3 ][ 3 ];
+            _statistics.getPixelSums( y, x, sum, cross );
+
+            // See Horprasert et al., 1999, Eq. 4
+            for( int id = 0; id < 3; ++id )
+            {
+                double mean = sum[ id ] / nb_frames;
+                double variance = cross[ id ][ id ] / nb_frames - mean * mean;
+                out_variance_sums[ 3 * y + id ] += std::max( variance, 0.0 );
+            }
+        }
+    }
+}
+
+
+void had::GlobalVarianceLCM::computePlanesRows( vector<double>& out_distortion_sums,
+                                                int             y_begin,
+                                                int             y_end )
+{
+    double nb_frames = _statistics.getNbFrames();
+    double stddev[ 3 ] = { _stddev[ 0 ], _stddev[ 1 ], _stddev[ 2 ] };
+
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        for( int x = 0; x < _planes[ 0 ].cols; ++x )
+        {
+            double sum[ 3 ], cross[ 3 ][ 3 ];
+            _statistics.getPixelSums( y, x, sum, cross );
+
+            cv::Scalar mean;
+            for( int id = 0; id < 3; ++id )
+            {
+                mean[ id ] = sum[ id ] / nb_frames;
+                _planes[ PLANE_MEAN + id ].at<float>( y, x ) = mean[ id ];
+            }
+
+            float denom = computeBrightnessDenominator( mean, cv::Scalar( stddev[ 0 ], stddev[ 1 ], stddev[ 2 ] ) );
+            _planes[ PLANE_INV_DENOMINATOR ].at<float>( y, x ) = 1.0f / denom;
+
+            // The variations are computed with the brightness actually used
+            // for classification
+            double brightness[ 3 ];
+            for( int id = 0; id < 3; ++id )
+                brightness[ id ] = mean[ id ] / ( denom * stddev[ id ] * stddev[ id ] );
+
+            double bdist_sum, cdist_sum;
+            FrameStatistics::computeDistortionSums( sum, cross, nb_frames, mean.val, stddev, brightness, &bdist_sum, &cdist_sum );
+            out_distortion_sums[ 2 * y ] += bdist_sum;
+            out_distortion_sums[ 2 * y + 1 ] += cdist_sum;
+        }
+    }
+}
+
+
+void had::GlobalVarianceLCM::computeCoefficients()
+{
+    // See Horprasert et al., 1999, Section 7
+    // Like the standard deviation, a null variation is replaced by 1
+    // to avoid a division by zero.
+    float bdist_variation = _bdist_variation != 0 ? _bdist_variation : 1;
+    float cdist_variation = _cdist_variation != 0 ? _cdist_variation : 1;
+
+    for( int id = 0; id < 3; ++id )
+    {
+        _gain[ id ] = 1.0f / ( _stddev[ id ] * _stddev[ id ] );
+        _scale[ id ] = 1.0f / ( _stddev[ id ] * cdist_variation );
+    }
+    _inv_bdist_variation = 1.0f / bdist_variation;
+}
+
+
+void had::GlobalVarianceLCM::classifyRows( const ClassificationBatch& batch,
+                                                 int                  y_begin,
+                                                 int                  y_end )
+{
+    classifyRowsOf<GlobalVarianceLCM>( batch, y_begin, y_end );
+}
+
+
+void had::GlobalVarianceLCM::computeNormalizedDistortionsRow( const cv::Mat& image,
+                                                                    int      y,
+                                                                    int      x_begin,
+                                                                    int      x_end,
+                                                                    float*   out_bdist_norm,
+                                                                    float*   out_cdist_norm_squared )
+{
+    // See Horprasert et al., 1999, Eqs. 9 and 10
+    // The gains and scales are the same for every pixel, so only the mean and
+    // the inverse denominator are read from memory.
+    const unsigned char* row_image = image.ptr<unsigned char>( y );
+    const float* row_mean_b    = _planes[ PLANE_MEAN ].ptr<float>( y );
+    const float* row_mean_g    = _planes[ PLANE_MEAN + 1 ].ptr<float>( y );
+    const float* row_mean_r    = _planes[ PLANE_MEAN + 2 ].ptr<float>( y );
+    const float* row_inv_denom = _planes[ PLANE_INV_DENOMINATOR ].ptr<float>( y );
+
+    for( int x = x_begin; x < x_end; ++x )
+    {
+        float b = row_image[ 3 * x ];
+        float g = row_image[ 3 * x + 1 ];
+        float r = row_image[ 3 * x + 2 ];
+
+        float bdist = (   row_mean_b[ x ] * _gain[ 0 ] * b
+                        + row_mean_g[ x ] * _gain[ 1 ] * g
+                        + row_mean_r[ x ] * _gain[ 2 ] * r ) * row_inv_denom[ x ];
+
+        float cdist_b = ( b - bdist * row_mean_b[ x ] ) * _scale[ 0 ];
+        float cdist_g = ( g - bdist * row_mean_g[ x ] ) * _scale[ 1 ];
+        float cdist_r = ( r - bdist * row_mean_r[ x ] ) * _scale[ 2 ];
+
+        out_bdist_norm[ x ] = ( bdist - 1 ) * _inv_bdist_variation;
+        out_cdist_norm_squared[ x ] = cdist_b * cdist_b + cdist_g * cdist_g + cdist_r * cdist_r;
+    }
+}
+
+
+void had::GlobalVarianceLCM::computeNormalizedDistortions( const cv::Mat& image,
+                                                                 cv::Mat& out_bdist_norm,
+                                                                 cv::Mat& out_cdist_norm_squared )
+{
+    // See Horprasert et al., 1999, Eqs. 9 and 10
+    out_bdist_norm.create( image.size(), CV_32F );
+    out_cdist_norm_squared.create( image.size(), CV_32F );
+    parallelRows( 0,
+                  image.rows,
+                  boost::bind( &GlobalVarianceLCM::computeNormalizedDistortionsRows,
+                               this,
+                               boost::cref( image ),
+                               boost::ref( out_bdist_norm ),
+                               boost::ref( out_cdist_norm_squared ),
+                               _1,
+                               _2 ) );
+}
+
+
+void had::GlobalVarianceLCM::computeNormalizedDistortions( const vector<cv::Mat>& images,
+                                                                 cv::Mat& out_bdist_norm,
+                                                                 cv::Mat& out_cdist_norm_squared )
+{
+    // See Horprasert et al., 1999, Eqs. 9 and 10
+    int cols = images[ 0 ].cols;
+    int rows = images[ 0 ].rows;
+    out_bdist_norm.create( rows, cols * images.size(), CV_32F );
+    out_cdist_norm_squared.create( rows, cols * images.size(), CV_32F );
+    for( unsigned int id_image = 0; id_image < images.size(); ++id_image )
+    {
+        cv::Mat bdist_image = out_bdist_norm.colRange( id_image * cols, ( id_image + 1 ) * cols );
+        cv::Mat cdist_image = out_cdist_norm_squared.colRange( id_image * cols, ( id_image + 1 ) * cols );
+        parallelRows( 0,
+                      rows,
+                      boost::bind( &GlobalVarianceLCM::computeNormalizedDistortionsRows,
+                                   this,
+                                   boost::cref( images[ id_image ] ),
+                                   boost::ref( bdist_image ),
+                                   boost::ref( cdist_image ),
+                                   _1,
+                                   _2 ) );
+    }
+}
+
+
+void had::GlobalVarianceLCM::addFrame( const cv::Mat& image )
+{
+    _statistics.add( image, _pool );
+}
+
+
+void had::GlobalVarianceLCM::finalize()
+{
+    if( _statistics.getNbFrames() == 0 )
+        CV_Error( CV_StsError, "no frame has been added to the model" );
+
+    computeModel();
+
+    // See Horprasert et al., 1999, Section 4.3
+    selectThresholds( _statistics.getSample() );
+}
+
+
+had::GlobalVarianceLCM::GlobalVarianceLCM( const boost::shared_ptr<ModelFile>& file,
+                                           ThreadPool*                         pool )
+: LCM( file, pool )
+{
+    if( file->getHeader().type != MODEL_GLOBAL_VARIANCE )
+        CV_Error( CV_StsBadArg, "the model file does not hold a GlobalVarianceLCM" );
+
+    // The per-pixel planes stay in the mapping, the global values are copied
+    cv::Size size( file->getHeader().cols, file->getHeader().rows );
+    _planes.resize( NB_PLANES );
+    for( int id = 0; id < 3; ++id )
+        _planes[ PLANE_MEAN + id ] = file->getBlock( GV_BLOCK_MEAN + id, 1, size );
+    _planes[ PLANE_INV_DENOMINATOR ] = file->getBlock( GV_BLOCK_INV_DENOMINATOR, 1, size );
+
+    for( int id = 0; id < 3; ++id )
+        _stddev[ id ] = file->getBlock( GV_BLOCK_STDDEV, 3, cv::Size( 1, 1 ) ).at<cv::Vec3f>( 0, 0 )[ id ];
+    _bdist_variation = file->getBlock( GV_BLOCK_BDIST_VARIATION, 1, cv::Size( 1, 1 ) ).at<float>( 0, 0 );
+    _cdist_variation = file->getBlock( GV_BLOCK_CDIST_VARIATION, 1, cv::Size( 1, 1 ) ).at<float>( 0, 0 );
+    computeCoefficients();
+}
+
+
+had::ModelType had::GlobalVarianceLCM::getModelBlocks( vector<cv::Mat>& out_blocks ) const
+{
+    out_blocks.clear();
+    out_blocks.insert( out_blocks.end(), _planes.begin(), _planes.end() );
+    out_blocks.push_back( cv::Mat( 1, 1, CV_32FC3, cv::Scalar( _stddev[ 0 ], _stddev[ 1 ], _stddev[ 2 ] ) ) );
+    out_blocks.push_back( cv::Mat( 1, 1, CV_32F, cv::Scalar( _bdist_variation ) ) );
+    out_blocks.push_back( cv::Mat( 1, 1, CV_32F, cv::Scalar( _cdist_variation ) ) );
+    return MODEL_GLOBAL_VARIANCE;
+}
@@ -0,0 +1,219 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_GLOBAL_VARIANCE_LCM_HPP
+#define HAD_GLOBAL_VARIANCE_LCM_HPP
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+using std::vector;
+#include <string>
+using std::string;
+
+#include <cv.h>
+#include <highgui.h>
+
+#include "LCM.hpp"
+#include "FrameStatistics.hpp"
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Multiple image Lambertain Color Model with a global variance.
+*
+* Like MultipleLCM, the mean is learned for each pixel, but the standard
+* deviation of each channel and the variations of the brightness and
+* chromaticity distortions are averaged over the whole image, as suggested in
+* Horprasert et al., 1999, Section 7. The model only keeps four floats per
+* pixel (the mean and the inverse of the brightness denominator), instead of
+* the 21 of MultipleLCM (11 for the statistics and 10 for the coefficients),
+* which reduces the memory used and the memory traffic of the classification,
+* at the cost of some accuracy.
+*/
+/* ----------------------------------------------------------------------------*/
+class GlobalVarianceLCM: public LCM
+{
+    friend class LCM;  // Calls the row functions without virtual dispatch, see LCM::classifyRowsOf().
+
+private:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Per-pixel planes of the model.
+    */
+    /* ----------------------------------------------------------------------------*/
+    enum Plane
+    {
+        PLANE_MEAN            = 0,  //!< Mean of B, G and R.
+        PLANE_INV_DENOMINATOR = 3,  //!< Inverse of the brightness denominator, see Eq. 5.
+        NB_PLANES             = 4
+    };
+
+    vector<cv::Mat> _planes;            //!< Per-pixel planes of the model (CV_32F, see Plane).
+    float           _stddev[ 3 ];       //!< Global standard deviation of B, G and R.
+    float           _bdist_variation;   //!< Global brightness distortion variation.
+    float           _cdist_variation;   //!< Global chromacity distortion variation.
+
+    float           _gain[ 3 ];         //!< 1 / stddev^2, used for the brightness distortion.
+    float           _scale[ 3 ];        //!< 1 / ( stddev * chromaticity distortion variation ).
+    float           _inv_bdist_variation; //!< 1 / brightness distortion variation.
+
+    FrameStatistics _statistics;        //!< Running sums of the training frames.
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Compute the model from the training frames added to _statistics.
+    *
+    * See Horprasert et al., 1999, Sections 4.1 and 7
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computeModel();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Sum the variances of the pixels of a band of rows, see computeModel().
+    *
+    * @param out_variance_sums Sums of the variances of B, G and R of each row
+    * (three values per row).
+    * @param y_begin First row of the band.
+    * @param y_end Row after the last row of the band.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computeVarianceRows( vector<double>& out_variance_sums,
+                              int             y_begin,
+                              int             y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Compute the per-pixel planes of a band of rows, and sum their
+    * squared distortions, see computeModel().
+    *
+    * @param out_distortion_sums Sums of the squared brightness and chromaticity
+    * distortions of each row (two values per row).
+    * @param y_begin First row of the band.
+    * @param y_end Row after the last row of the band.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computePlanesRows( vector<double>& out_distortion_sums,
+                            int             y_begin,
+                            int             y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Bake the global coefficients used for classification.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computeCoefficients();
+
+    virtual void computeNormalizedDistortions( const vector<cv::Mat>& images,
+                                                     cv::Mat& out_bdist_norm,
+                                                     cv::Mat& out_cdist_norm_squared );
+
+    virtual void computeNormalizedDistortions( const cv::Mat& image,
+                                                     cv::Mat& out_bdist_norm,
+                                                     cv::Mat& out_cdist_norm_squared );
+
+protected:
+    virtual ModelType getModelBlocks( vector<cv::Mat>& out_blocks ) const;
+
+    virtual int getModelPixelSize() const { return NB_PLANES * sizeof( float ); }
+
+    virtual void classifyRows( const ClassificationBatch& batch,
+                                     int                  y_begin,
+                                     int                  y_end );
+
+    virtual void computeNormalizedDistortionsRow( const cv::Mat& image,
+                                                        int      y,
+                                                        int      x_begin,
+                                                        int      x_end,
+                                                        float*   out_bdist_norm,
+                                                        float*   out_cdist_norm_squared );
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor.
+    *
+    * @param images Vector of training images (8-bit 3-channel images, CV_8UC3).
+    * @param detection_rate Detection rate (ex: 95% is .95).
+    * @param pool Thread pool used to train and classify by bands of rows
+    * (NULL to use the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    GlobalVarianceLCM( const vector<cv::Mat>& images,
+                       const float            detection_rate,
+                       ThreadPool*            pool = NULL );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor of an empty model, trained online with addFrame() and
+    * finalize(), see MultipleLCM.
+    *
+    * @param detection_rate Detection rate (ex: 95% is .95).
+    * @param nb_threshold_frames Maximum number of frames kept to select the
+    * thresholds, at least 1.
+    * @param pool Thread pool used to train and classify by bands of rows
+    * (NULL to use the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    GlobalVarianceLCM( const float  detection_rate,
+                       const int    nb_threshold_frames = 16,
+                       ThreadPool*  pool = NULL )
+    : LCM( detection_rate, pool ), _statistics( nb_threshold_frames )
+    {
+        CV_Assert( nb_threshold_frames > 0 );
+    }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor of a model loaded from a file, see LCM::load().
+    *
+    * @param file Model file, of type MODEL_GLOBAL_VARIANCE.
+    * @param pool Thread pool used to classify by bands of rows (NULL to use
+    * the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    GlobalVarianceLCM( const boost::shared_ptr<ModelFile>& file,
+                       ThreadPool*                         pool = NULL );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Destructor.
+    */
+    /* ----------------------------------------------------------------------------*/
+    virtual ~GlobalVarianceLCM() {}
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Add a training frame to a model created empty, see
+    * MultipleLCM::addFrame().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void addFrame( const cv::Mat& image );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Compute the model from the frames added so far, see
+    * MultipleLCM::finalize().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void finalize();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of frames added with addFrame().
+    */
+    /* ----------------------------------------------------------------------------*/
+    int getNbFrames() const { return _statistics.getNbFrames(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the size of the frames of the model, see LCM::getSize().
+    */
+    /* ----------------------------------------------------------------------------*/
+    virtual cv::Size getSize() const { return _planes.empty() ? cv::Size() : _planes[ 0 ].size(); }
+};
+
+}
+
+#endif // HAD_GLOBAL_VARIANCE_LCM_HPP
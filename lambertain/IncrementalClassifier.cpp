@@ -0,0 +1,154 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <cstring>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include "IncrementalClassifier.hpp"
+#include "Workspace.hpp"
+
+had::IncrementalClassifier::IncrementalClassifier( LCM*       lcm,
+                                                   int        tolerance,
+                                                   ChangeTest test,
+                                                   int        tile_size )
+: _lcm( lcm ), _test( test ), _tolerance( tolerance ), _tile_size( tile_size ),
+  _kernel( getDifferenceKernel( detectKernelISA() ) ), _nb_tiles( 0 ), _nb_tiles_skipped( 0 )
+{
+    CV_Assert( lcm != NULL && tolerance >= 0 && tile_size > 0 );
+}
+
+
+void had::IncrementalClassifier::reset()
+{
+    _reference = cv::Mat();
+    _classification = cv::Mat();
+    _nb_tiles = 0;
+    _nb_tiles_skipped = 0;
+}
+
+
+void had::IncrementalClassifier::compareTileRows( const cv::Mat& image,
+                                                        cv::Mat& out_mask,
+                                                        int      tile_begin,
+                                                        int      tile_end )
+{
+    // The rows of the image are compared whole, with the sums and the maxima
+    // of the differences accumulated per tile, which keeps the kernel calls
+    // long enough to be vectorized.
+    int nb_tile_cols = getNbTileCols();
+    int* sums = Workspace::get<int>( Workspace::BUFFER_TILE_SUMS, nb_tile_cols, NULL );
+    int* maxs = Workspace::get<int>( Workspace::BUFFER_TILE_MAXS, nb_tile_cols, NULL );
+    for( int tile_y = tile_begin; tile_y < tile_end; ++tile_y )
+    {
+        int y_begin = tile_y * _tile_size;
+        int y_end = std::min( y_begin + _tile_size, image.rows );
+        std::fill( sums, sums + nb_tile_cols, 0 );
+        std::fill( maxs, maxs + nb_tile_cols, 0 );
+        for( int y = y_begin; y < y_end; ++y )
+            _kernel( image.ptr<unsigned char>( y ), _reference.ptr<unsigned char>( y ), 3 * image.cols, 3 * _tile_size, sums, maxs );
+
+        unsigned char* changed = &_changed[ tile_y * nb_tile_cols ];
+        for( int tile_x = 0; tile_x < nb_tile_cols; ++tile_x )
+        {
+            int width = std::min( _tile_size, image.cols - tile_x * _tile_size );
+            if( _test == CHANGE_MAX_DIFFERENCE )
+                changed[ tile_x ] = maxs[ tile_x ] > _tolerance;
+            else
+                changed[ tile_x ] = sums[ tile_x ] > _tolerance * 3 * width * ( y_end - y_begin );
+        }
+
+        for( int y = y_begin; y < y_end; ++y )
+        {
+            unsigned char* row_mask = out_mask.ptr<unsigned char>( y );
+            for( int tile_x = 0; tile_x < nb_tile_cols; ++tile_x )
+            {
+                int x = tile_x * _tile_size;
+                int width = std::min( _tile_size, image.cols - x );
+                memset( row_mask + x, changed[ tile_x ], width );
+            }
+        }
+    }
+}
+
+
+void had::IncrementalClassifier::copyLabelsRows( const cv::Mat& image,
+                                                       cv::Mat& io_classification,
+                                                       int      tile_begin,
+                                                       int      tile_end )
+{
+    int nb_tile_cols = getNbTileCols();
+    for( int tile_y = tile_begin; tile_y < tile_end; ++tile_y )
+    {
+        int y_end = std::min( ( tile_y + 1 ) * _tile_size, io_classification.rows );
+        for( int tile_x = 0; tile_x < nb_tile_cols; ++tile_x )
+        {
+            int x = tile_x * _tile_size;
+            int width = std::min( _tile_size, io_classification.cols - x );
+            if( _changed[ tile_y * nb_tile_cols + tile_x ] )
+            {
+                for( int y = tile_y * _tile_size; y < y_end; ++y )
+                    memcpy( _reference.ptr<unsigned char>( y ) + 3 * x, image.ptr<unsigned char>( y ) + 3 * x, 3 * width );
+                continue;
+            }
+
+            for( int y = tile_y * _tile_size; y < y_end; ++y )
+                memcpy( io_classification.ptr<unsigned char>( y ) + x, _classification.ptr<unsigned char>( y ) + x, width );
+        }
+    }
+}
+
+
+void had::IncrementalClassifier::classify( const cv::Mat& image,
+                                                 cv::Mat& out_classification )
+{
+    CV_Assert( image.type() == CV_8UC3 );
+    if( _reference.empty() || image.size() != _reference.size() )
+    {
+        // The reference is only replaced once the frame is classified
+        _lcm->classify( image, out_classification );
+        _reference = image.clone();
+        out_classification.copyTo( _classification );
+        _nb_tiles += getNbTileRows() * getNbTileCols();
+        return;
+    }
+
+    // The mask is written entirely, tile by tile
+    _mask.create( image.size(), CV_8UC1 );
+    _changed.resize( getNbTileRows() * getNbTileCols() );
+    ThreadPool::runRange( _lcm->getThreadPool(),
+                          0,
+                          getNbTileRows(),
+                          boost::bind( &IncrementalClassifier::compareTileRows,
+                                       this,
+                                       boost::cref( image ),
+                                       boost::ref( _mask ),
+                                       _1,
+                                       _2 ) );
+
+    int nb_skipped = 0;
+    for( unsigned int id = 0; id < _changed.size(); ++id )
+        nb_skipped += _changed[ id ] ? 0 : 1;
+    _nb_tiles += _changed.size();
+    _nb_tiles_skipped += nb_skipped;
+
+    if( nb_skipped == (int) _changed.size() )
+    {
+        _classification.copyTo( out_classification );
+        return;
+    }
+
+    _lcm->classify( image, _mask, 0, out_classification );
+    ThreadPool::runRange( _lcm->getThreadPool(),
+                          0,
+                          getNbTileRows(),
+                          boost::bind( &IncrementalClassifier::copyLabelsRows,
+                                       this,
+                                       boost::cref( image ),
+                                       boost::ref( out_classification ),
+                                       _1,
+                                       _2 ) );
+
+    // The labels are copied, so that the caller can modify its image
+    out_classification.copyTo( _classification );
+}
@@ -0,0 +1,172 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_INCREMENTAL_CLASSIFIER_HPP
+#define HAD_INCREMENTAL_CLASSIFIER_HPP
+
+#include <vector>
+using std::vector;
+
+#include <cv.h>
+
+#include "LCM.hpp"
+#include "DistortionKernels.hpp"
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Classifier of the frames of a stream that only classifies again the
+* tiles that changed.
+*
+* The frame is split into square tiles. Each tile of a new frame is compared
+* to the same tile of the frame it was last classified from: if they differ
+* by more than a tolerance, the tile is classified again with the model (see
+* LCM::classify() with a mask), and otherwise its previous labels are kept.
+* With a fixed camera, most of the tiles of a quiet scene are skipped.
+*
+* The comparison is made with the frame a tile was last classified from, and
+* not with the previous frame, so that slow changes cannot accumulate without
+* bound: the labels of a skipped tile are always those of a frame within the
+* tolerance of the current one. If the model updates itself (see
+* MultipleLCM::setUpdateRate()), it is only updated with the tiles that are
+* classified.
+*/
+/* ----------------------------------------------------------------------------*/
+class IncrementalClassifier
+{
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Test used to decide if a tile changed.
+    */
+    /* ----------------------------------------------------------------------------*/
+    enum ChangeTest
+    {
+        CHANGE_MAX_DIFFERENCE  = 0,  //!< Largest absolute difference of a channel of a pixel above the tolerance.
+        CHANGE_MEAN_DIFFERENCE = 1   //!< Mean absolute difference of the channels of the pixels (SAD / number of values) above the tolerance.
+    };
+
+private:
+    LCM*                  _lcm;             //!< Model used to classify the tiles that changed (not owned).
+    ChangeTest            _test;            //!< Test used to decide if a tile changed.
+    int                   _tolerance;       //!< Tolerance of the test, in intensity levels.
+    int                   _tile_size;       //!< Width and height of the tiles, in pixels.
+    DifferenceKernel      _kernel;          //!< Kernel used to compare the rows of the frames.
+
+    cv::Mat               _reference;       //!< Frame each tile was last classified from (CV_8UC3).
+    cv::Mat               _classification;  //!< Labels of the last classified frame (CV_8UC1).
+    cv::Mat               _mask;            //!< Mask of the pixels of the tiles that changed in the last frame (CV_8UC1).
+    vector<unsigned char> _changed;         //!< Result of the test of each tile of the last frame, row by row.
+    long long             _nb_tiles;        //!< Number of tiles seen since the last reset.
+    long long             _nb_tiles_skipped; //!< Number of tiles whose labels were kept since the last reset.
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Test a band of rows of tiles, and prepare the mask of the tiles to
+    * classify.
+    *
+    * @param image New frame (8-bit 3-channel image, CV_8UC3).
+    * @param out_mask Mask of the pixels to classify, already allocated.
+    * @param tile_begin First row of tiles of the band.
+    * @param tile_end Row of tiles after the last row of the band.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void compareTileRows( const cv::Mat& image,
+                                cv::Mat& out_mask,
+                                int      tile_begin,
+                                int      tile_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Copy the previous labels of the skipped tiles of a band of rows
+    * of tiles, and the tiles that changed into the reference. Called once
+    * the new frame has been classified, so that a failed classification
+    * leaves the reference and the labels of the previous frame together.
+    *
+    * @param image New frame (8-bit 3-channel image, CV_8UC3).
+    * @param io_classification Classification of the new frame.
+    * @param tile_begin First row of tiles of the band.
+    * @param tile_end Row of tiles after the last row of the band.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void copyLabelsRows( const cv::Mat& image,
+                               cv::Mat& io_classification,
+                               int      tile_begin,
+                               int      tile_end );
+
+    int getNbTileCols() const { return ( _reference.cols + _tile_size - 1 ) / _tile_size; }
+    int getNbTileRows() const { return ( _reference.rows + _tile_size - 1 ) / _tile_size; }
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor.
+    *
+    * @param lcm Trained model, which must outlive the classifier.
+    * @param tolerance Tolerance of the test, in intensity levels (ex: 8 for
+    * the mean difference, which should be above the noise of the camera).
+    * @param test Test used to decide if a tile changed.
+    * @param tile_size Width and height of the tiles, in pixels.
+    */
+    /* ----------------------------------------------------------------------------*/
+    IncrementalClassifier( LCM*       lcm,
+                           int        tolerance,
+                           ChangeTest test = CHANGE_MEAN_DIFFERENCE,
+                           int        tile_size = 16 );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Classify the next frame of the stream.
+    *
+    * The first frame, and every frame whose size differs from the previous
+    * one, is classified entirely.
+    *
+    * The buffer of out_classification is reused as with LCM::classify(), so
+    * the result of the previous frame is overwritten if it is classified into
+    * the same matrix (clone() it to keep it). The classifier keeps its own copy
+    * of the labels, so the caller may modify its result.
+    *
+    * @param image Input image (8-bit 3-channel image, CV_8UC3).
+    * @param out_classification Computed classification image (8-bit 1-channel
+    * image, CV_8UC1).
+    */
+    /* ----------------------------------------------------------------------------*/
+    void classify( const cv::Mat& image,
+                         cv::Mat& out_classification );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Forget the previous frame, so that the next one is classified
+    * entirely (ex: after the model has been changed), and clear the counters
+    * of tiles.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void reset();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of tiles seen since the construction or the last
+    * call to reset().
+    */
+    /* ----------------------------------------------------------------------------*/
+    long long getNbTiles() const { return _nb_tiles; }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of tiles whose labels were kept since the
+    * construction or the last call to reset().
+    */
+    /* ----------------------------------------------------------------------------*/
+    long long getNbTilesSkipped() const { return _nb_tiles_skipped; }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the fraction of the tiles whose labels were kept, in [0, 1].
+    */
+    /* ----------------------------------------------------------------------------*/
+    double getSkippedRatio() const { return _nb_tiles > 0 ? (double) _nb_tiles_skipped / _nb_tiles : 0; }
+};
+
+}
+
+#endif // HAD_INCREMENTAL_CLASSIFIER_HPP
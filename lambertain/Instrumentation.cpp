@@ -0,0 +1,79 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include "Instrumentation.hpp"
+
+void had::StageStats::clear()
+{
+    for( int id = 0; id < NB_STAGES; ++id )
+    {
+        nb_calls[ id ] = 0;
+        ticks[ id ] = 0;
+    }
+    for( int id = 0; id < NB_COUNTERS; ++id )
+        counters[ id ] = 0;
+}
+
+
+had::StageStats& had::StageStats::operator+=( const StageStats& stats )
+{
+    for( int id = 0; id < NB_STAGES; ++id )
+    {
+        nb_calls[ id ] += stats.nb_calls[ id ];
+        ticks[ id ] += stats.ticks[ id ];
+    }
+    for( int id = 0; id < NB_COUNTERS; ++id )
+        counters[ id ] += stats.counters[ id ];
+    return *this;
+}
+
+
+void had::StageStats::print( std::ostream& out ) const
+{
+    for( int id = 0; id < NB_STAGES; ++id )
+    {
+        out << getStageName( (Stage) id ) << ".calls " << nb_calls[ id ] << std::endl;
+        out << getStageName( (Stage) id ) << ".seconds " << getSeconds( (Stage) id ) << std::endl;
+    }
+    for( int id = 0; id < NB_COUNTERS; ++id )
+        out << getCounterName( (Counter) id ) << " " << counters[ id ] << std::endl;
+}
+
+
+const char* had::StageStats::getStageName( Stage stage )
+{
+    switch( stage )
+    {
+        case STAGE_CLASSIFY:    return "classify";
+        case STAGE_DISTORTIONS: return "distortions";
+        case STAGE_LABELING:    return "labeling";
+        case STAGE_UPDATE:      return "update";
+        case STAGE_TO_IMAGE:    return "to_image";
+        case STAGE_TRAINING:    return "training";
+        case STAGE_THRESHOLDS:  return "thresholds";
+        default:                return "unknown";
+    }
+}
+
+
+const char* had::StageStats::getCounterName( Counter counter )
+{
+    switch( counter )
+    {
+        case COUNTER_FRAMES:          return "frames";
+        case COUNTER_PIXELS:          return "pixels";
+        case COUNTER_TRAINING_FRAMES: return "training_frames";
+        case COUNTER_ALLOCATIONS:     return "allocations";
+        case COUNTER_ALLOCATED_BYTES: return "allocated_bytes";
+        default:                      return "unknown";
+    }
+}
+
+
+bool had::StageStats::isEnabled()
+{
+#ifdef HAD_INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+}
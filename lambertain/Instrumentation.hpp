@@ -0,0 +1,171 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_INSTRUMENTATION_HPP
+#define HAD_INSTRUMENTATION_HPP
+
+#include <iostream>
+
+#include <boost/cstdint.hpp>
+
+#include <cv.h>
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Stages of the models whose time is measured.
+*
+* The stages that run by bands of rows on a thread pool add the time spent by
+* all the threads, the other ones measure the time of the calling thread.
+*/
+/* ----------------------------------------------------------------------------*/
+enum Stage
+{
+    STAGE_CLASSIFY    = 0,  //!< Calls to classify(), from start to end.
+    STAGE_DISTORTIONS = 1,  //!< Normalized distortions of the classified rows, on all the threads.
+    STAGE_LABELING    = 2,  //!< Labeling of the classified rows, on all the threads.
+    STAGE_UPDATE      = 3,  //!< Update of the model by the classified rows, on all the threads.
+    STAGE_TO_IMAGE    = 4,  //!< Calls to classificationToImage(), from start to end.
+    STAGE_TRAINING    = 5,  //!< Computation of the model from the training frames.
+    STAGE_THRESHOLDS  = 6,  //!< Selection of the thresholds.
+    NB_STAGES         = 7
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Counters of the models.
+*/
+/* ----------------------------------------------------------------------------*/
+enum Counter
+{
+    COUNTER_FRAMES          = 0,    //!< Frames classified.
+    COUNTER_PIXELS          = 1,    //!< Pixels classified.
+    COUNTER_TRAINING_FRAMES = 2,    //!< Frames used to compute a model.
+    COUNTER_ALLOCATIONS     = 3,    //!< Buffers allocated by classify() and classificationToImage().
+    COUNTER_ALLOCATED_BYTES = 4,    //!< Bytes of the buffers allocated.
+    NB_COUNTERS             = 5
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Timers and counters of a model, see LCM::getStats().
+*
+* They are only collected when the library is compiled with
+* HAD_INSTRUMENTATION defined (see the Makefile). Otherwise, the
+* instrumentation macros below expand to nothing, so that the hot paths are
+* the same as without instrumentation, and the statistics stay at zero. The
+* layout of the classes does not depend on HAD_INSTRUMENTATION, so a program
+* may be compiled without it against an instrumented library: isEnabled()
+* tells how the library was compiled.
+*/
+/* ----------------------------------------------------------------------------*/
+struct StageStats
+{
+    boost::uint64_t nb_calls[ NB_STAGES ];      //!< Number of times each stage ran.
+    boost::int64_t  ticks[ NB_STAGES ];         //!< Time spent in each stage, in cv::getTickCount() ticks.
+    boost::uint64_t counters[ NB_COUNTERS ];    //!< Value of each counter.
+
+    StageStats() { clear(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Set all the timers and counters to zero.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void clear();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Add the timers and counters of other statistics.
+    */
+    /* ----------------------------------------------------------------------------*/
+    StageStats& operator+=( const StageStats& stats );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the time spent in a stage, in seconds.
+    */
+    /* ----------------------------------------------------------------------------*/
+    double getSeconds( Stage stage ) const { return ticks[ stage ] / cv::getTickFrequency(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Print the timers and counters, one per line, as "name value".
+    */
+    /* ----------------------------------------------------------------------------*/
+    void print( std::ostream& out ) const;
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Check whether the library collects the statistics, that is whether
+    * it was compiled with HAD_INSTRUMENTATION defined.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static bool isEnabled();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the name of a stage, ex: "classify".
+    */
+    /* ----------------------------------------------------------------------------*/
+    static const char* getStageName( Stage stage );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the name of a counter, ex: "frames".
+    */
+    /* ----------------------------------------------------------------------------*/
+    static const char* getCounterName( Counter counter );
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Measure consecutive stages: each call to split() adds the time since
+* the previous one (or since the construction) to a stage.
+*/
+/* ----------------------------------------------------------------------------*/
+class StageClock
+{
+private:
+    StageStats&    _stats;  //!< Statistics receiving the times.
+    boost::int64_t _last;   //!< Tick of the previous split.
+
+public:
+    explicit StageClock( StageStats& stats )
+    : _stats( stats ), _last( cv::getTickCount() )
+    {
+    }
+
+    void split( Stage stage )
+    {
+        boost::int64_t now = cv::getTickCount();
+        _stats.ticks[ stage ] += now - _last;
+        ++_stats.nb_calls[ stage ];
+        _last = now;
+    }
+};
+
+}
+
+// The statistics are first collected in a local StageStats, without any
+// synchronization, and then merged into those of the model with
+// LCM::mergeStats(). The local StageStats is only declared when they are
+// collected: the functions that take statistics take a pointer to them, NULL
+// otherwise (see HAD_STATS_POINTER).
+#ifdef HAD_INSTRUMENTATION
+#define HAD_STATS_LOCAL( stats )                had::StageStats stats
+#define HAD_STATS_POINTER( stats )              ( &( stats ) )
+#define HAD_STAGE_CLOCK( stats )                had::StageClock had_stage_clock( stats )
+#define HAD_STAGE_SPLIT( stage )                had_stage_clock.split( stage )
+#define HAD_COUNT( stats, counter, value )      ( stats ).counters[ counter ] += ( value )
+#define HAD_STATS_MERGE( stats )                mergeStats( stats )
+#else
+#define HAD_STATS_LOCAL( stats )
+#define HAD_STATS_POINTER( stats )              NULL
+#define HAD_STAGE_CLOCK( stats )
+#define HAD_STAGE_SPLIT( stage )
+#define HAD_COUNT( stats, counter, value )
+#define HAD_STATS_MERGE( stats )
+#endif
+
+#endif // HAD_INSTRUMENTATION_HPP
@@ -1,27 +1,27 @@
 // (c)2010 - Emmanuel Goossaert
 // Under GNU License 3.0
-#include "LCM.hpp"
+#include <cstring>
 
-void had::LCM::showImage( const string name, const cv::Mat& image, int col, int row )
-{
-    // The sizes of 60 and 200 are magic values that I have choosen based upon
-    // my own system. Change them to better fit your screen and system.
-    int size_captionbar = 60;
-    int size_window = 200;
-    int x = col * size_window;
-    int y = row * size_window;
-    int width = size_window;
-    int height = size_window;
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
 
-    // Need to add this due to a bug in OpenCV 2.1
-    if( row <= 3 ) y += row * size_captionbar;
+#include "LCM.hpp"
+#include "SingleLCM.hpp"
+#include "MultipleLCM.hpp"
+#include "GlobalVarianceLCM.hpp"
+#include "QuantizedLCM.hpp"
 
-    cv::namedWindow( name.c_str(), 0 );
+namespace {
 
-    cvResizeWindow( name.c_str(), width, height );
-    cvMoveWindow( name.c_str(), x, y );
+// Allocate an output, unless it already has the right size and type, in
+// which case its buffer is reused. Return true if it was allocated.
+bool createOutput( cv::Mat& io_output, cv::Size size, int type )
+{
+    const unsigned char* data = io_output.data;
+    io_output.create( size, type );
+    return io_output.data != data;
+}
 
-    cv::imshow( name.c_str(), image );
 }
 
 
@@ -62,85 +62,149 @@ float had::LCM::computeBrightnessDenominator( const cv::Scalar& mean,
 }
 
 
-float had::LCM::computeBrightnessDistortion( const cv::Vec3b& pixel,
-                                             const cv::Scalar& brightness )
+void had::LCM::selectThresholdMatrix( const cv::Mat& mat,
+                                      const float detection_rate,  // example: .99 for 99%
+                                            float *left,
+                                            float *right )
 {
-    // See Horprasert et al., 1999, Eq. 5
-    // See Yacoob and Davis, 2006, Eq. 3
-    
-    // There is possibly a typo in Yacoob and Davis, that I have fixed.
-    // In order to get the formula as they presented it, just square
-    // every pixel value below.
-    return   (float) pixel[ 0 ] * brightness[ 0 ]
-           + (float) pixel[ 1 ] * brightness[ 1 ]
-           + (float) pixel[ 2 ] * brightness[ 2 ];
+    CV_Assert( mat.type() == CV_32F );
+
+    QuantileSelector selector( detection_rate );
+    while( selector.needsPass() )
+    {
+        for( int y = 0; y < mat.rows; ++y )
+            selector.add( mat.ptr<float>( y ), mat.cols );
+        selector.endPass();
+    }
+
+    *left  = selector.getLeft();
+    *right = selector.getRight();
 }
 
 
-float had::LCM::computeChromacityDistortion( const cv::Vec3b& pixel,
-                                             const cv::Scalar& mean,
-                                             const cv::Scalar& stddev,
-                                                        float bdist )
+void had::LCM::computeNormalizedDistortionsRows( const cv::Mat& image,
+                                                       cv::Mat& out_bdist_norm,
+                                                       cv::Mat& out_cdist_norm_squared,
+                                                       int      y_begin,
+                                                       int      y_end )
 {
-    // See Horprasert et al., 1999, Eq. 6
-    // See Yacoob and Davis, 2006, Eq. 4
-    // _stddev is never null: see computeModelMeanStdDev()
-    float b = ( (float) pixel[ 0 ] - bdist * mean[ 0 ] ) / stddev[ 0 ];
-    float g = ( (float) pixel[ 1 ] - bdist * mean[ 1 ] ) / stddev[ 1 ];
-    float r = ( (float) pixel[ 2 ] - bdist * mean[ 2 ] ) / stddev[ 2 ];
-    return sqrt( r * r + g * g + b * b );
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        computeNormalizedDistortionsRow( image,
+                                         y,
+                                         0,
+                                         image.cols,
+                                         out_bdist_norm.ptr<float>( y ),
+                                         out_cdist_norm_squared.ptr<float>( y ) );
+    }
 }
 
 
-void had::LCM::selectThresholdMatrix( const cv::Mat& mat,
-                                      const float detection_rate,  // example: .99 for 99%
-                                            float *left,
-                                            float *right )
+void had::LCM::selectThresholdsRows( const vector<cv::Mat>&          images,
+                                           vector<QuantileSelector>& io_selectors_bdist,
+                                           vector<QuantileSelector>& io_selectors_cdist,
+                                           int                       id_begin,
+                                           int                       id_end )
 {
-    CV_Assert( mat.type() == CV_32F );
+    int rows = images[ 0 ].rows;
+    long long nb_rows = (long long) images.size() * rows;
+    long long nb_selectors = io_selectors_bdist.size();
 
-    // Convert the matrix into an array
-    int size = mat.rows * mat.cols;
-    float* array = new float[ size ];
-    for( int y = 0; y < mat.rows; ++y )
+    vector<float> bdist_norm, cdist_norm_squared;
+    for( int id = id_begin; id < id_end; ++id )
     {
-        for( int x = 0; x < mat.cols; ++x )
+        int row_begin = (int) ( nb_rows * id / nb_selectors );
+        int row_end   = (int) ( nb_rows * ( id + 1 ) / nb_selectors );
+        for( int row = row_begin; row < row_end; ++row )
         {
-            array[ x + y * mat.cols ] = mat.at<float>( y, x );
+            const cv::Mat& image = images[ row / rows ];
+            bdist_norm.resize( image.cols );
+            cdist_norm_squared.resize( image.cols );
+            computeNormalizedDistortionsRow( image, row % rows, 0, image.cols, &bdist_norm[ 0 ], &cdist_norm_squared[ 0 ] );
+            io_selectors_bdist[ id ].add( &bdist_norm[ 0 ], image.cols );
+            io_selectors_cdist[ id ].add( &cdist_norm_squared[ 0 ], image.cols );
         }
     }
+}
+
 
-    // Get the values at rate and (1 - detection_rate)
-    int index_left  = (1 - detection_rate) * (float) size;
-    int index_right = detection_rate       * (float) size;
-    std::sort( array, array + size + 1 );
-    *left  = array[ index_left ];
-    *right = array[ index_right ];
+void had::LCM::selectThresholds( const vector<cv::Mat>& images )
+{
+    CV_Assert( ! images.empty() );
+
+    // See Horprasert et al., 1999, Section 4.3
+    HAD_STATS_LOCAL( stats );
+    HAD_STAGE_CLOCK( stats );
+    QuantileSelector selector_bdist( _detection_rate );
+    QuantileSelector selector_cdist( _detection_rate );
 
+    // Each thread counts its share of the distortions in its own partial
+    // selectors, which are merged at the end of each pass.
+    int nb_selectors = _pool ? _pool->getNbThreads() : 1;
 
-    if( _trace )
+    // Both selectors need the same number of passes
+    while( selector_bdist.needsPass() )
     {
-        std::cerr << "size: " << size << " | "
-                  << "index_left: " << index_left << " " << "index_right: " << index_right << " " 
-                  << array[ index_left ] << " " << array[ index_right ]
-                  << std::endl;
+        vector<QuantileSelector> selectors_bdist( nb_selectors, selector_bdist.split() );
+        vector<QuantileSelector> selectors_cdist( nb_selectors, selector_cdist.split() );
+        parallelRows( 0,
+                      nb_selectors,
+                      boost::bind( &LCM::selectThresholdsRows,
+                                   this,
+                                   boost::cref( images ),
+                                   boost::ref( selectors_bdist ),
+                                   boost::ref( selectors_cdist ),
+                                   _1,
+                                   _2 ),
+                      nb_selectors );
+
+        for( int id = 0; id < nb_selectors; ++id )
+        {
+            selector_bdist.merge( selectors_bdist[ id ] );
+            selector_cdist.merge( selectors_cdist[ id ] );
+        }
+        selector_bdist.endPass();
+        selector_cdist.endPass();
     }
 
-    delete[] array;
+    // Squaring preserves the order of the chromaticity distortions, which are
+    // positive, so the squared threshold is selected directly.
+    _threshold_cdist_squared = selector_cdist.getRight();
+    _threshold_bdist_left    = selector_bdist.getLeft();
+    _threshold_bdist_right   = selector_bdist.getRight();
+
+    HAD_STAGE_SPLIT( STAGE_THRESHOLDS );
+    HAD_STATS_MERGE( stats );
 }
 
 
-void had::LCM::selectThresholds( const float    detection_rate, // example: .99 for 99%
-                                 const cv::Mat& bdist_norm,
-                                 const cv::Mat& cdist_norm,
-                                       float*   threshold_cdist,
-                                       float*   threshold_bdist_left,
-                                       float*   threshold_bdist_right )
+void had::LCM::labelPixels( const float*         bdist_norm,
+                           const float*         cdist_norm_squared,
+                                 int            nb_pixels,
+                                 unsigned char* out_labels )
 {
-    // See Horprasert et al., 1999, Section 4.3
-    float dummy;
-    selectThresholdMatrix( cdist_norm, detection_rate, &dummy, threshold_cdist );
-    selectThresholdMatrix( bdist_norm, detection_rate, threshold_bdist_left, threshold_bdist_right );
+    // See Horprasert et al., 1999, Eq 11
+    // The tests are applied in the same order of precedence as the original
+    // masks: shadow, then background, then foreground.
+    for( int x = 0; x < nb_pixels; ++x )
+    {
+        float bdist = bdist_norm[ x ];
+        unsigned char label = had::LCM::HIGHLIGHT;
+
+        // alpha_i < 0
+        if( bdist < 0 )
+            label = had::LCM::SHADOW;
+
+        // T_alpha2 < alpha_i < T_alpha1
+        if( bdist > _threshold_bdist_left && bdist < _threshold_bdist_right )
+            label = had::LCM::BACKGROUND;
+
+        // CD_i > T_cd, on squared values
+        if( cdist_norm_squared[ x ] > _threshold_cdist_squared )
+            label = had::LCM::FOREGROUND;
+
+        out_labels[ x ] = label;
+    }
 }
 
 
@@ -148,98 +212,236 @@ void had::LCM::classify( const cv::Mat& image,
                                cv::Mat& out_classification )
 {
     // See Horprasert et al., 1999, Eq 11
-    cv::Mat bdist_norm, cdist_norm;
-    computeNormalizedDistortions( image, bdist_norm, cdist_norm );
+    CV_Assert( image.type() == CV_8UC3 && acceptsSize( image.size() ) );
+    HAD_STATS_LOCAL( stats );
+    HAD_STAGE_CLOCK( stats );
 
-    if( _trace )
+    if( createOutput( out_classification, image.size(), CV_8UC1 ) )
     {
-        std::cerr << "Thresholds: cdist=" << _threshold_cdist << " "
-                  << "bdist_left=" << _threshold_bdist_left << " " 
-                  << "bdist_right=" << _threshold_bdist_right << " " 
-                  << std::endl;
+        HAD_COUNT( stats, COUNTER_ALLOCATIONS, 1 );
+        HAD_COUNT( stats, COUNTER_ALLOCATED_BYTES, image.rows * image.cols );
     }
+    ClassificationBatch batch = { &image, &out_classification, 1, NULL, false, 0 };
+    parallelRows( 0,
+                  image.rows,
+                  boost::bind( &LCM::classifyRows, this, boost::cref( batch ), _1, _2 ) );
+
+    HAD_STAGE_SPLIT( STAGE_CLASSIFY );
+    HAD_COUNT( stats, COUNTER_FRAMES, 1 );
+    HAD_COUNT( stats, COUNTER_PIXELS, image.rows * image.cols );
+    HAD_STATS_MERGE( stats );
+}
+
+
+void had::LCM::classify( const vector<cv::Mat>& images,
+                               vector<cv::Mat>& out_classifications )
+{
+    // See Horprasert et al., 1999, Eq 11
+    out_classifications.resize( images.size() );
+    if( images.empty() )
+        return;
 
-    // CD_i > T_cd
-    cv::Mat mask_foreground;
-    cv::threshold( cdist_norm,
-                   mask_foreground,
-                   _threshold_cdist,
-                   had::LCM::FOREGROUND,
-                   cv::THRESH_BINARY );
-
-    // alpha_i > T_alpha2
-    cv::Mat mask_background_left;
-    cv::threshold( bdist_norm,
-                   mask_background_left,
-                   _threshold_bdist_left,
-                   had::LCM::BACKGROUND,
-                   cv::THRESH_BINARY );
-
-    // alpha_i < T_alpha1
-    cv::Mat mask_background_right;
-    cv::threshold( - bdist_norm,
-                   mask_background_right,
-                   - _threshold_bdist_right,
-                   had::LCM::BACKGROUND,
-                   cv::THRESH_BINARY );
-
-    // Combine the two background masks
-    cv::Mat mask_background = mask_background_left & mask_background_right;
-
-    // alpha_i < 0
-    cv::Mat mask_shadow;
-    cv::threshold( - bdist_norm,
-                   mask_shadow,
-                   0,
-                   had::LCM::SHADOW,
-                   cv::THRESH_BINARY );
-
-    cv::Mat mask_foreground_8u, mask_background_8u, mask_shadow_8u;
-    mask_foreground.convertTo( mask_foreground_8u, CV_8UC1 );
-    mask_background.convertTo( mask_background_8u, CV_8UC1 );
-    mask_shadow.convertTo( mask_shadow_8u, CV_8UC1 );
-
-    if( _trace )
+    HAD_STATS_LOCAL( stats );
+    HAD_STAGE_CLOCK( stats );
+    for( unsigned int id_image = 0; id_image < images.size(); ++id_image )
     {
-        showImage( "foreground", (mask_foreground_8u - 3) * 255, 0, 0 );
-        showImage( "shadow", (mask_shadow_8u - 1) * 255, 0, 1 );
-        showImage( "background", mask_background_8u * 255, 0, 2 );
+        CV_Assert( images[ id_image ].type() == CV_8UC3 && images[ id_image ].size() == images[ 0 ].size() );
+        CV_Assert( acceptsSize( images[ id_image ].size() ) );
+        if( createOutput( out_classifications[ id_image ], images[ 0 ].size(), CV_8UC1 ) )
+        {
+            HAD_COUNT( stats, COUNTER_ALLOCATIONS, 1 );
+            HAD_COUNT( stats, COUNTER_ALLOCATED_BYTES, images[ 0 ].rows * images[ 0 ].cols );
+        }
     }
 
-    // Now use the different masks to create the classification
-    out_classification = cv::Mat( image.size(),
-                                  CV_8UC1,
-                                  cv::Scalar( had::LCM::HIGHLIGHT ) );
+    ClassificationBatch batch = { &images[ 0 ], &out_classifications[ 0 ], (int) images.size(), NULL, false, 0 };
+    parallelRows( 0,
+                  images[ 0 ].rows,
+                  boost::bind( &LCM::classifyRows, this, boost::cref( batch ), _1, _2 ) );
 
-    mask_shadow_8u.copyTo( out_classification, mask_shadow_8u );
-    mask_background_8u.copyTo( out_classification, mask_background_8u );
-    mask_foreground_8u.copyTo( out_classification, mask_foreground_8u );
+    HAD_STAGE_SPLIT( STAGE_CLASSIFY );
+    HAD_COUNT( stats, COUNTER_FRAMES, images.size() );
+    HAD_COUNT( stats, COUNTER_PIXELS, images.size() * images[ 0 ].rows * images[ 0 ].cols );
+    HAD_STATS_MERGE( stats );
 }
 
 
-void had::LCM::classificationToImage( const cv::Mat& classification,
-                                          cv::Mat& out_image )
+void had::LCM::classify( const cv::Mat&      image,
+                         const cv::Mat&      mask,
+                               unsigned char label_outside,
+                               cv::Mat&      out_classification )
+{
+    // See Horprasert et al., 1999, Eq 11
+    CV_Assert( image.type() == CV_8UC3 && acceptsSize( image.size() ) );
+    CV_Assert( mask.type() == CV_8UC1 && mask.size() == image.size() );
+    HAD_STATS_LOCAL( stats );
+    HAD_STAGE_CLOCK( stats );
+
+    if( createOutput( out_classification, image.size(), CV_8UC1 ) )
+    {
+        HAD_COUNT( stats, COUNTER_ALLOCATIONS, 1 );
+        HAD_COUNT( stats, COUNTER_ALLOCATED_BYTES, image.rows * image.cols );
+    }
+    ClassificationBatch batch = { &image, &out_classification, 1, &mask, true, label_outside };
+    parallelRows( 0,
+                  image.rows,
+                  boost::bind( &LCM::classifyRows, this, boost::cref( batch ), _1, _2 ) );
+
+    HAD_STAGE_SPLIT( STAGE_CLASSIFY );
+    HAD_COUNT( stats, COUNTER_FRAMES, 1 );
+    HAD_STATS_MERGE( stats );
+}
+
+
+void had::LCM::classify( const cv::Mat& image,
+                         const cv::Mat& mask,
+                               cv::Mat& io_classification )
 {
-    out_image = cv::Mat( classification.size(), CV_8UC3, cv::Scalar::all( 0 ) );
-    for( int y = 0; y < classification.rows; ++y )
+    // See Horprasert et al., 1999, Eq 11
+    CV_Assert( image.type() == CV_8UC3 && acceptsSize( image.size() ) );
+    CV_Assert( mask.type() == CV_8UC1 && mask.size() == image.size() );
+    CV_Assert( io_classification.type() == CV_8UC1 && io_classification.size() == image.size() );
+    HAD_STATS_LOCAL( stats );
+    HAD_STAGE_CLOCK( stats );
+
+    ClassificationBatch batch = { &image, &io_classification, 1, &mask, false, 0 };
+    parallelRows( 0,
+                  image.rows,
+                  boost::bind( &LCM::classifyRows, this, boost::cref( batch ), _1, _2 ) );
+
+    HAD_STAGE_SPLIT( STAGE_CLASSIFY );
+    HAD_COUNT( stats, COUNTER_FRAMES, 1 );
+    HAD_STATS_MERGE( stats );
+}
+
+
+void had::LCM::classify( const cv::Mat&          image,
+                         const vector<cv::Rect>& regions,
+                               unsigned char     label_outside,
+                               cv::Mat&          out_classification )
+{
+    // The mask is a header over the workspace of the calling thread, so that
+    // the calls on different threads do not share it. It is held while the
+    // rows are classified, during which this thread may run a task calling
+    // this function again: that call allocates its own mask.
+    HAD_STATS_LOCAL( stats );
+    unsigned char* mask_data = Workspace::hold( Workspace::BUFFER_REGIONS_MASK,
+                                                image.rows * image.cols,
+                                                HAD_STATS_POINTER( stats ) );
+    cv::Mat regions_mask;
+    if( mask_data )
+        regions_mask = cv::Mat( image.rows, image.cols, CV_8UC1, mask_data );
+    else
+        regions_mask.create( image.size(), CV_8UC1 );
+    regions_mask.setTo( cv::Scalar( 0 ) );
+    fillRectangles( regions_mask, regions, cv::Scalar( 1 ) );
+    HAD_STATS_MERGE( stats );
+
+    try
     {
+        classify( image, regions_mask, label_outside, out_classification );
+    }
+    catch( ... )
+    {
+        if( mask_data )
+            Workspace::release( Workspace::BUFFER_REGIONS_MASK );
+        throw;
+    }
+    if( mask_data )
+        Workspace::release( Workspace::BUFFER_REGIONS_MASK );
+}
+
+
+void had::LCM::classificationToImageRows( const cv::Mat& classification,
+                                                cv::Mat& out_image,
+                                                int      y_begin,
+                                                int      y_end )
+{
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        const unsigned char* row_classification = classification.ptr<unsigned char>( y );
+        unsigned char* row_image = out_image.ptr<unsigned char>( y );
         for( int x = 0; x < classification.cols; ++x )
         {
-            unsigned char type = classification.at<unsigned char>( y, x );
-            if( type == had::LCM::FOREGROUND )
-            {
-                out_image.at<cv::Vec3b>( y, x )[ 0 ] = 255; // blue
-            }
-            else if( type == had::LCM::BACKGROUND )
-            {
-                out_image.at<cv::Vec3b>( y, x )[ 1 ] = 255; // green
-            }
-            else if( type == had::LCM::SHADOW )
-            {
-                out_image.at<cv::Vec3b>( y, x )[ 2 ] = 255; // red
-            }
+            unsigned char type = row_classification[ x ];
+            unsigned char* pixel = row_image + 3 * x;
+            pixel[ 0 ] = type == had::LCM::FOREGROUND ? 255 : 0; // blue
+            pixel[ 1 ] = type == had::LCM::BACKGROUND ? 255 : 0; // green
+            pixel[ 2 ] = type == had::LCM::SHADOW     ? 255 : 0; // red
             // else: type == had::LCM::HIGHLIGHT => black
         }
     }
 }
 
+
+void had::LCM::classificationToImage( const cv::Mat& classification,
+                                          cv::Mat& out_image )
+{
+    HAD_STATS_LOCAL( stats );
+    HAD_STAGE_CLOCK( stats );
+    if( createOutput( out_image, classification.size(), CV_8UC3 ) )
+    {
+        HAD_COUNT( stats, COUNTER_ALLOCATIONS, 1 );
+        HAD_COUNT( stats, COUNTER_ALLOCATED_BYTES, 3 * classification.rows * classification.cols );
+    }
+    parallelRows( 0,
+                  classification.rows,
+                  boost::bind( &LCM::classificationToImageRows,
+                               this,
+                               boost::cref( classification ),
+                               boost::ref( out_image ),
+                               _1,
+                               _2 ) );
+    HAD_STAGE_SPLIT( STAGE_TO_IMAGE );
+    HAD_STATS_MERGE( stats );
+}
+
+
+void had::LCM::mergeStats( const StageStats& stats )
+{
+    boost::mutex::scoped_lock lock( _stats_mutex );
+    _stats += stats;
+}
+
+
+had::StageStats had::LCM::getStats()
+{
+    boost::mutex::scoped_lock lock( _stats_mutex );
+    return _stats;
+}
+
+
+void had::LCM::clearStats()
+{
+    boost::mutex::scoped_lock lock( _stats_mutex );
+    _stats.clear();
+}
+
+
+void had::LCM::save( const string& filename ) const
+{
+    ModelFileHeader header;
+    vector<cv::Mat> blocks;
+    header.type                    = getModelBlocks( blocks );
+    header.detection_rate          = _detection_rate;
+    header.threshold_cdist_squared = _threshold_cdist_squared;
+    header.threshold_bdist_left    = _threshold_bdist_left;
+    header.threshold_bdist_right   = _threshold_bdist_right;
+    ModelFile::write( filename, header, blocks );
+}
+
+
+had::LCM* had::LCM::load( const string& filename, ThreadPool* pool )
+{
+    boost::shared_ptr<ModelFile> file( new ModelFile( filename ) );
+
+    switch( file->getHeader().type )
+    {
+        case MODEL_SINGLE:          return new SingleLCM( file, pool );
+        case MODEL_MULTIPLE:        return new MultipleLCM( file, pool );
+        case MODEL_GLOBAL_VARIANCE: return new GlobalVarianceLCM( file, pool );
+        case MODEL_QUANTIZED:       return new QuantizedLCM( file, pool );
+        default:                    CV_Error( CV_StsError, "the model file " + filename + " has an unknown model type" );
+    }
+    return NULL;
+}
@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 #include <vector>
 using std::vector;
 #include <string>
@@ -13,6 +14,16 @@ using std::string;
 #include <cv.h>
 #include <highgui.h>
 
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "Instrumentation.hpp"
+#include "QuantileSelector.hpp"
+#include "ModelFile.hpp"
+#include "ThreadPool.hpp"
+#include "Workspace.hpp"
+
 namespace had {
 
 /* ----------------------------------------------------------------------------*/
@@ -52,10 +63,21 @@ class LCM
 {
 protected:
     float      _detection_rate;         //!< Percentage of background pixels to (ex: .95 means 95%)
-    float      _threshold_cdist;        //!< Contrast distortion threshold (computed automatically)
+    float      _threshold_cdist_squared; //!< Squared chromaticity distortion threshold (computed automatically)
     float      _threshold_bdist_left;   //!< Left brightness distortion threshold (computed automatically)
     float      _threshold_bdist_right;  //!< Right brightness distortion threshold (computed automatically)
-    bool       _trace;                  //!< If true, show debugging values and images
+    ThreadPool* _pool;                  //!< Pool used to process rows in parallel (not owned, NULL to use the calling thread only)
+    boost::shared_ptr<ModelFile> _model_file; //!< File the model was loaded from, which holds its planes (empty if the model was trained)
+    StageStats   _stats;                //!< Timers and counters collected so far (see getStats()).
+    boost::mutex _stats_mutex;          //!< Protects _stats.
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Add statistics collected by a stage to those of the model, see
+    * HAD_STATS_MERGE.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void mergeStats( const StageStats& stats );
 
     /* ----------------------------------------------------------------------------*/
     /** 
@@ -87,23 +109,6 @@ protected:
                          const vector<cv::Rect>& rectangles,
                          const cv::Scalar value );
 
-    /* ----------------------------------------------------------------------------*/
-    /** 
-    * @brief Show an image in the cell of a grid system, for debugging purposes.
-    *
-    * The screen is divided into cells of equal size, and the given image is shown
-    * into a cell of that grid. The col and row parameters determine which cell
-    * it is. The size of the cell (and therefore of the image) is determined inside
-    * of the method, to maintain alignment.
-    * 
-    * @param name Name of the window.
-    * @param image Image to show (any format will work).
-    * @param col Column of the cell in which the image will be shown (starting at 0).
-    * @param row Row of the cell in which the image will be shown (starting at 0).
-    */
-    /* ----------------------------------------------------------------------------*/
-    void showImage( const string name, const cv::Mat& image, int col, int row );
-
     /* ----------------------------------------------------------------------------*/
     /** 
     * @brief Select thresholds based upon values in a matrix.
@@ -121,22 +126,159 @@ protected:
 
     /* ----------------------------------------------------------------------------*/
     /** 
-    * @brief Select thresholds for the color model.
+    * @brief Process a range of rows, in parallel if a thread pool has been set.
+    *
+    * The way the rows are split only depends on the range and on nb_chunks, so
+    * that the results do not depend on the number of threads, and the task is
+    * not copied (see ThreadPool::runRange()).
     * 
-    * @param detection_rate Detection rate (ex: 95% is .95)
-    * @param bdist_norm Normalized brightness distortion distribution.
-    * @param cdist_norm Normalize chromaticity distortion distribution.
-    * @param out_threshold_cdist Computed chromaticity distortion threshold.
-    * @param out_threshold_bdist_left Computed left brightness distortion threshold.
-    * @param out_threshold_bdist_right Computed right brightness distortion threshold.
+    * @param begin First row.
+    * @param end Row after the last row.
+    * @param task Task called with the bounds of each band of rows.
+    * @param nb_chunks Maximum number of bands (0 to let the pool decide).
+    */
+    /* ----------------------------------------------------------------------------*/
+    template<typename RowsTask>
+    void parallelRows( int begin,
+                       int end,
+                       const RowsTask& task,
+                       int nb_chunks = 0 )
+    {
+        ThreadPool::runRange( _pool, begin, end, task, nb_chunks );
+    }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Images of a classification, shared by all its bands of rows, see
+    * classifyRows().
+    */
+    /* ----------------------------------------------------------------------------*/
+    struct ClassificationBatch
+    {
+        const cv::Mat*      images;                 //!< Input images (8-bit 3-channel images, CV_8UC3), of the same size.
+        cv::Mat*            out_classifications;    //!< Classification images, already allocated.
+        int                 nb_images;              //!< Number of images.
+        const cv::Mat*      mask;                   //!< Mask of the pixels to classify (CV_8UC1), NULL to classify all of them.
+        bool                fill_outside;           //!< If true, the pixels outside the mask are set to label_outside, and otherwise kept.
+        unsigned char       label_outside;          //!< Label of the pixels outside the mask.
+    };
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Classify a band of rows of a batch of images, see classify().
+    *
+    * This is the only virtual call of a classification, once per band: the
+    * models implement it with classifyRowsOf(), which calls their row
+    * functions directly, so that the compiler can inline them.
+    * 
+    * @param batch Images to classify.
+    * @param y_begin First row of the band.
+    * @param y_end Row after the last row of the band.
+    */
+    /* ----------------------------------------------------------------------------*/
+    virtual void classifyRows( const ClassificationBatch& batch,
+                                     int                  y_begin,
+                                     int                  y_end ) = 0;
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Classify a band of rows of a batch of images with the row
+    * functions of a model, called without virtual dispatch.
+    *
+    * The band is split into tiles of a few rows, and each tile is classified
+    * in all the images before moving to the next one, so that the part of the
+    * model that the tile reads stays in the cache. With a mask, each row is
+    * split into the runs of pixels inside and outside the mask: the runs
+    * inside are classified with classifyRowOf(), and the runs outside are
+    * filled with label_outside, or kept.
+    *
+    * It is instantiated in the file of each model, where the row functions
+    * of the model are defined, and the model must be a friend of LCM.
+    * 
+    * @param batch Images to classify.
+    * @param y_begin First row of the band.
+    * @param y_end Row after the last row of the band.
+    */
+    /* ----------------------------------------------------------------------------*/
+    template<typename Model>
+    void classifyRowsOf( const ClassificationBatch& batch,
+                               int                  y_begin,
+                               int                  y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Classify a span of pixels of a row of an image with the row
+    * functions of a model, see classifyRowsOf().
+    * 
+    * @param x_begin First pixel of the span.
+    * @param x_end Pixel after the last pixel of the span.
+    * @param bdist_norm Buffer of image.cols values for the brightness distortions.
+    * @param cdist_norm_squared Buffer of image.cols values for the chromaticity
+    * distortions.
+    * @param io_stats Statistics of the band, NULL if they are not collected
+    * (see HAD_STATS_POINTER).
+    */
+    /* ----------------------------------------------------------------------------*/
+    template<typename Model>
+    void classifyRowOf( const cv::Mat&    image,
+                              cv::Mat&    out_classification,
+                              int         y,
+                              int         x_begin,
+                              int         x_end,
+                              float*      bdist_norm,
+                              float*      cdist_norm_squared,
+                              StageStats* io_stats );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Convert a band of rows of a classification image, see
+    * classificationToImage().
     */
     /* ----------------------------------------------------------------------------*/
-    void selectThresholds( const float    detection_rate,
-                           const cv::Mat& bdist_norm,
-                           const cv::Mat& cdist_norm,
-                                 float*   out_threshold_cdist,
-                                 float*   out_threshold_bdist_left,
-                                 float*   out_threshold_bdist_right );
+    void classificationToImageRows( const cv::Mat& classification,
+                                          cv::Mat& out_image,
+                                          int      y_begin,
+                                          int      y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Feed the distortions of the training images to partial selectors,
+    * see selectThresholds().
+    *
+    * The rows of all the images are seen as a single range, which is split
+    * into as many bands as there are partial selectors.
+    * 
+    * @param images Training images (8-bit 3-channel images, CV_8UC3).
+    * @param io_selectors_bdist Partial selectors of the brightness distortions.
+    * @param io_selectors_cdist Partial selectors of the chromaticity distortions.
+    * @param id_begin First partial selector to feed.
+    * @param id_end Partial selector after the last one to feed.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void selectThresholdsRows( const vector<cv::Mat>&          images,
+                                     vector<QuantileSelector>& io_selectors_bdist,
+                                     vector<QuantileSelector>& io_selectors_cdist,
+                                     int                       id_begin,
+                                     int                       id_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Select the thresholds of the color model from the distortions of
+    * the training images.
+    *
+    * The distortions are computed one row at a time with
+    * computeNormalizedDistortionsRow() and streamed into a QuantileSelector,
+    * so that the memory used does not depend on the number or on the size of
+    * the training images. The thresholds are stored in _threshold_cdist_squared,
+    * _threshold_bdist_left and _threshold_bdist_right.
+    *
+    * See Horprasert et al., 1999, Section 4.3
+    * 
+    * @param images Training images (8-bit 3-channel images, CV_8UC3), at
+    * least one.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void selectThresholds( const vector<cv::Mat>& images );
 
     /* ----------------------------------------------------------------------------*/
     /** 
@@ -156,83 +298,103 @@ protected:
 
     /* ----------------------------------------------------------------------------*/
     /** 
-    * @brief Compute the brightness distortion of a pixel.
+    * @brief Compute the normalized brightness and chromaticity distortions of
+    * a span of pixels in a row of an image.
     *
-    * See Horprasert et al., 1999, Eq. 5
-    * See Yacoob and Davis, 2006, Eq. 3
-    * 
-    * @param pixel Pixel (8-bit 3-channel Scalar).
-    * @param brightness Brightness of the pixel.
+    * This method is re-implemented by the actual models. It is the per-row
+    * building block of classify(), which keeps the two rows of distortions in
+    * the cache instead of materializing full distortion images.
+    * See Horprasert et al., 1999, Eqs. 9 and 10
     * 
-    * @return The brightness distortion of the given pixel.
+    * @param image Input image (8-bit 3-channel image, CV_8UC3).
+    * @param y Index of the row in the image.
+    * @param x_begin First pixel of the span.
+    * @param x_end Pixel after the last pixel of the span.
+    * @param out_bdist_norm Array of image.cols values, whose values in the
+    * span receive the normalized brightness distortions.
+    * @param out_cdist_norm_squared Array of image.cols values, whose values in
+    * the span receive the squared normalized chromaticity distortions.
     */
     /* ----------------------------------------------------------------------------*/
-    float computeBrightnessDistortion( const cv::Vec3b& pixel,
-                                       const cv::Scalar& brightness );
+    virtual void computeNormalizedDistortionsRow( const cv::Mat& image,
+                                                        int      y,
+                                                        int      x_begin,
+                                                        int      x_end,
+                                                        float*   out_bdist_norm,
+                                                        float*   out_cdist_norm_squared ) = 0;
 
     /* ----------------------------------------------------------------------------*/
     /** 
-    * @brief Compute the brightness distortion of the pixel in a given image.
-    *
-    * This method is re-implemented by the actual models.
-    * See Horprasert et al., 1999, Eq. 5
-    * See Yacoob and Davis, 2006, Eq. 3
+    * @brief Update the model with a span of pixels of a row of an image that
+    * has just been classified. Called by classify() for each span, after the
+    * labeling; the model is not updated by default.
     * 
-    * @param image Input image (8-bit 3-channel image, CV_8UC3)
-    * @param y Y-coordinate of the pixel whose brightness distortion needs
-    * to be computed.
-    * @param x X-coordinate of the pixel whose brightness distortion needs
-    * to be computed.
-    * 
-    * @return The brightness distortion of the given pixel.
+    * @param image Classified image (8-bit 3-channel image, CV_8UC3).
+    * @param y Index of the row in the image.
+    * @param x_begin First pixel of the span.
+    * @param x_end Pixel after the last pixel of the span.
+    * @param bdist_norm Normalized brightness distortions of the row.
+    * @param cdist_norm_squared Squared normalized chromaticity distortions of the row.
+    * @param labels Labels of the row.
     */
     /* ----------------------------------------------------------------------------*/
-    virtual float computeBrightnessDistortion( const cv::Mat& image,
-                                               int y,
-                                               int x ) = 0;
+    virtual void updateModelRow( const cv::Mat&       image,
+                                       int            y,
+                                       int            x_begin,
+                                       int            x_end,
+                                 const float*         bdist_norm,
+                                 const float*         cdist_norm_squared,
+                                 const unsigned char* labels ) {}
 
     /* ----------------------------------------------------------------------------*/
     /** 
-    * @brief Compute the chromaticity distortion of a pixel.
-    *
-    * See Horprasert et al., 1999, Eq. 6
-    * See Yacoob and Davis, 2006, Eq. 4
+    * @brief Label a span of pixels of a row of an image directly from their
+    * colors, without computing their distortions, for the models that can
+    * (see SingleLCM::buildLookupTable()). Called by classify() for each span;
+    * the model is then not updated.
     * 
-    * @param pixel Pixel (8-bit 3-channel Scalar).
-    * @param mean Mean of the training pixels (8-bit 3-channel Scalar).
-    * @param stddev Standard deviation of the training pixels (8-bit 3-channel Scalar).
-    * @param bdist Brightness distortion of the training pixels.
+    * @param image Input image (8-bit 3-channel image, CV_8UC3).
+    * @param y Index of the row in the image.
+    * @param x_begin First pixel of the span.
+    * @param x_end Pixel after the last pixel of the span.
+    * @param out_labels Labels of the row, whose values in the span are set.
     * 
-    * @return The chromaticity distortion of the given pixel.
+    * @return False if the span has to be classified from its distortions.
     */
     /* ----------------------------------------------------------------------------*/
-    float computeChromacityDistortion( const cv::Vec3b&  pixel,
-                                       const cv::Scalar& mean,
-                                       const cv::Scalar& stddev,
-                                             float       bdist );
+    virtual bool lookupLabelsRow( const cv::Mat&       image,
+                                        int            y,
+                                        int            x_begin,
+                                        int            x_end,
+                                        unsigned char* out_labels ) { return false; }
 
     /* ----------------------------------------------------------------------------*/
     /** 
-    * @brief Compute the chromaticity distortion of the pixel in a given image.
-    *
-    * This method is re-implemented by the actual models.
-    * See Horprasert et al., 1999, Eq. 6
-    * See Yacoob and Davis, 2006, Eq. 4
+    * @brief Get the number of bytes of the model read to classify one pixel,
+    * used to size the tiles of the batch classification. Models whose values
+    * are the same for all the pixels return 0.
+    */
+    /* ----------------------------------------------------------------------------*/
+    virtual int getModelPixelSize() const { return 0; }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Label pixels from their normalized distortions.
     *
-    * @param image Input image (8-bit 3-channel image, CV_8UC3)
-    * @param y Y-coordinate of the pixel whose brightness distortion needs
-    * to be computed.
-    * @param x X-coordinate of the pixel whose brightness distortion needs
-    * to be computed.
-    * @param bdist Brightness distortion of the training pixels.
+    * This is the combination of all the tests of Horprasert et al., 1999, Eq. 11,
+    * in a single pass: the label of each pixel is written directly, without
+    * building intermediary masks.
     * 
-    * @return The chromaticity distortion of the given pixel.
+    * @param bdist_norm Normalized brightness distortions.
+    * @param cdist_norm_squared Squared normalized chromaticity distortions.
+    * @param nb_pixels Number of pixels to label.
+    * @param out_labels Computed labels (BACKGROUND, SHADOW, HIGHLIGHT or FOREGROUND).
     */
     /* ----------------------------------------------------------------------------*/
-    virtual float computeChromacityDistortion( const cv::Mat& image,
-                                                     int      y,
-                                                     int      x,
-                                                     float    bdist ) = 0;
+    void labelPixels( const float*         bdist_norm,
+                      const float*         cdist_norm_squared,
+                            int            nb_pixels,
+                            unsigned char* out_labels );
 
     /* ----------------------------------------------------------------------------*/
     /** 
@@ -241,13 +403,34 @@ protected:
     * 
     * @param image Input image used to compute the distributions (8-bit 3-channel
     * image, CV_8UC3).
-    * @param out_bdist_norm Computed brightness distortion distribution.
-    * @param out_cdist_norm Computed chromaticity distortion distribution.
+    * @param out_bdist_norm Computed brightness distortion distribution, whose
+    * buffer is reused if it already has the right size and type.
+    * @param out_cdist_norm_squared Computed squared chromaticity distortion
+    * distribution, whose buffer is reused in the same way.
     */
     /* ----------------------------------------------------------------------------*/
     virtual void computeNormalizedDistortions( const cv::Mat& image,
                                                      cv::Mat& out_bdist_norm,
-                                                     cv::Mat& out_cdist_norm ) = 0;
+                                                     cv::Mat& out_cdist_norm_squared ) = 0;
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Compute the normalized distortions of a band of rows of an image,
+    * with computeNormalizedDistortionsRow().
+    * 
+    * @param image Input image (8-bit 3-channel image, CV_8UC3).
+    * @param out_bdist_norm Brightness distortion distribution, already allocated.
+    * @param out_cdist_norm_squared Squared chromaticity distortion distribution,
+    * already allocated.
+    * @param y_begin First row of the band.
+    * @param y_end Row after the last row of the band.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computeNormalizedDistortionsRows( const cv::Mat& image,
+                                                 cv::Mat& out_bdist_norm,
+                                                 cv::Mat& out_cdist_norm_squared,
+                                                 int      y_begin,
+                                                 int      y_end );
 
     /* ----------------------------------------------------------------------------*/
     /** 
@@ -256,13 +439,47 @@ protected:
     * 
     * @param images Vector of input images used to compute the distributions (8-bit
     * 3-channel images, CV_8UC3).
-    * @param out_bdist_norm Computed brightness distortion distribution.
-    * @param out_cdist_norm Computed chromaticity distortion distribution.
+    * @param out_bdist_norm Computed brightness distortion distribution, the
+    * images side by side, whose buffer is reused if it already has the right
+    * size and type.
+    * @param out_cdist_norm_squared Computed squared chromaticity distortion
+    * distribution, whose buffer is reused in the same way.
     */
     /* ----------------------------------------------------------------------------*/
     virtual void computeNormalizedDistortions( const vector<cv::Mat>& image,
                                                      cv::Mat& out_bdist_norm,
-                                                     cv::Mat& out_cdist_norm ) = 0;
+                                                     cv::Mat& out_cdist_norm_squared ) = 0;
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the blocks to save in a model file, see save().
+    * 
+    * @param out_blocks Blocks of the model, in the order of ModelBlock.
+    * 
+    * @return Kind of the model.
+    */
+    /* ----------------------------------------------------------------------------*/
+    virtual ModelType getModelBlocks( vector<cv::Mat>& out_blocks ) const = 0;
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Constructor of a model loaded from a file, see load(). Only the
+    * detection rate and the thresholds are read, the blocks are left to the
+    * subclasses.
+    * 
+    * @param file Model file.
+    * @param pool Thread pool used to process rows in parallel, see setThreadPool().
+    */
+    /* ----------------------------------------------------------------------------*/
+    LCM( const boost::shared_ptr<ModelFile>& file, ThreadPool* pool )
+    : _detection_rate( file->getHeader().detection_rate ),
+      _threshold_cdist_squared( file->getHeader().threshold_cdist_squared ),
+      _threshold_bdist_left( file->getHeader().threshold_bdist_left ),
+      _threshold_bdist_right( file->getHeader().threshold_bdist_right ),
+      _pool( pool ),
+      _model_file( file )
+    {
+    }
 
 public:
     /* ----------------------------------------------------------------------------*/
@@ -270,10 +487,11 @@ public:
     * @brief Constructor.
     * 
     * @param detection_rate Detection rate (ex: 95% is .95).
+    * @param pool Thread pool used to process rows in parallel, see setThreadPool().
     */
     /* ----------------------------------------------------------------------------*/
-    LCM( const float detection_rate, const bool trace = false )
-    : _detection_rate( detection_rate ), _trace( trace )
+    LCM( const float detection_rate, ThreadPool* pool = NULL )
+    : _detection_rate( detection_rate ), _pool( pool )
     {
     }
 
@@ -284,10 +502,103 @@ public:
     /* ----------------------------------------------------------------------------*/
     virtual ~LCM() {}
 
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Set the thread pool used to split training and classification into
+    * bands of rows. The results do not depend on the number of threads.
+    * 
+    * @param pool Thread pool, which must outlive the model, or NULL to use the
+    * calling thread only (default).
+    */
+    /* ----------------------------------------------------------------------------*/
+    void setThreadPool( ThreadPool* pool ) { _pool = pool; }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the thread pool used by the model, or NULL if there is none.
+    */
+    /* ----------------------------------------------------------------------------*/
+    ThreadPool* getThreadPool() const { return _pool; }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the size of the frames that the model classifies, or an
+    * empty size if the model is the same for all the pixels and classifies
+    * frames of any size. classify() throws a cv::Exception on frames of
+    * another size.
+    */
+    /* ----------------------------------------------------------------------------*/
+    virtual cv::Size getSize() const { return cv::Size(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Check whether the model classifies frames of a size, see
+    * getSize().
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool acceptsSize( cv::Size size ) const
+    {
+        cv::Size model_size = getSize();
+        return model_size.width == 0 || model_size == size;
+    }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the timers and counters collected since the model was created
+    * or since the last call to clearStats(). They are only collected when the
+    * library is compiled with HAD_INSTRUMENTATION defined, and are all zero
+    * otherwise (see StageStats::isEnabled()).
+    */
+    /* ----------------------------------------------------------------------------*/
+    StageStats getStats();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Set all the timers and counters of the model to zero.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void clearStats();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Save the trained model in a binary file, which can be loaded back
+    * with load(). Throws a cv::Exception on errors.
+    *
+    * See ModelFile for the format of the file.
+    * 
+    * @param filename Name of the model file.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void save( const string& filename ) const;
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Load a model saved with save(). Throws a cv::Exception on errors.
+    *
+    * The file is mapped in memory and the per-pixel planes of a MultipleLCM or
+    * of a QuantizedLCM are used in place, so loading does not depend on the size of the model, and
+    * the processes that load the same file share its memory.
+    * 
+    * @param filename Name of the model file.
+    * @param pool Thread pool used to process rows in parallel, see setThreadPool().
+    * 
+    * @return The loaded model, a SingleLCM, a MultipleLCM, a GlobalVarianceLCM
+    * or a QuantizedLCM, to be deleted by the caller.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static LCM* load( const string& filename, ThreadPool* pool = NULL );
+
     /* ----------------------------------------------------------------------------*/
     /** 
     * @brief Classify the pixels of an input image based on a model.
     * 
+    * The buffer of out_classification is reused if it already has the size
+    * and the type of the result (see cv::Mat::create()), so that classifying
+    * a stream into the same matrix does not allocate any memory once the
+    * first frame has been classified: the row buffers come from the workspace
+    * of each thread (see Workspace). The matrices that share this buffer are
+    * overwritten as well.
+    *
     * @param image Input image (8-bit 3-channel image, CV_8UC3).
     * @param out_classification Computed classification image (8-bit 1-channel image,
     * CV_8UC1).
@@ -296,6 +607,90 @@ public:
     void classify( const cv::Mat& image,
                          cv::Mat& out_classification );
 
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Classify the pixels of several input images based on a model.
+    *
+    * The result is the same as classifying the images one after the other,
+    * including the updates of the model, but the images are processed tile by
+    * tile: each part of the model is read from memory once for all the
+    * images, instead of once per image.
+    * 
+    * @param images Input images, all of the same size (8-bit 3-channel images,
+    * CV_8UC3).
+    * @param out_classifications Computed classification images (8-bit 1-channel
+    * images, CV_8UC1), in the same order as the input images, whose buffers
+    * are reused as with classify( image, out_classification ).
+    */
+    /* ----------------------------------------------------------------------------*/
+    void classify( const vector<cv::Mat>& images,
+                         vector<cv::Mat>& out_classifications );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Classify only the pixels of an input image inside a mask.
+    *
+    * The distortions are only computed, and the model only updated, inside the
+    * mask, so the time taken depends on the area of the mask rather than on the
+    * size of the image. The pixels inside get the same labels as with
+    * classify( image, out_classification ).
+    * 
+    * @param image Input image (8-bit 3-channel image, CV_8UC3).
+    * @param mask Mask of the pixels to classify, which are the non-zero pixels
+    * (8-bit 1-channel image, CV_8UC1, of the size of the image).
+    * @param label_outside Label of the pixels outside the mask (ex: BACKGROUND,
+    * or 0 to tell them apart from the classified pixels).
+    * @param out_classification Computed classification image (8-bit 1-channel
+    * image, CV_8UC1), whose buffer is reused as with classify( image,
+    * out_classification ).
+    */
+    /* ----------------------------------------------------------------------------*/
+    void classify( const cv::Mat&      image,
+                   const cv::Mat&      mask,
+                         unsigned char label_outside,
+                         cv::Mat&      out_classification );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Classify only the pixels of an input image inside a mask, and keep
+    * the labels of the other pixels of an existing classification (ex: labels
+    * computed otherwise, see PyramidClassifier).
+    * 
+    * @param image Input image (8-bit 3-channel image, CV_8UC3).
+    * @param mask Mask of the pixels to classify, which are the non-zero pixels
+    * (8-bit 1-channel image, CV_8UC1, of the size of the image).
+    * @param io_classification Classification image (8-bit 1-channel image,
+    * CV_8UC1, of the size of the image), whose pixels inside the mask are
+    * classified.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void classify( const cv::Mat& image,
+                   const cv::Mat& mask,
+                         cv::Mat& io_classification );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Classify only the pixels of an input image inside a set of
+    * rectangles, see classify( image, mask, label_outside, out_classification ).
+    *
+    * The mask of the rectangles is held in the workspace of the calling
+    * thread (see Workspace::hold()), so the function does not allocate it once
+    * the workspace has grown, unless it is called from a task that the thread
+    * runs while it waits for another call.
+    * 
+    * @param image Input image (8-bit 3-channel image, CV_8UC3).
+    * @param regions Vector of rectangles that indicate which areas are
+    * classified, as for the training regions of SingleLCM.
+    * @param label_outside Label of the pixels outside the rectangles.
+    * @param out_classification Computed classification image (8-bit 1-channel
+    * image, CV_8UC1).
+    */
+    /* ----------------------------------------------------------------------------*/
+    void classify( const cv::Mat&          image,
+                   const vector<cv::Rect>& regions,
+                         unsigned char     label_outside,
+                         cv::Mat&          out_classification );
+
     /* ----------------------------------------------------------------------------*/
     /** 
     * @brief Show a classification image that has been outputed by classify().
@@ -309,7 +704,8 @@ public:
     * - BLACK: background highlight
     *
     * @param classification Classification image (8-bit 1-channel image, CV_8UC1).
-    * @param out_image Output image that can be shown. 
+    * @param out_image Output image that can be shown, whose buffer is reused
+    * if it already has the right size and type.
     */
     /* ----------------------------------------------------------------------------*/
     void classificationToImage( const cv::Mat& classification,
@@ -321,6 +717,108 @@ public:
     const static unsigned char FOREGROUND = 4; //!< Foreground pixel.
 };
 
+
+template<typename Model>
+void LCM::classifyRowsOf( const ClassificationBatch& batch,
+                                int                  y_begin,
+                                int                  y_end )
+{
+    // The tiles are sized so that the part of the model they read fits in
+    // half of a typical L2 cache, along with the rows of the images.
+    const int size_cache = 128 * 1024;
+
+    Model& model = static_cast<Model&>( *this );
+    int cols = batch.images[ 0 ].cols;
+    int size_row = cols * model.Model::getModelPixelSize();
+    int nb_rows_tile = size_row > 0 ? std::max( size_cache / size_row, 1 ) : y_end - y_begin;
+
+    // The distortions are computed, labeled and possibly used to update the
+    // model one row at a time, so that each pixel of the image and of the
+    // model is read only once. The rows are independent, and each row is
+    // classified in the same order of images as with successive calls to
+    // classify(), so the updates of the model give the same result.
+    HAD_STATS_LOCAL( stats );
+    float* bdist_norm = Workspace::get<float>( Workspace::BUFFER_BDIST_NORM, cols, HAD_STATS_POINTER( stats ) );
+    float* cdist_norm_squared = Workspace::get<float>( Workspace::BUFFER_CDIST_NORM_SQUARED, cols, HAD_STATS_POINTER( stats ) );
+    for( int y_tile = y_begin; y_tile < y_end; y_tile += nb_rows_tile )
+    {
+        int y_tile_end = std::min( y_tile + nb_rows_tile, y_end );
+        for( int id_image = 0; id_image < batch.nb_images; ++id_image )
+        {
+            const cv::Mat& image = batch.images[ id_image ];
+            cv::Mat& classification = batch.out_classifications[ id_image ];
+            for( int y = y_tile; y < y_tile_end; ++y )
+            {
+                if( ! batch.mask )
+                {
+                    classifyRowOf<Model>( image, classification, y, 0, cols, bdist_norm, cdist_norm_squared, HAD_STATS_POINTER( stats ) );
+                    continue;
+                }
+
+                const unsigned char* row_mask = batch.mask->ptr<unsigned char>( y );
+                unsigned char* labels = classification.ptr<unsigned char>( y );
+                int x = 0;
+                while( x < cols )
+                {
+                    // The runs outside the mask are skipped 8 pixels at a time
+                    int x_begin = x;
+                    while( x + 8 <= cols )
+                    {
+                        boost::uint64_t word;
+                        memcpy( &word, row_mask + x, sizeof( word ) );
+                        if( word != 0 )
+                            break;
+                        x += 8;
+                    }
+                    while( x < cols && row_mask[ x ] == 0 )
+                        ++x;
+                    if( batch.fill_outside )
+                        std::fill( labels + x_begin, labels + x, batch.label_outside );
+
+                    x_begin = x;
+                    while( x < cols && row_mask[ x ] != 0 )
+                        ++x;
+                    if( x > x_begin )
+                    {
+                        classifyRowOf<Model>( image, classification, y, x_begin, x, bdist_norm, cdist_norm_squared, HAD_STATS_POINTER( stats ) );
+                        HAD_COUNT( stats, COUNTER_PIXELS, x - x_begin );
+                    }
+                }
+            }
+        }
+    }
+    HAD_STATS_MERGE( stats );
+}
+
+
+template<typename Model>
+void LCM::classifyRowOf( const cv::Mat&    image,
+                               cv::Mat&    out_classification,
+                               int         y,
+                               int         x_begin,
+                               int         x_end,
+                               float*      bdist_norm,
+                               float*      cdist_norm_squared,
+                               StageStats* io_stats )
+{
+    // The calls are qualified with the model, so that they are not virtual
+    HAD_STAGE_CLOCK( *io_stats );
+    Model& model = static_cast<Model&>( *this );
+    unsigned char* labels = out_classification.ptr<unsigned char>( y );
+    if( model.Model::lookupLabelsRow( image, y, x_begin, x_end, labels ) )
+    {
+        HAD_STAGE_SPLIT( STAGE_LABELING );
+        return;
+    }
+
+    model.Model::computeNormalizedDistortionsRow( image, y, x_begin, x_end, bdist_norm, cdist_norm_squared );
+    HAD_STAGE_SPLIT( STAGE_DISTORTIONS );
+    labelPixels( bdist_norm + x_begin, cdist_norm_squared + x_begin, x_end - x_begin, labels + x_begin );
+    HAD_STAGE_SPLIT( STAGE_LABELING );
+    model.Model::updateModelRow( image, y, x_begin, x_end, bdist_norm, cdist_norm_squared, labels );
+    HAD_STAGE_SPLIT( STAGE_UPDATE );
+}
+
 }
 
 #endif // HAD_LCM_HPP
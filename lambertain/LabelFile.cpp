@@ -0,0 +1,310 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "LabelFile.hpp"
+
+namespace {
+
+const char MAGIC[ 8 ] = { 'H', 'A', 'D', 'L', 'B', 'L', 0, 0 };
+const boost::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// Alignment of the frame headers in the file
+const size_t FRAME_ALIGNMENT = 8;
+
+size_t alignOffset( size_t offset )
+{
+    return ( offset + FRAME_ALIGNMENT - 1 ) / FRAME_ALIGNMENT * FRAME_ALIGNMENT;
+}
+
+// Labels of the four pixels of each packed byte, as the bytes of a 32-bit
+// value in the order of the pixels
+struct UnpackTable
+{
+    unsigned char labels[ 256 ][ 4 ];
+
+    UnpackTable()
+    {
+        for( int value = 0; value < 256; ++value )
+            for( int id = 0; id < 4; ++id )
+                labels[ value ][ id ] = (unsigned char) ( ( ( value >> ( 2 * id ) ) & 3 ) + 1 );
+    }
+};
+
+const UnpackTable UNPACK_TABLE;
+
+void unpack( const unsigned char* packed, size_t nb_labels, unsigned char* out_labels )
+{
+    size_t nb_bytes = nb_labels / 4;
+    for( size_t id = 0; id < nb_bytes; ++id )
+        memcpy( out_labels + 4 * id, UNPACK_TABLE.labels[ packed[ id ] ], 4 );
+    for( size_t id = 4 * nb_bytes; id < nb_labels; ++id )
+        out_labels[ id ] = UNPACK_TABLE.labels[ packed[ nb_bytes ] ][ id - 4 * nb_bytes ];
+}
+
+// Decode the runs of a frame, returning false if they are invalid or do not
+// cover exactly nb_labels labels
+bool decodeRuns( const unsigned char* runs, size_t size, size_t nb_labels, unsigned char* out_labels )
+{
+    const unsigned char* end = runs + size;
+    size_t position = 0;
+    while( runs < end )
+    {
+        unsigned char label = *runs++;
+        boost::uint64_t length = 0;
+        int shift = 0;
+        for( ;; )
+        {
+            if( runs == end || shift > 56 )
+                return false;
+            unsigned char byte = *runs++;
+            length |= (boost::uint64_t) ( byte & 0x7f ) << shift;
+            shift += 7;
+            if( ( byte & 0x80 ) == 0 )
+                break;
+        }
+
+        ++length;
+        if( length > nb_labels - position )
+            return false;
+        memset( out_labels + position, label, length );
+        position += length;
+    }
+    return position == nb_labels;
+}
+
+}
+
+const boost::uint32_t had::LabelWriter::VERSION;
+
+
+had::LabelWriter::LabelWriter( const string& filename,
+                               cv::Size      size,
+                               int           encoding )
+: _filename( filename ), _size( size ), _encoding( encoding ), _nb_frames( 0 ), _nb_bytes( 0 )
+{
+    CV_Assert( size.width > 0 && size.height > 0 );
+    CV_Assert( encoding == LABELS_AUTO || encoding == LABELS_PACKED || encoding == LABELS_RLE );
+
+    _file.open( filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+    if( ! _file )
+        CV_Error( CV_StsError, "cannot create the label file " + filename );
+
+    LabelFileHeader header;
+    memset( &header, 0, sizeof( LabelFileHeader ) );
+    memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+    header.version    = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.rows       = size.height;
+    header.cols       = size.width;
+    _file.write( (const char*) &header, sizeof( LabelFileHeader ) );
+    _nb_bytes = alignOffset( sizeof( LabelFileHeader ) );
+    const char padding[ FRAME_ALIGNMENT ] = { 0 };
+    _file.write( padding, _nb_bytes - sizeof( LabelFileHeader ) );
+    if( ! _file )
+        CV_Error( CV_StsError, "cannot write the label file " + filename );
+}
+
+
+bool had::LabelWriter::pack( const unsigned char* labels, size_t nb_labels, unsigned char* out_packed )
+{
+    // The labels are valid if all the labels - 1 fit in two bits, which is
+    // checked once on all of them
+    unsigned char invalid = 0;
+    size_t nb_bytes = nb_labels / 4;
+    for( size_t id = 0; id < nb_bytes; ++id )
+    {
+        unsigned char value_0 = labels[ 4 * id ] - 1;
+        unsigned char value_1 = labels[ 4 * id + 1 ] - 1;
+        unsigned char value_2 = labels[ 4 * id + 2 ] - 1;
+        unsigned char value_3 = labels[ 4 * id + 3 ] - 1;
+        invalid |= value_0 | value_1 | value_2 | value_3;
+        out_packed[ id ] = (unsigned char) ( value_0 | ( value_1 << 2 ) | ( value_2 << 4 ) | ( value_3 << 6 ) );
+    }
+    if( nb_labels > 4 * nb_bytes )
+    {
+        unsigned char last = 0;
+        for( size_t id = 4 * nb_bytes; id < nb_labels; ++id )
+        {
+            unsigned char value = labels[ id ] - 1;
+            invalid |= value;
+            last |= (unsigned char) ( value << ( 2 * ( id - 4 * nb_bytes ) ) );
+        }
+        out_packed[ nb_bytes ] = last;
+    }
+    return ( invalid & ~3 ) == 0;
+}
+
+
+void had::LabelWriter::encodeRuns( const unsigned char* labels, size_t nb_labels, vector<unsigned char>& out_runs )
+{
+    size_t position = 0;
+    while( position < nb_labels )
+    {
+        unsigned char label = labels[ position ];
+        size_t end = position + 1;
+        while( end < nb_labels && labels[ end ] == label )
+            ++end;
+
+        out_runs.push_back( label );
+        boost::uint64_t length = end - position - 1;
+        while( length >= 0x80 )
+        {
+            out_runs.push_back( (unsigned char) ( ( length & 0x7f ) | 0x80 ) );
+            length >>= 7;
+        }
+        out_runs.push_back( (unsigned char) length );
+        position = end;
+    }
+}
+
+
+void had::LabelWriter::write( const cv::Mat& classification )
+{
+    CV_Assert( classification.type() == CV_8UC1 && classification.size() == _size );
+
+    // The labels are encoded in raster order, across the rows
+    cv::Mat labels = classification.isContinuous() ? classification : classification.clone();
+    size_t nb_labels = (size_t) _size.width * _size.height;
+
+    bool packed = false;
+    if( _encoding != LABELS_RLE )
+    {
+        _packed.resize( ( nb_labels + 3 ) / 4 );
+        packed = pack( labels.data, nb_labels, &_packed[ 0 ] );
+    }
+    _runs.clear();
+    if( ! packed || _encoding == LABELS_AUTO )
+        encodeRuns( labels.data, nb_labels, _runs );
+    if( packed && _encoding == LABELS_AUTO && _runs.size() < _packed.size() )
+        packed = false;
+
+    const vector<unsigned char>& data = packed ? _packed : _runs;
+    LabelFrameHeader header;
+    header.encoding = packed ? LABELS_PACKED : LABELS_RLE;
+    header.size     = data.size();
+    size_t size = alignOffset( sizeof( LabelFrameHeader ) + data.size() );
+
+    const char padding[ FRAME_ALIGNMENT ] = { 0 };
+    _file.write( (const char*) &header, sizeof( LabelFrameHeader ) );
+    _file.write( (const char*) &data[ 0 ], data.size() );
+    _file.write( padding, size - sizeof( LabelFrameHeader ) - data.size() );
+    if( ! _file )
+        CV_Error( CV_StsError, "cannot write the label file " + _filename );
+
+    _nb_bytes += size;
+    ++_nb_frames;
+}
+
+
+void had::LabelWriter::flush()
+{
+    _file.flush();
+    if( ! _file )
+        CV_Error( CV_StsError, "cannot write the label file " + _filename );
+}
+
+
+had::LabelReader::LabelReader( const string& filename )
+: _data( NULL ), _size( 0 )
+{
+    int fd = open( filename.c_str(), O_RDONLY );
+    if( fd < 0 )
+        CV_Error( CV_StsError, "cannot open the label file " + filename );
+
+    struct stat status;
+    if( fstat( fd, &status ) != 0 || (size_t) status.st_size < sizeof( LabelFileHeader ) )
+    {
+        close( fd );
+        CV_Error( CV_StsError, "the label file " + filename + " is truncated" );
+    }
+    _size = status.st_size;
+
+    // The mapping stays valid after the file descriptor is closed
+    void* data = mmap( NULL, _size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( data == MAP_FAILED )
+        CV_Error( CV_StsError, "cannot map the label file " + filename );
+    _data = (unsigned char*) data;
+
+    const LabelFileHeader& header = *(const LabelFileHeader*) _data;
+    string error;
+    if( memcmp( header.magic, MAGIC, sizeof( MAGIC ) ) != 0 )
+        error = "is not a label file";
+    else if( header.byte_order != BYTE_ORDER_MARK )
+        error = "was written on a machine with a different byte order";
+    else if( header.version != LabelWriter::VERSION )
+        error = "has an unsupported version";
+
+    // The frames stop at the first one that is incomplete
+    size_t offset = alignOffset( sizeof( LabelFileHeader ) );
+    while( error.empty() && offset + sizeof( LabelFrameHeader ) <= _size )
+    {
+        const LabelFrameHeader& frame = *(const LabelFrameHeader*) ( _data + offset );
+        if( frame.encoding != LABELS_PACKED && frame.encoding != LABELS_RLE )
+            error = "has a frame of an unknown encoding";
+        else if( frame.size > _size - offset - sizeof( LabelFrameHeader ) )
+            break;
+        else
+        {
+            _frames.push_back( offset );
+            offset += alignOffset( sizeof( LabelFrameHeader ) + frame.size );
+        }
+    }
+
+    if( ! error.empty() )
+    {
+        munmap( _data, _size );
+        CV_Error( CV_StsError, "the label file " + filename + " " + error );
+    }
+}
+
+
+had::LabelReader::~LabelReader()
+{
+    munmap( _data, _size );
+}
+
+
+cv::Size had::LabelReader::getSize() const
+{
+    const LabelFileHeader& header = *(const LabelFileHeader*) _data;
+    return cv::Size( header.cols, header.rows );
+}
+
+
+int had::LabelReader::getEncoding( int id ) const
+{
+    CV_Assert( id >= 0 && id < (int) _frames.size() );
+    return ( (const LabelFrameHeader*) ( _data + _frames[ id ] ) )->encoding;
+}
+
+
+void had::LabelReader::read( int id, cv::Mat& out_classification ) const
+{
+    CV_Assert( id >= 0 && id < (int) _frames.size() );
+    const LabelFrameHeader& frame = *(const LabelFrameHeader*) ( _data + _frames[ id ] );
+    const unsigned char* data = _data + _frames[ id ] + sizeof( LabelFrameHeader );
+
+    cv::Size size = getSize();
+    size_t nb_labels = (size_t) size.width * size.height;
+    // The labels are decoded in raster order, across the rows
+    out_classification.create( size, CV_8UC1 );
+    if( ! out_classification.isContinuous() )
+        out_classification = cv::Mat( size, CV_8UC1 );
+    if( frame.encoding == LABELS_PACKED )
+    {
+        if( frame.size != ( nb_labels + 3 ) / 4 )
+            CV_Error( CV_StsError, "the label file has a packed frame of the wrong size" );
+        unpack( data, nb_labels, out_classification.data );
+    }
+    else if( ! decodeRuns( data, frame.size, nb_labels, out_classification.data ) )
+    {
+        CV_Error( CV_StsError, "the label file has an invalid frame" );
+    }
+}
@@ -0,0 +1,238 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_LABEL_FILE_HPP
+#define HAD_LABEL_FILE_HPP
+
+#include <fstream>
+#include <vector>
+using std::vector;
+#include <string>
+using std::string;
+
+#include <boost/cstdint.hpp>
+
+#include <cv.h>
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Encodings of the frames of a label file.
+*/
+/* ----------------------------------------------------------------------------*/
+enum LabelEncoding
+{
+    LABELS_AUTO   = 0,  //!< For a writer: the smallest of PACKED and RLE, frame by frame.
+    LABELS_PACKED = 1,  //!< Four labels per byte, two bits per label (see LabelWriter).
+    LABELS_RLE    = 2   //!< Runs of identical labels (see LabelWriter).
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Header at the beginning of a label file.
+*
+* The header is followed by the frames, one after the other, each one made of
+* a LabelFrameHeader and of its encoded labels, padded with zeros to a
+* multiple of 8 bytes. All the values are stored with the byte order of the
+* machine that wrote the file, which is checked with byte_order when reading.
+*/
+/* ----------------------------------------------------------------------------*/
+struct LabelFileHeader
+{
+    char            magic[ 8 ];     //!< "HADLBL", padded with zeros.
+    boost::uint32_t version;        //!< Version of the format.
+    boost::uint32_t byte_order;     //!< 0x01020304 in the byte order of the writer.
+    boost::uint32_t rows;           //!< Number of rows of the frames.
+    boost::uint32_t cols;           //!< Number of columns of the frames.
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Header of a frame of a label file.
+*/
+/* ----------------------------------------------------------------------------*/
+struct LabelFrameHeader
+{
+    boost::uint32_t encoding;   //!< Encoding of the labels (LABELS_PACKED or LABELS_RLE).
+    boost::uint32_t size;       //!< Size of the encoded labels in bytes, without the padding.
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Writer of the classifications of a stream of frames into a label
+* file, which is lossless and much smaller than images.
+*
+* The labels of a frame are encoded in raster order (row after row), in one
+* of two ways:
+* - PACKED: the labels 1 to 4 (see LCM::BACKGROUND) are stored as two bits
+*   each, label - 1, four labels per byte, the first one in the lowest bits.
+*   A frame takes a quarter of the size of a classification, whatever its
+*   content.
+* - RLE: each run of identical labels is stored as the label (one byte)
+*   followed by the length of the run minus one, as an unsigned LEB128 number
+*   (7 bits per byte, lowest bits first). A frame takes two bytes per run, so
+*   large uniform regions cost almost nothing.
+* The frames whose labels are not all between 1 and 4, like the ones
+* classified with a region of interest and a label 0 outside, are always
+* stored as RLE.
+*/
+/* ----------------------------------------------------------------------------*/
+class LabelWriter
+{
+private:
+    std::ofstream         _file;            //!< Label file.
+    string                _filename;        //!< Name of the label file.
+    cv::Size              _size;            //!< Size of the frames.
+    int                   _encoding;        //!< Encoding of the frames (see LabelEncoding).
+    int                   _nb_frames;       //!< Number of frames written.
+    boost::uint64_t       _nb_bytes;        //!< Size of the file written so far.
+    vector<unsigned char> _packed;          //!< Buffer of the packed labels of a frame.
+    vector<unsigned char> _runs;            //!< Buffer of the runs of a frame.
+
+    LabelWriter( const LabelWriter& );
+    LabelWriter& operator=( const LabelWriter& );
+
+public:
+    static const boost::uint32_t VERSION = 1;   //!< Version of the format written.
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor. Create the label file, throwing a cv::Exception on
+    * errors.
+    *
+    * @param filename Name of the label file.
+    * @param size Size of the frames.
+    * @param encoding Encoding of the frames (see LabelEncoding).
+    */
+    /* ----------------------------------------------------------------------------*/
+    LabelWriter( const string& filename,
+                 cv::Size      size,
+                 int           encoding = LABELS_AUTO );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Encode the classification of a frame, and append it to the file,
+    * throwing a cv::Exception on errors.
+    *
+    * @param classification Classification (8-bit 1-channel image, CV_8UC1),
+    * of the size of the file.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void write( const cv::Mat& classification );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Write the frames buffered so far to the file, so that a reader
+    * opened afterwards sees them.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void flush();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of frames written.
+    */
+    /* ----------------------------------------------------------------------------*/
+    int getNbFrames() const { return _nb_frames; }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the size of the file written so far, in bytes.
+    */
+    /* ----------------------------------------------------------------------------*/
+    boost::uint64_t getNbBytes() const { return _nb_bytes; }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Pack labels between 1 and 4 into two bits each (see the
+    * description of the class).
+    *
+    * @return False if a label is not between 1 and 4, true otherwise.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static bool pack( const unsigned char* labels, size_t nb_labels, unsigned char* out_packed );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Encode labels as runs (see the description of the class),
+    * appended to out_runs.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static void encodeRuns( const unsigned char* labels, size_t nb_labels, vector<unsigned char>& out_runs );
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Reader of a label file mapped in memory, which decodes any frame
+* without reading the others.
+*
+* The frames are indexed when the file is opened, by following their headers,
+* which only touches one page per frame. The frames written after the
+* opening are not seen, and an incomplete last frame, still being written, is
+* ignored.
+*/
+/* ----------------------------------------------------------------------------*/
+class LabelReader
+{
+private:
+    unsigned char*  _data;      //!< Beginning of the mapping.
+    size_t          _size;      //!< Size of the mapping.
+    vector<size_t>  _frames;    //!< Offset of the header of each frame.
+
+    LabelReader( const LabelReader& );
+    LabelReader& operator=( const LabelReader& );
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor. Map a label file in memory and index its frames,
+    * throwing a cv::Exception if the file is invalid.
+    *
+    * @param filename Name of the label file.
+    */
+    /* ----------------------------------------------------------------------------*/
+    explicit LabelReader( const string& filename );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Destructor. Unmap the file.
+    */
+    /* ----------------------------------------------------------------------------*/
+    ~LabelReader();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of frames of the file.
+    */
+    /* ----------------------------------------------------------------------------*/
+    int getNbFrames() const { return _frames.size(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the size of the frames.
+    */
+    /* ----------------------------------------------------------------------------*/
+    cv::Size getSize() const;
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the encoding of a frame (LABELS_PACKED or LABELS_RLE).
+    */
+    /* ----------------------------------------------------------------------------*/
+    int getEncoding( int id ) const;
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Decode a frame, throwing a cv::Exception if it is invalid.
+    *
+    * @param id Index of the frame, from 0 to getNbFrames() - 1.
+    * @param out_classification Classification of the frame (8-bit 1-channel
+    * image, CV_8UC1).
+    */
+    /* ----------------------------------------------------------------------------*/
+    void read( int id, cv::Mat& out_classification ) const;
+};
+
+}
+
+#endif // HAD_LABEL_FILE_HPP
@@ -0,0 +1,167 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ModelFile.hpp"
+
+namespace {
+
+const char MAGIC[ 8 ] = { 'H', 'A', 'D', 'L', 'C', 'M', 0, 0 };
+const boost::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+size_t alignOffset( size_t offset )
+{
+    return ( offset + had::ModelFile::ALIGNMENT - 1 ) / had::ModelFile::ALIGNMENT * had::ModelFile::ALIGNMENT;
+}
+
+// Size of a value of a block, 0 if the type is not supported
+size_t depthSize( boost::uint32_t depth )
+{
+    switch( depth )
+    {
+        case CV_32F: return sizeof( float );
+        case CV_16U: return sizeof( boost::uint16_t );
+        case CV_8U:  return sizeof( boost::uint8_t );
+        default:     return 0;
+    }
+}
+
+}
+
+const boost::uint32_t had::ModelFile::VERSION;
+const size_t had::ModelFile::ALIGNMENT;
+
+
+had::ModelFile::ModelFile( const string& filename )
+: _data( NULL ), _size( 0 )
+{
+    int fd = open( filename.c_str(), O_RDONLY );
+    if( fd < 0 )
+        CV_Error( CV_StsError, "cannot open the model file " + filename );
+
+    struct stat status;
+    if( fstat( fd, &status ) != 0 || (size_t) status.st_size < sizeof( ModelFileHeader ) )
+    {
+        close( fd );
+        CV_Error( CV_StsError, "the model file " + filename + " is truncated" );
+    }
+    _size = status.st_size;
+
+    // The mapping stays valid after the file descriptor is closed
+    void* data = mmap( NULL, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if( data == MAP_FAILED )
+        CV_Error( CV_StsError, "cannot map the model file " + filename );
+    _data = (unsigned char*) data;
+
+    const ModelFileHeader& header = getHeader();
+    string error;
+    if( memcmp( header.magic, MAGIC, sizeof( MAGIC ) ) != 0 )
+        error = "is not a model file";
+    else if( header.byte_order != BYTE_ORDER_MARK )
+        error = "was written on a machine with a different byte order";
+    else if( header.version != VERSION )
+        error = "has an unsupported version";
+    else if( sizeof( ModelFileHeader ) + (size_t) header.nb_blocks * sizeof( ModelFileBlock ) > _size )
+        error = "is truncated";
+
+    const ModelFileBlock* blocks = (const ModelFileBlock*) ( _data + sizeof( ModelFileHeader ) );
+    for( boost::uint32_t id = 0; error.empty() && id < header.nb_blocks; ++id )
+    {
+        boost::uint64_t size = (boost::uint64_t) blocks[ id ].rows * blocks[ id ].cols * blocks[ id ].channels * depthSize( blocks[ id ].depth );
+        if( depthSize( blocks[ id ].depth ) == 0 )
+            error = "has a block of an unsupported type";
+        else if( blocks[ id ].offset % ALIGNMENT != 0 )
+            error = "has a misaligned block";
+        else if( blocks[ id ].offset > _size || size > _size - blocks[ id ].offset )
+            error = "is truncated";
+    }
+
+    if( ! error.empty() )
+    {
+        munmap( _data, _size );
+        CV_Error( CV_StsError, "the model file " + filename + " " + error );
+    }
+}
+
+
+had::ModelFile::~ModelFile()
+{
+    munmap( _data, _size );
+}
+
+
+const had::ModelFileHeader& had::ModelFile::getHeader() const
+{
+    return *(const ModelFileHeader*) _data;
+}
+
+
+cv::Mat had::ModelFile::getBlock( int id, int channels, cv::Size size, int depth ) const
+{
+    const ModelFileHeader& header = getHeader();
+    const ModelFileBlock* blocks = (const ModelFileBlock*) ( _data + sizeof( ModelFileHeader ) );
+    if(    id < 0 || id >= (int) header.nb_blocks
+        || (int) blocks[ id ].depth != depth
+        || (int) blocks[ id ].channels != channels
+        || (int) blocks[ id ].rows != size.height
+        || (int) blocks[ id ].cols != size.width )
+        CV_Error( CV_StsBadArg, "the model file does not have the expected blocks" );
+
+    return cv::Mat( size, CV_MAKETYPE( depth, channels ), _data + blocks[ id ].offset );
+}
+
+
+void had::ModelFile::write( const string&          filename,
+                                  ModelFileHeader  header,
+                            const vector<cv::Mat>& blocks )
+{
+    CV_Assert( ! blocks.empty() );
+
+    memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+    header.version    = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.rows       = blocks[ 0 ].rows;
+    header.cols       = blocks[ 0 ].cols;
+    header.nb_blocks  = blocks.size();
+
+    // Place the blocks after the table, each one on an aligned offset
+    vector<ModelFileBlock> table( blocks.size() );
+    size_t offset = alignOffset( sizeof( ModelFileHeader ) + blocks.size() * sizeof( ModelFileBlock ) );
+    for( unsigned int id = 0; id < blocks.size(); ++id )
+    {
+        CV_Assert( depthSize( blocks[ id ].depth() ) != 0 );
+        table[ id ].rows     = blocks[ id ].rows;
+        table[ id ].cols     = blocks[ id ].cols;
+        table[ id ].channels = blocks[ id ].channels();
+        table[ id ].depth    = blocks[ id ].depth();
+        table[ id ].offset   = offset;
+        offset = alignOffset( offset + blocks[ id ].rows * blocks[ id ].cols * blocks[ id ].elemSize() );
+    }
+
+    std::ofstream file( filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+    if( ! file )
+        CV_Error( CV_StsError, "cannot create the model file " + filename );
+
+    const char padding[ ALIGNMENT ] = { 0 };
+    file.write( (const char*) &header, sizeof( ModelFileHeader ) );
+    file.write( (const char*) &table[ 0 ], table.size() * sizeof( ModelFileBlock ) );
+    size_t position = sizeof( ModelFileHeader ) + table.size() * sizeof( ModelFileBlock );
+    for( unsigned int id = 0; id < blocks.size(); ++id )
+    {
+        file.write( padding, table[ id ].offset - position );
+        size_t row_size = blocks[ id ].cols * blocks[ id ].elemSize();
+        for( int y = 0; y < blocks[ id ].rows; ++y )
+            file.write( (const char*) blocks[ id ].ptr( y ), row_size );
+        position = table[ id ].offset + blocks[ id ].rows * row_size;
+    }
+
+    if( ! file )
+        CV_Error( CV_StsError, "cannot write the model file " + filename );
+}
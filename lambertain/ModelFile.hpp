@@ -0,0 +1,215 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_MODEL_FILE_HPP
+#define HAD_MODEL_FILE_HPP
+
+#include <vector>
+using std::vector;
+#include <string>
+using std::string;
+
+#include <boost/cstdint.hpp>
+
+#include <cv.h>
+
+#include "DistortionKernels.hpp"
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Kinds of models that can be stored in a model file.
+*/
+/* ----------------------------------------------------------------------------*/
+enum ModelType
+{
+    MODEL_SINGLE          = 1,  //!< SingleLCM, whose blocks hold a single pixel.
+    MODEL_MULTIPLE        = 2,  //!< MultipleLCM, whose blocks hold one value per pixel.
+    MODEL_GLOBAL_VARIANCE = 3,  //!< GlobalVarianceLCM (see GlobalVarianceBlock).
+    MODEL_QUANTIZED       = 4   //!< QuantizedLCM (see QuantizedBlock).
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Blocks of the model file of a SingleLCM or a MultipleLCM, in the
+* order in which they are stored.
+*
+* MEAN, STDDEV and BRIGHTNESS have three channels (B, G and R), all the other
+* blocks have a single channel.
+*/
+/* ----------------------------------------------------------------------------*/
+enum ModelBlock
+{
+    BLOCK_MEAN            = 0,
+    BLOCK_STDDEV          = 1,
+    BLOCK_BRIGHTNESS      = 2,
+    BLOCK_BDIST_VARIATION = 3,
+    BLOCK_CDIST_VARIATION = 4,
+    BLOCK_COEFFICIENTS    = 5,  //!< First of the NB_COEFFICIENTS planes (see DistortionCoefficient).
+    NB_MODEL_BLOCKS       = BLOCK_COEFFICIENTS + NB_COEFFICIENTS
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Blocks of the model file of a GlobalVarianceLCM, in the order in which
+* they are stored.
+*
+* MEAN and INV_DENOMINATOR hold one value per pixel, MEAN being made of three
+* consecutive planes (B, G and R). The other blocks hold a single value, with
+* three channels for STDDEV.
+*/
+/* ----------------------------------------------------------------------------*/
+enum GlobalVarianceBlock
+{
+    GV_BLOCK_MEAN            = 0,
+    GV_BLOCK_INV_DENOMINATOR = 3,
+    GV_BLOCK_STDDEV          = 4,
+    GV_BLOCK_BDIST_VARIATION = 5,
+    GV_BLOCK_CDIST_VARIATION = 6,
+    NB_GV_BLOCKS             = 7
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Blocks of the model file of a QuantizedLCM, in the order in which they
+* are stored.
+*
+* VALUES are the NB_QUANTIZED_VALUES planes of 16-bit unsigned fixed-point
+* values (see QuantizedValue), and EXPONENTS the NB_QUANTIZED_EXPONENTS 8-bit
+* planes of per-pixel numbers of fractional bits (see QuantizedExponent).
+*/
+/* ----------------------------------------------------------------------------*/
+enum QuantizedBlock
+{
+    Q_BLOCK_VALUES    = 0,
+    Q_BLOCK_EXPONENTS = Q_BLOCK_VALUES + NB_QUANTIZED_VALUES,
+    NB_Q_BLOCKS       = Q_BLOCK_EXPONENTS + NB_QUANTIZED_EXPONENTS
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Header at the beginning of a model file.
+*
+* The header is followed by a table of nb_blocks ModelFileBlock, and then by
+* the blocks themselves. Each block is a matrix of 32-bit floats, or of 16-bit
+* or 8-bit unsigned integers, with one or more interleaved channels, stored
+* row after row without padding. The blocks
+* of per-pixel values have the size of the model, the others a single pixel.
+* The blocks start on 64-byte boundaries, so that they can be used in place
+* once the file is mapped in memory.
+*
+* All the values are stored with the byte order of the machine that wrote the
+* file, which is checked with byte_order when loading.
+*/
+/* ----------------------------------------------------------------------------*/
+struct ModelFileHeader
+{
+    char            magic[ 8 ];                 //!< "HADLCM", padded with zeros.
+    boost::uint32_t version;                    //!< Version of the format.
+    boost::uint32_t byte_order;                 //!< 0x01020304 in the byte order of the writer.
+    boost::uint32_t type;                       //!< Kind of model (see ModelType).
+    boost::uint32_t rows;                       //!< Number of rows of the model.
+    boost::uint32_t cols;                       //!< Number of columns of the model.
+    boost::uint32_t nb_blocks;                  //!< Number of blocks.
+    float           detection_rate;             //!< Detection rate of the model.
+    float           threshold_cdist_squared;    //!< Squared chromaticity distortion threshold.
+    float           threshold_bdist_left;       //!< Left brightness distortion threshold.
+    float           threshold_bdist_right;      //!< Right brightness distortion threshold.
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Entry of the block table of a model file.
+*/
+/* ----------------------------------------------------------------------------*/
+struct ModelFileBlock
+{
+    boost::uint32_t rows;       //!< Number of rows.
+    boost::uint32_t cols;       //!< Number of columns.
+    boost::uint32_t channels;   //!< Number of interleaved channels.
+    boost::uint32_t depth;      //!< Type of the values: CV_32F, CV_16U or CV_8U.
+    boost::uint64_t offset;     //!< Offset of the block from the beginning of the file.
+};
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Model file mapped in memory.
+*
+* The file is mapped privately: the pages are shared with all the processes
+* that map the same file until they are written to, in which case they are
+* copied. Several processes can then use one physical copy of a large model,
+* while each one of them can still update its own model.
+*/
+/* ----------------------------------------------------------------------------*/
+class ModelFile
+{
+private:
+    unsigned char* _data;   //!< Beginning of the mapping.
+    size_t         _size;   //!< Size of the mapping.
+
+    ModelFile( const ModelFile& );
+    ModelFile& operator=( const ModelFile& );
+
+public:
+    static const boost::uint32_t VERSION = 4;   //!< Version of the format written by write().
+    static const size_t ALIGNMENT = 64;         //!< Alignment of the blocks in the file.
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor. Map a model file in memory and check its header and
+    * block table, throwing a cv::Exception if the file is invalid.
+    *
+    * @param filename Name of the model file.
+    */
+    /* ----------------------------------------------------------------------------*/
+    explicit ModelFile( const string& filename );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Destructor. Unmap the file: the blocks can no longer be used.
+    */
+    /* ----------------------------------------------------------------------------*/
+    ~ModelFile();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the header of the file.
+    */
+    /* ----------------------------------------------------------------------------*/
+    const ModelFileHeader& getHeader() const;
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get a block of the file, without copying it.
+    *
+    * @param id Index of the block.
+    * @param channels Expected number of channels of the block.
+    * @param size Expected size of the block.
+    * @param depth Expected type of the values of the block.
+    *
+    * @return Matrix (of the given depth and number of channels) whose data is
+    * in the mapping, and remains valid as long as this object exists.
+    */
+    /* ----------------------------------------------------------------------------*/
+    cv::Mat getBlock( int id, int channels, cv::Size size, int depth = CV_32F ) const;
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Write a model file, throwing a cv::Exception on errors.
+    *
+    * @param filename Name of the model file.
+    * @param header Header of the file. The magic, version, byte order, size and
+    * number of blocks are filled in by this function, the size of the model
+    * being the size of the first block.
+    * @param blocks Blocks of the model (32-bit float, 16-bit or 8-bit unsigned
+    * matrices with any number of channels).
+    */
+    /* ----------------------------------------------------------------------------*/
+    static void write( const string&          filename,
+                             ModelFileHeader  header,
+                       const vector<cv::Mat>& blocks );
+};
+
+}
+
+#endif // HAD_MODEL_FILE_HPP
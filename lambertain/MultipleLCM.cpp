@@ -1,168 +1,415 @@
 // (c)2010 - Emmanuel Goossaert
 // Under GNU License 3.0
+#include <boost/bind.hpp>
+
 #include "MultipleLCM.hpp"
 
-void had::MultipleLCM::computeModelMeanStdDev( const vector<cv::Mat>& images )
-                        
+void had::MultipleLCM::computeModel( const vector<cv::Mat>& images )
 {
-    // See Horprasert et al., 1999, Sections 4.1 and 7, and Eq. 4
-    
-    // Prepare matrices
-    _mean       = cv::Mat( images[ 0 ].size(), CV_32FC3, cv::Scalar::all( 0 ) );
-    _stddev     = cv::Mat( images[ 0 ].size(), CV_32FC3, cv::Scalar::all( 0 ) );
-    _brightness = cv::Mat( images[ 0 ].size(), CV_32FC3, cv::Scalar::all( 0 ) );
-    
-    cv::Mat pixels = cv::Mat( images.size(), 1, CV_8UC3, cv::Scalar::all( 0 ) );
-    cv::Scalar mean, stddev;
-
-    for( int y = 0; y < images[ 0 ].rows; ++y )
-    {
-        for( int x = 0; x < images[ 0 ].cols; ++x )
-        {
-            // Prepare the pixels from the different images
-            for( unsigned int id_image = 0; id_image < images.size(); ++id_image )
-            {
-                pixels.at<cv::Vec3b>( id_image, 0 ) = images[ id_image ].at<cv::Vec3b>( y, x );
-            }
- 
-            cv::meanStdDev( pixels, mean, stddev );
-            for( int id = 0; id < 3; ++id )
-                if( stddev[ id ] == 0 ) stddev[ id ] = 1;
+    // The frames are only needed for the running sums, which are released
+    // once the model is computed
+    _statistics.add( images, _pool );
+    computeModel();
+    _statistics.clear();
 
-            float denom = computeBrightnessDenominator( mean, stddev );
-            for( int id = 0; id < 3; ++id )
-            {
-                _brightness.at<cv::Vec3f>( y, x )[ id ] = mean[ id ] / ( denom * stddev[ id ] * stddev[ id ] );
-                _mean.at<cv::Vec3f>( y, x )[ id ] = mean[ id ];
-                _stddev.at<cv::Vec3f>( y, x )[ id ] = stddev[ id ];
-            }
-        }
-    }
+    // See Horprasert et al., 1999, Section 4.3
+    selectThresholds( images );
 }
 
 
-void had::MultipleLCM::computeModel( const vector<cv::Mat>& images )
+void had::MultipleLCM::computeModel()
 {
     // See Horprasert et al., 1999, Section 4.1
-    computeModelMeanStdDev( images );
-    computeVariations( images );
+    HAD_STATS_LOCAL( stats );
+    HAD_STAGE_CLOCK( stats );
+    cv::Size size = _statistics.getSize();
+    _mean            = cv::Mat( size, CV_32FC3 );
+    _stddev          = cv::Mat( size, CV_32FC3 );
+    _brightness      = cv::Mat( size, CV_32FC3 );
+    _bdist_variation = cv::Mat( size, CV_32F );
+    _cdist_variation = cv::Mat( size, CV_32F );
+
+    parallelRows( 0,
+                  _mean.rows,
+                  boost::bind( &MultipleLCM::finalizeRows, this, _1, _2 ) );
+    computeCoefficients();
+    HAD_STAGE_SPLIT( STAGE_TRAINING );
+    HAD_COUNT( stats, COUNTER_TRAINING_FRAMES, _statistics.getNbFrames() );
+    HAD_STATS_MERGE( stats );
+}
+
+
+void had::MultipleLCM::computeCoefficients()
+{
+    // See Horprasert et al., 1999, Section 7
+    _coefficients.resize( NB_COEFFICIENTS );
+    for( int id = 0; id < NB_COEFFICIENTS; ++id )
+        _coefficients[ id ] = cv::Mat( _mean.size(), CV_32F );
+
+    parallelRows( 0,
+                  _mean.rows,
+                  boost::bind( &MultipleLCM::computeCoefficientsRows, this, _1, _2 ) );
+}
 
-    cv::Mat bdist_norm, cdist_norm;
-    computeNormalizedDistortions( images, bdist_norm, cdist_norm );
 
-    selectThresholds( _detection_rate,
-                      bdist_norm,
-                      cdist_norm,
-                      &_threshold_cdist,
-                      &_threshold_bdist_left,
-                      &_threshold_bdist_right
-                    );
+void had::MultipleLCM::computeCoefficientsRows( int y_begin, int y_end )
+{
+    for( int y = y_begin; y < y_end; ++y )
+        for( int x = 0; x < _mean.cols; ++x )
+            computeCoefficientsPixel( y, x );
 }
 
 
-float had::MultipleLCM::computeBrightnessDistortion( const cv::Mat& image,
-                                                              int y,
-                                                              int x )
+void had::MultipleLCM::computeCoefficientsPixel( int y, int x )
 {
-    cv::Scalar brightness( _brightness.at<cv::Vec3f>( y, x )[ 0 ],
-                           _brightness.at<cv::Vec3f>( y, x )[ 1 ],
-                           _brightness.at<cv::Vec3f>( y, x )[ 2 ] );
-    return LCM::computeBrightnessDistortion( image.at<cv::Vec3b>( y, x ),
-                                             brightness );
+    // Like the standard deviation, a null variation is replaced by 1
+    // to avoid a division by zero.
+    float bdist_variation = _bdist_variation.at<float>( y, x );
+    float cdist_variation = _cdist_variation.at<float>( y, x );
+    if( bdist_variation == 0 ) bdist_variation = 1;
+    if( cdist_variation == 0 ) cdist_variation = 1;
+
+    for( int id = 0; id < 3; ++id )
+    {
+        float scale = 1.0f / ( _stddev.at<cv::Vec3f>( y, x )[ id ] * cdist_variation );
+        _coefficients[ COEF_BRIGHTNESS + id ].at<float>( y, x ) = _brightness.at<cv::Vec3f>( y, x )[ id ];
+        _coefficients[ COEF_SCALE + id ].at<float>( y, x ) = scale;
+        _coefficients[ COEF_MEAN_SCALED + id ].at<float>( y, x ) = _mean.at<cv::Vec3f>( y, x )[ id ] * scale;
+    }
+    _coefficients[ COEF_INV_BDIST_VARIATION ].at<float>( y, x ) = 1.0f / bdist_variation;
 }
 
 
-float had::MultipleLCM::computeChromacityDistortion( const cv::Mat& image,
-                                                              int y,
-                                                              int x,
-                                                              float bdist )
+void had::MultipleLCM::setUpdateRate( float rate, bool update_shadow_highlight )
 {
-    cv::Scalar mean( _mean.at<cv::Vec3f>( y, x )[ 0 ],
-                     _mean.at<cv::Vec3f>( y, x )[ 1 ],
-                     _mean.at<cv::Vec3f>( y, x )[ 2 ] );
-    cv::Scalar stddev( _stddev.at<cv::Vec3f>( y, x )[ 0 ],
-                       _stddev.at<cv::Vec3f>( y, x )[ 1 ],
-                       _stddev.at<cv::Vec3f>( y, x )[ 2 ] );
-    return LCM::computeChromacityDistortion( image.at<cv::Vec3b>( y, x ),
-                                             mean,
-                                             stddev,
-                                             bdist );
+    CV_Assert( rate >= 0 && rate <= 1 );
+    _update_rate = rate;
+    _update_shadow_highlight = update_shadow_highlight;
 }
 
 
-void had::MultipleLCM::computeVariations( const vector<cv::Mat>& images )
+void had::MultipleLCM::updateModelRow( const cv::Mat&       image,
+                                             int            y,
+                                             int            x_begin,
+                                             int            x_end,
+                                       const float*         bdist_norm,
+                                       const float*         cdist_norm_squared,
+                                       const unsigned char* labels )
 {
-    // See Horprasert et al., 1999, Section 4.1
+    if( _update_rate == 0 )
+        return;
 
-    _bdist_variation = cv::Mat( images[ 0 ].size(), CV_32F, cv::Scalar::all( 0 ) );
-    _cdist_variation = cv::Mat( images[ 0 ].size(), CV_32F, cv::Scalar::all( 0 ) );
-    int nb_pixels = images.size();
+    float rate = _update_rate;
+    float keep = 1 - _update_rate;
+    const unsigned char* row_image = image.ptr<unsigned char>( y );
+    cv::Vec3f* row_mean   = _mean.ptr<cv::Vec3f>( y );
+    cv::Vec3f* row_stddev = _stddev.ptr<cv::Vec3f>( y );
+    cv::Vec3f* row_brightness = _brightness.ptr<cv::Vec3f>( y );
+    float* row_bdist_variation = _bdist_variation.ptr<float>( y );
+    float* row_cdist_variation = _cdist_variation.ptr<float>( y );
 
-    for( int y = 0; y < images[ 0 ].rows; ++y )
+    for( int x = x_begin; x < x_end; ++x )
     {
-        for( int x = 0; x < images[ 0 ].cols; ++x )
+        unsigned char label = labels[ x ];
+        if( label != BACKGROUND && ! ( _update_shadow_highlight && ( label == SHADOW || label == HIGHLIGHT ) ) )
+            continue;
+
+        // The squared variations are running averages of the squared
+        // distortions, see Horprasert et al., 1999, Eqs. 7 and 8. The
+        // distortions of the pixel are the normalized ones computed by
+        // classify(), multiplied back by the variations they were divided by.
+        float bdist_variation = row_bdist_variation[ x ] != 0 ? row_bdist_variation[ x ] : 1;
+        float cdist_variation = row_cdist_variation[ x ] != 0 ? row_cdist_variation[ x ] : 1;
+        row_bdist_variation[ x ] = bdist_variation * sqrt( keep + rate * bdist_norm[ x ] * bdist_norm[ x ] );
+        row_cdist_variation[ x ] = cdist_variation * sqrt( keep + rate * cdist_norm_squared[ x ] );
+
+        // Running mean and variance of each channel, see Horprasert et al.,
+        // 1999, Eq. 4
+        cv::Scalar mean, stddev;
+        for( int id = 0; id < 3; ++id )
         {
-            // The variations are computed for each pixel position
-            // and accross all training images
-            float bdist_sum = 0;
-            float cdist_sum = 0;
+            float difference = row_image[ 3 * x + id ] - row_mean[ x ][ id ];
+            float variance = keep * row_stddev[ x ][ id ] * row_stddev[ x ][ id ] + rate * difference * difference;
+            mean[ id ] = row_mean[ x ][ id ] + rate * difference;
+            stddev[ id ] = variance > 0 ? sqrt( variance ) : 1;
+        }
 
-            for( unsigned int id_image = 0; id_image < images.size(); ++id_image )
-            {
-                float bdist_current = computeBrightnessDistortion( images[ id_image ],
-                                                                   y,
-                                                                   x );
+        float denom = computeBrightnessDenominator( mean, stddev );
+        for( int id = 0; id < 3; ++id )
+        {
+            row_brightness[ x ][ id ] = mean[ id ] / ( denom * stddev[ id ] * stddev[ id ] );
+            row_mean[ x ][ id ] = mean[ id ];
+            row_stddev[ x ][ id ] = stddev[ id ];
+        }
 
-                float cdist_current = computeChromacityDistortion( images[ id_image ],
-                                                                   y,
-                                                                   x,
-                                                                   bdist_current );
+        computeCoefficientsPixel( y, x );
+    }
+}
 
-                bdist_sum += ( bdist_current - 1 ) * ( bdist_current - 1 );
-                cdist_sum += cdist_current * cdist_current;
-            }
 
-            // See Horprasert et al., 1999, Eqs. 7 and 8
-            _bdist_variation.at<float>( y, x ) = sqrt( bdist_sum / (float) nb_pixels );
-            _cdist_variation.at<float>( y, x ) = sqrt( cdist_sum / (float) nb_pixels );
+void had::MultipleLCM::setKernelISA( KernelISA isa )
+{
+    KernelISA supported = detectKernelISA();
+    _kernel_isa = isa > supported ? supported : isa;
+    _kernel = getDistortionKernel( _kernel_isa );
+}
+
+
+void had::MultipleLCM::classifyRows( const ClassificationBatch& batch,
+                                           int                  y_begin,
+                                           int                  y_end )
+{
+    classifyRowsOf<MultipleLCM>( batch, y_begin, y_end );
+}
+
+
+void had::MultipleLCM::computeNormalizedDistortionsRow( const cv::Mat& image,
+                                                              int      y,
+                                                              int      x_begin,
+                                                              int      x_end,
+                                                              float*   out_bdist_norm,
+                                                              float*   out_cdist_norm_squared )
+{
+    // See Horprasert et al., 1999, Eqs. 9 and 10
+    // The row is processed in runs short enough for the de-interleaved
+    // pixels to stay in the L1 cache.
+    const int size_run = 256;
+    float pixels[ 3 ][ size_run ];
+
+    const unsigned char* row_image = image.ptr<unsigned char>( y );
+    DistortionRow row;
+    for( int x_start = x_begin; x_start < x_end; x_start += size_run )
+    {
+        row.nb_pixels = std::min( size_run, x_end - x_start );
+        for( int x = 0; x < row.nb_pixels; ++x )
+        {
+            const unsigned char* pixel = row_image + 3 * ( x_start + x );
+            pixels[ 0 ][ x ] = pixel[ 0 ];
+            pixels[ 1 ][ x ] = pixel[ 1 ];
+            pixels[ 2 ][ x ] = pixel[ 2 ];
         }
+
+        for( int id = 0; id < 3; ++id )
+            row.pixel[ id ] = pixels[ id ];
+        for( int id = 0; id < NB_COEFFICIENTS; ++id )
+            row.coefficients[ id ] = _coefficients[ id ].ptr<float>( y ) + x_start;
+        row.out_bdist_norm         = out_bdist_norm + x_start;
+        row.out_cdist_norm_squared = out_cdist_norm_squared + x_start;
+
+        _kernel( row );
     }
 }
 
 
 void had::MultipleLCM::computeNormalizedDistortions( const cv::Mat& image,
                                                            cv::Mat& out_bdist_norm,
-                                                           cv::Mat& out_cdist_norm )
+                                                           cv::Mat& out_cdist_norm_squared )
 {
-    vector<cv::Mat> images;
-    images.push_back( image );
-    computeNormalizedDistortions( images, out_bdist_norm, out_cdist_norm );
+    // See Horprasert et al., 1999, Eqs. 9 and 10
+    out_bdist_norm.create( image.size(), CV_32F );
+    out_cdist_norm_squared.create( image.size(), CV_32F );
+    parallelRows( 0,
+                  image.rows,
+                  boost::bind( &MultipleLCM::computeNormalizedDistortionsRows,
+                               this,
+                               boost::cref( image ),
+                               boost::ref( out_bdist_norm ),
+                               boost::ref( out_cdist_norm_squared ),
+                               _1,
+                               _2 ) );
 }
 
 
-
 void had::MultipleLCM::computeNormalizedDistortions( const vector<cv::Mat>& images,
                                                            cv::Mat& out_bdist_norm,
-                                                           cv::Mat& out_cdist_norm )
+                                                           cv::Mat& out_cdist_norm_squared )
 {
     // See Horprasert et al., 1999, Eqs. 9 and 10
     int cols = images[ 0 ].cols;
     int rows = images[ 0 ].rows;
-    out_bdist_norm = cv::Mat( rows, cols * images.size(), CV_32F, cv::Scalar::all( 0 ) );
-    out_cdist_norm = cv::Mat( rows, cols * images.size(), CV_32F, cv::Scalar::all( 0 ) );
+    out_bdist_norm.create( rows, cols * images.size(), CV_32F );
+    out_cdist_norm_squared.create( rows, cols * images.size(), CV_32F );
     for( unsigned int id_image = 0; id_image < images.size(); ++id_image )
     {
         cv::Mat bdist_image = out_bdist_norm.colRange( id_image * cols, ( id_image + 1 ) * cols );
-        cv::Mat cdist_image = out_cdist_norm.colRange( id_image * cols, ( id_image + 1 ) * cols );
-        for( int y = 0; y < rows; ++y )
+        cv::Mat cdist_image = out_cdist_norm_squared.colRange( id_image * cols, ( id_image + 1 ) * cols );
+        parallelRows( 0,
+                      rows,
+                      boost::bind( &MultipleLCM::computeNormalizedDistortionsRows,
+                                   this,
+                                   boost::cref( images[ id_image ] ),
+                                   boost::ref( bdist_image ),
+                                   boost::ref( cdist_image ),
+                                   _1,
+                                   _2 ) );
+    }
+}
+
+
+void had::MultipleLCM::addFrame( const cv::Mat& image )
+{
+    _statistics.add( image, _pool );
+}
+
+
+void had::MultipleLCM::finalizeRows( int y_begin, int y_end )
+{
+    double nb_frames = _statistics.getNbFrames();
+
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        for( int x = 0; x < _mean.cols; ++x )
+        {
+            double sum[ 3 ], cross[ 3 ][ 3 ];
+            _statistics.getPixelSums( y, x, sum, cross );
+
+            // See Horprasert et al., 1999, Eq. 4
+            cv::Scalar mean, stddev;
+            for( int id = 0; id < 3; ++id )
+            {
+                mean[ id ] = sum[ id ] / nb_frames;
+                double variance = cross[ id ][ id ] / nb_frames - mean[ id ] * mean[ id ];
+                stddev[ id ] = variance > 0 ? sqrt( variance ) : 1;
+            }
+
+            float denom = computeBrightnessDenominator( mean, stddev );
+            double brightness[ 3 ];
+            for( int id = 0; id < 3; ++id )
+            {
+                // The variations are computed with the brightness actually
+                // stored in the model
+                _brightness.at<cv::Vec3f>( y, x )[ id ] = mean[ id ] / ( denom * stddev[ id ] * stddev[ id ] );
+                _mean.at<cv::Vec3f>( y, x )[ id ] = mean[ id ];
+                _stddev.at<cv::Vec3f>( y, x )[ id ] = stddev[ id ];
+                brightness[ id ] = _brightness.at<cv::Vec3f>( y, x )[ id ];
+            }
+
+            double bdist_sum, cdist_sum;
+            FrameStatistics::computeDistortionSums( sum, cross, nb_frames, mean.val, stddev.val, brightness, &bdist_sum, &cdist_sum );
+
+            // See Horprasert et al., 1999, Eqs. 7 and 8
+            _bdist_variation.at<float>( y, x ) = sqrt( bdist_sum / nb_frames );
+            _cdist_variation.at<float>( y, x ) = sqrt( cdist_sum / nb_frames );
+        }
+    }
+}
+
+
+void had::MultipleLCM::finalize()
+{
+    if( _statistics.getNbFrames() == 0 )
+        CV_Error( CV_StsError, "no frame has been added to the model" );
+
+    computeModel();
+
+    // See Horprasert et al., 1999, Section 4.3
+    selectThresholds( _statistics.getSample() );
+}
+
+
+had::MultipleLCM::MultipleLCM( const boost::shared_ptr<ModelFile>& file,
+                               ThreadPool*                         pool )
+: LCM( file, pool ), _update_rate( 0 ), _update_shadow_highlight( false )
+{
+    if( file->getHeader().type != MODEL_MULTIPLE )
+        CV_Error( CV_StsBadArg, "the model file does not hold a MultipleLCM" );
+
+    setKernelISA( detectKernelISA() );
+
+    cv::Size size( file->getHeader().cols, file->getHeader().rows );
+    _mean            = file->getBlock( BLOCK_MEAN, 3, size );
+    _stddev          = file->getBlock( BLOCK_STDDEV, 3, size );
+    _brightness      = file->getBlock( BLOCK_BRIGHTNESS, 3, size );
+    _bdist_variation = file->getBlock( BLOCK_BDIST_VARIATION, 1, size );
+    _cdist_variation = file->getBlock( BLOCK_CDIST_VARIATION, 1, size );
+    _coefficients.resize( NB_COEFFICIENTS );
+    for( int id = 0; id < NB_COEFFICIENTS; ++id )
+        _coefficients[ id ] = file->getBlock( BLOCK_COEFFICIENTS + id, 1, size );
+}
+
+
+had::MultipleLCM::MultipleLCM( const MultipleLCM& model,
+                               int                factor,
+                               ThreadPool*        pool )
+: LCM( model._detection_rate, pool ), _update_rate( 0 ), _update_shadow_highlight( false )
+{
+    CV_Assert( ! model._coefficients.empty() && factor > 0 );
+    setKernelISA( detectKernelISA() );
+    _threshold_cdist_squared = model._threshold_cdist_squared;
+    _threshold_bdist_left    = model._threshold_bdist_left;
+    _threshold_bdist_right   = model._threshold_bdist_right;
+
+    cv::Size size( ( model._mean.cols + factor - 1 ) / factor, ( model._mean.rows + factor - 1 ) / factor );
+    _mean            = cv::Mat( size, CV_32FC3 );
+    _stddev          = cv::Mat( size, CV_32FC3 );
+    _brightness      = cv::Mat( size, CV_32FC3 );
+    _bdist_variation = cv::Mat( size, CV_32F );
+    _cdist_variation = cv::Mat( size, CV_32F );
+
+    parallelRows( 0,
+                  size.height,
+                  boost::bind( &MultipleLCM::reduceRows, this, boost::cref( model ), factor, _1, _2 ) );
+    computeCoefficients();
+}
+
+
+void had::MultipleLCM::reduceRows( const MultipleLCM& model,
+                                         int          factor,
+                                         int          y_begin,
+                                         int          y_end )
+{
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        int y_last = std::min( ( y + 1 ) * factor, model._mean.rows );
+        for( int x = 0; x < _mean.cols; ++x )
         {
-            for( int x = 0; x < cols; ++x )
+            int x_last = std::min( ( x + 1 ) * factor, model._mean.cols );
+            cv::Scalar mean, stddev;
+            double bdist_variation = 0, cdist_variation = 0;
+            for( int y_model = y * factor; y_model < y_last; ++y_model )
             {
-                float bdist_current = computeBrightnessDistortion( images[ id_image ], y, x );
-                float cdist_current = computeChromacityDistortion( images[ id_image ], y, x, bdist_current );
-                bdist_image.at<float>( y, x ) = (bdist_current - 1) / _bdist_variation.at<float>( y, x );
-                cdist_image.at<float>( y, x ) = cdist_current / _cdist_variation.at<float>( y, x );
+                for( int x_model = x * factor; x_model < x_last; ++x_model )
+                {
+                    for( int id = 0; id < 3; ++id )
+                    {
+                        mean[ id ] += model._mean.at<cv::Vec3f>( y_model, x_model )[ id ];
+                        stddev[ id ] += model._stddev.at<cv::Vec3f>( y_model, x_model )[ id ];
+                    }
+                    bdist_variation += model._bdist_variation.at<float>( y_model, x_model );
+                    cdist_variation += model._cdist_variation.at<float>( y_model, x_model );
+                }
             }
+
+            double nb_pixels = ( y_last - y * factor ) * ( x_last - x * factor );
+            for( int id = 0; id < 3; ++id )
+            {
+                mean[ id ] /= nb_pixels;
+                stddev[ id ] /= nb_pixels;
+            }
+
+            // See Horprasert et al., 1999, Eq. 4
+            float denom = computeBrightnessDenominator( mean, stddev );
+            for( int id = 0; id < 3; ++id )
+            {
+                _brightness.at<cv::Vec3f>( y, x )[ id ] = mean[ id ] / ( denom * stddev[ id ] * stddev[ id ] );
+                _mean.at<cv::Vec3f>( y, x )[ id ] = mean[ id ];
+                _stddev.at<cv::Vec3f>( y, x )[ id ] = stddev[ id ];
+            }
+            _bdist_variation.at<float>( y, x ) = bdist_variation / nb_pixels;
+            _cdist_variation.at<float>( y, x ) = cdist_variation / nb_pixels;
         }
     }
 }
+
+
+had::ModelType had::MultipleLCM::getModelBlocks( vector<cv::Mat>& out_blocks ) const
+{
+    out_blocks.clear();
+    out_blocks.push_back( _mean );
+    out_blocks.push_back( _stddev );
+    out_blocks.push_back( _brightness );
+    out_blocks.push_back( _bdist_variation );
+    out_blocks.push_back( _cdist_variation );
+    out_blocks.insert( out_blocks.end(), _coefficients.begin(), _coefficients.end() );
+    return MODEL_MULTIPLE;
+}
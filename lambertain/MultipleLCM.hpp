@@ -14,6 +14,8 @@ using std::string;
 #include <highgui.h>
 
 #include "LCM.hpp"
+#include "DistortionKernels.hpp"
+#include "FrameStatistics.hpp"
 
 namespace had {
 
@@ -26,6 +28,9 @@ namespace had {
 /* ----------------------------------------------------------------------------*/
 class MultipleLCM: public LCM
 {
+    friend class LCM;  // Calls the row functions without virtual dispatch, see LCM::classifyRowsOf().
+    friend class QuantizedLCM;  // Quantizes the coefficients and copies the thresholds.
+
 private:
 
     cv::Mat _mean;              //!< Mean of the background pixels in the model.
@@ -34,24 +39,25 @@ private:
     cv::Mat _bdist_variation;   //!< Brightness distortion variation
     cv::Mat _cdist_variation;   //!< Chromacity distortion variation
 
-    /* ----------------------------------------------------------------------------*/
-    /** 
-    * @brief Compute the mean and standard deviation of a set of images.
-    * 
-    * See Horprasert et al., 1999, Sections 4.1 and 7, and Eq. 4
-    *
-    * @param images Vector of input images (8-bit 3-channel images, CV_8UC3).
-    */
-    /* ----------------------------------------------------------------------------*/
-    void computeModelMeanStdDev( const vector<cv::Mat>& images );
+    vector<cv::Mat>  _coefficients;     //!< Planes of coefficients consumed by the distortion kernels (see DistortionCoefficient).
+    KernelISA        _kernel_isa;       //!< Instruction set of the distortion kernel.
+    DistortionKernel _kernel;           //!< Distortion kernel used by computeNormalizedDistortionsRow().
 
+    FrameStatistics  _statistics;           //!< Running sums of the training frames.
+
+    float            _update_rate;              //!< Learning rate of the update of the model by classify(), 0 if disabled.
+    bool             _update_shadow_highlight;  //!< If true, SHADOW and HIGHLIGHT pixels update the model too.
 
     /* ----------------------------------------------------------------------------*/
     /** 
     * @brief Compute the Lambertain Color Model based on a set of images. All the
     * pixels in each image are used as training background pixels.
     *
-    * See Horprasert et al., 1999, Section 4.1
+    * The images are added as a batch to the running sums (see
+    * FrameStatistics::add()), from which the model is computed, and the
+    * thresholds are selected on all the images.
+    *
+    * See Horprasert et al., 1999, Sections 4.1 and 4.3
     * 
     * @param images Vector of input images (8-bit 3-channel images, CV_8UC3).
     */
@@ -60,31 +66,86 @@ private:
 
     /* ----------------------------------------------------------------------------*/
     /** 
-    * @brief Compute the variations of the brightness and chromaticity distributions.
+    * @brief Compute the mean, standard deviation, brightness, variations and
+    * coefficients of the model from the running sums.
     *
     * See Horprasert et al., 1999, Section 4.1
-    * 
-    * @param images Vector of input images (8-bit 3-channel images, CV_8UC3).
     */
     /* ----------------------------------------------------------------------------*/
-    void computeVariations( const vector<cv::Mat>& images );
+    void computeModel();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Bake the coefficients used for classification from the mean, standard
+    * deviation, brightness and variations of the model.
+    *
+    * See Horprasert et al., 1999, Section 7
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computeCoefficients();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Bake the coefficients of a band of rows, see computeCoefficients().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computeCoefficientsRows( int y_begin, int y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Bake the coefficients of a single pixel, see computeCoefficients().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computeCoefficientsPixel( int y, int x );
 
-    virtual float computeBrightnessDistortion( const cv::Mat& image,
-                                       int y,
-                                       int x );
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Compute the mean, standard deviation, brightness and variations of
+    * a band of rows from the running sums, see computeModel().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void finalizeRows( int y_begin, int y_end );
 
-    virtual float computeChromacityDistortion( const cv::Mat& image,
-                                       int y,
-                                       int x,
-                                       float bdist );
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Reduce a band of rows of a model, see the reducing constructor.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void reduceRows( const MultipleLCM& model,
+                           int          factor,
+                           int          y_begin,
+                           int          y_end );
+
+    virtual ModelType getModelBlocks( vector<cv::Mat>& out_blocks ) const;
+
+    virtual int getModelPixelSize() const { return NB_COEFFICIENTS * sizeof( float ); }
+
+    virtual void classifyRows( const ClassificationBatch& batch,
+                                     int                  y_begin,
+                                     int                  y_end );
+
+    virtual void computeNormalizedDistortionsRow( const cv::Mat& image,
+                                                        int      y,
+                                                        int      x_begin,
+                                                        int      x_end,
+                                                        float*   out_bdist_norm,
+                                                        float*   out_cdist_norm_squared );
+
+    virtual void updateModelRow( const cv::Mat&       image,
+                                       int            y,
+                                       int            x_begin,
+                                       int            x_end,
+                                 const float*         bdist_norm,
+                                 const float*         cdist_norm_squared,
+                                 const unsigned char* labels );
 
     virtual void computeNormalizedDistortions( const vector<cv::Mat>& images,
                                                      cv::Mat& out_bdist_norm,
-                                                     cv::Mat& out_cdist_norm );
+                                                     cv::Mat& out_cdist_norm_squared );
 
     virtual void computeNormalizedDistortions( const cv::Mat& image,
                                                      cv::Mat& out_bdist_norm,
-                                                     cv::Mat& out_cdist_norm );
+                                                     cv::Mat& out_cdist_norm_squared );
 
 public:
     /* ----------------------------------------------------------------------------*/
@@ -93,13 +154,17 @@ public:
     * 
     * @param images Vector of training images (8-bit 3-channel images, CV_8UC3).
     * @param detection_rate Detection rate (ex: 95% is .95).
+    * @param pool Thread pool used to train and classify by bands of rows
+    * (NULL to use the calling thread only).
     */
     /* ----------------------------------------------------------------------------*/
     MultipleLCM( const vector<cv::Mat>& images,
                  const float            detection_rate,
-                 const bool             trace = false )
-    : LCM( detection_rate, trace )
+                 ThreadPool*            pool = NULL )
+    : LCM( detection_rate, pool ), _update_rate( 0 ), _update_shadow_highlight( false )
     {
+        setKernelISA( detectKernelISA() );
+
         if( images.empty() )
         {
             std::cerr << "ERROR: no input images!" << std::endl;
@@ -109,12 +174,160 @@ public:
         computeModel( images );
     }
 
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Constructor of an empty model, trained online: the training frames
+    * are given one at a time with addFrame(), and then finalize() computes the
+    * model.
+    *
+    * Only running sums are kept for the statistics of the model, so the memory
+    * used does not depend on the number of training frames. The thresholds are
+    * selected on a uniform random sample of the frames.
+    * 
+    * @param detection_rate Detection rate (ex: 95% is .95).
+    * @param nb_threshold_frames Maximum number of frames kept to select the
+    * thresholds, at least 1.
+    * @param pool Thread pool used to train and classify by bands of rows
+    * (NULL to use the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    MultipleLCM( const float  detection_rate,
+                 const int    nb_threshold_frames = 16,
+                 ThreadPool*  pool = NULL )
+    : LCM( detection_rate, pool ), _statistics( nb_threshold_frames ),
+      _update_rate( 0 ), _update_shadow_highlight( false )
+    {
+        CV_Assert( nb_threshold_frames > 0 );
+        setKernelISA( detectKernelISA() );
+    }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Constructor of a model loaded from a file, see LCM::load().
+    *
+    * The planes of the model are used in place in the mapping of the file.
+    * 
+    * @param file Model file, of type MODEL_MULTIPLE.
+    * @param pool Thread pool used to classify by bands of rows (NULL to use
+    * the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    MultipleLCM( const boost::shared_ptr<ModelFile>& file,
+                 ThreadPool*                         pool = NULL );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Constructor of a coarse model, for the frames reduced by a factor
+    * with PyramidClassifier::downsample().
+    *
+    * Each pixel of the coarse model has the means of the mean, standard
+    * deviation and variations of a block of factor x factor pixels of the
+    * model, and the thresholds are the ones of the model. The noise of the
+    * camera is averaged out in the reduced frames but not in the standard
+    * deviation, so the coarse model only detects the changes that cover a
+    * large part of a block, and detects few pixels of noise.
+    * 
+    * @param model Trained model.
+    * @param factor Width and height of the blocks, in pixels.
+    * @param pool Thread pool used to reduce and classify by bands of rows
+    * (NULL to use the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    MultipleLCM( const MultipleLCM& model,
+                 int                factor,
+                 ThreadPool*        pool = NULL );
+
     /* ----------------------------------------------------------------------------*/
     /** 
     * @brief Destructor.
     */
     /* ----------------------------------------------------------------------------*/
     virtual ~MultipleLCM() {}
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Add a training frame to a model created empty.
+    *
+    * The frame is accumulated into the running sums of the model, and may be
+    * kept in the sample of frames used to select the thresholds. The model is
+    * only updated by finalize().
+    * 
+    * @param image Training frame (8-bit 3-channel image, CV_8UC3), of the same
+    * size as the previous ones.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void addFrame( const cv::Mat& image );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Compute the model from the frames added so far.
+    *
+    * See Horprasert et al., 1999, Sections 4.1 and 4.3
+    *
+    * More frames can be added afterwards, and finalize() called again.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void finalize();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the number of frames added with addFrame().
+    */
+    /* ----------------------------------------------------------------------------*/
+    int getNbFrames() const { return _statistics.getNbFrames(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the size of the frames of the model, see LCM::getSize().
+    */
+    /* ----------------------------------------------------------------------------*/
+    virtual cv::Size getSize() const { return _coefficients.empty() ? cv::Size() : _coefficients[ 0 ].size(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Select the instruction set of the distortion kernel.
+    *
+    * By default, the most capable instruction set supported by the CPU is used.
+    * All the kernels give bit-identical results, so this is only useful for
+    * benchmarking and testing.
+    * 
+    * @param isa Instruction set. If it is not supported by the CPU, the most
+    * capable supported instruction set below it is used instead.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void setKernelISA( KernelISA isa );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Enable or disable the update of the model by classify().
+    *
+    * When enabled, the pixels labeled BACKGROUND by classify() are blended into
+    * the mean, standard deviation, brightness and variations of the model, and
+    * their coefficients are baked again, in the same pass as the labeling.
+    * This lets the model follow slow changes of the lighting. The thresholds
+    * are not updated.
+    * 
+    * @param rate Learning rate in [0, 1]: weight of the classified image in the
+    * updated model. 0 disables the update (default).
+    * @param update_shadow_highlight If true, the pixels labeled SHADOW and
+    * HIGHLIGHT update the model too.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void setUpdateRate( float rate, bool update_shadow_highlight = false );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the learning rate of the update of the model, 0 if disabled.
+    */
+    /* ----------------------------------------------------------------------------*/
+    float getUpdateRate() const { return _update_rate; }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the instruction set of the distortion kernel in use.
+    */
+    /* ----------------------------------------------------------------------------*/
+    KernelISA getKernelISA() const { return _kernel_isa; }
 };
 
 
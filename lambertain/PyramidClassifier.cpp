@@ -0,0 +1,197 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <cstring>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include "PyramidClassifier.hpp"
+#include "Workspace.hpp"
+
+const int had::PyramidClassifier::MAX_FACTOR;
+
+had::PyramidClassifier::PyramidClassifier( LCM* lcm,
+                                           LCM* coarse_lcm,
+                                           int  factor )
+: _lcm( lcm ), _coarse_lcm( coarse_lcm ), _factor( factor ), _nb_blocks( 0 ), _nb_blocks_refined( 0 )
+{
+    CV_Assert( lcm != NULL && coarse_lcm != NULL && factor > 0 && factor <= MAX_FACTOR );
+    computeMeans( factor, _means );
+}
+
+
+void had::PyramidClassifier::reset()
+{
+    _nb_blocks = 0;
+    _nb_blocks_refined = 0;
+}
+
+
+void had::PyramidClassifier::downsampleRows( const cv::Mat&                image,
+                                                   int                     factor,
+                                                   AccumulateKernel        kernel,
+                                             const vector<unsigned char>& means,
+                                                   cv::Mat&                out_image,
+                                                   int                     y_begin,
+                                                   int                     y_end )
+{
+    // The rows of a block are summed first, in one pass over contiguous
+    // values, and then the columns of each block
+    int nb_values = 3 * image.cols;
+    boost::uint16_t* sums = Workspace::get<boost::uint16_t>( Workspace::BUFFER_BLOCK_SUMS, nb_values, NULL );
+    for( int block_y = y_begin; block_y < y_end; ++block_y )
+    {
+        int y_first = block_y * factor;
+        int y_last = std::min( y_first + factor, image.rows );
+        std::fill( sums, sums + nb_values, 0 );
+        for( int y = y_first; y < y_last; ++y )
+            kernel( image.ptr<unsigned char>( y ), nb_values, sums );
+
+        unsigned char* row_out = out_image.ptr<unsigned char>( block_y );
+        for( int block_x = 0; block_x < out_image.cols; ++block_x )
+        {
+            int x_first = block_x * factor;
+            int x_last = std::min( x_first + factor, image.cols );
+            int sum[ 3 ] = { 0, 0, 0 };
+            for( int x = x_first; x < x_last; ++x )
+            {
+                sum[ 0 ] += sums[ 3 * x ];
+                sum[ 1 ] += sums[ 3 * x + 1 ];
+                sum[ 2 ] += sums[ 3 * x + 2 ];
+            }
+
+            int nb_pixels = ( x_last - x_first ) * ( y_last - y_first );
+            if( nb_pixels == factor * factor )
+            {
+                for( int id = 0; id < 3; ++id )
+                    row_out[ 3 * block_x + id ] = means[ sum[ id ] ];
+            }
+            else
+            {
+                for( int id = 0; id < 3; ++id )
+                    row_out[ 3 * block_x + id ] = (unsigned char) ( ( sum[ id ] + nb_pixels / 2 ) / nb_pixels );
+            }
+        }
+    }
+}
+
+
+void had::PyramidClassifier::computeMeans( int factor, vector<unsigned char>& out_means )
+{
+    int nb_pixels = factor * factor;
+    out_means.resize( 255 * nb_pixels + 1 );
+    for( unsigned int sum = 0; sum < out_means.size(); ++sum )
+        out_means[ sum ] = (unsigned char) ( ( sum + nb_pixels / 2 ) / nb_pixels );
+}
+
+
+void had::PyramidClassifier::downsample( const cv::Mat&    image,
+                                               int         factor,
+                                               cv::Mat&    out_image,
+                                               ThreadPool* pool )
+{
+    CV_Assert( factor > 0 && factor <= MAX_FACTOR );
+    vector<unsigned char> means;
+    computeMeans( factor, means );
+    downsample( image, factor, means, out_image, pool );
+}
+
+
+void had::PyramidClassifier::downsample( const cv::Mat&                image,
+                                               int                     factor,
+                                         const vector<unsigned char>& means,
+                                               cv::Mat&                out_image,
+                                               ThreadPool*             pool )
+{
+    CV_Assert( image.type() == CV_8UC3 && factor > 0 && factor <= MAX_FACTOR );
+    out_image.create( ( image.rows + factor - 1 ) / factor, ( image.cols + factor - 1 ) / factor, CV_8UC3 );
+
+    ThreadPool::runRange( pool,
+                          0,
+                          out_image.rows,
+                          boost::bind( &PyramidClassifier::downsampleRows,
+                                       boost::cref( image ),
+                                       factor,
+                                       getAccumulateKernel( detectKernelISA() ),
+                                       boost::cref( means ),
+                                       boost::ref( out_image ),
+                                       _1,
+                                       _2 ) );
+}
+
+
+void had::PyramidClassifier::prepareBlockRows( cv::Mat& out_mask,
+                                               cv::Mat& out_classification,
+                                               int      y_begin,
+                                               int      y_end )
+{
+    // A block is refined if a neighbour, or the block itself at the edges of
+    // the frame where there are fewer neighbours, has a different label. The
+    // rows of the mask and of the coarse labels are the same for all the
+    // rows of pixels of a block, so they are expanded once.
+    const cv::Mat& labels = _coarse_classification;
+    unsigned char* row_mask = Workspace::get<unsigned char>( Workspace::BUFFER_ROW_MASK, out_mask.cols, NULL );
+    unsigned char* row_labels = Workspace::get<unsigned char>( Workspace::BUFFER_ROW_LABELS, out_mask.cols, NULL );
+    for( int block_y = y_begin; block_y < y_end; ++block_y )
+    {
+        const unsigned char* rows[ 3 ] = { labels.ptr<unsigned char>( std::max( block_y - 1, 0 ) ),
+                                           labels.ptr<unsigned char>( block_y ),
+                                           labels.ptr<unsigned char>( std::min( block_y + 1, labels.rows - 1 ) ) };
+        unsigned char* refined = &_refined[ block_y * labels.cols ];
+        for( int block_x = 0; block_x < labels.cols; ++block_x )
+        {
+            int x_left = std::max( block_x - 1, 0 );
+            int x_right = std::min( block_x + 1, labels.cols - 1 );
+            unsigned char label = rows[ 1 ][ block_x ];
+            bool mixed = false;
+            for( int id = 0; id < 3; ++id )
+                mixed = mixed || rows[ id ][ x_left ] != label || rows[ id ][ block_x ] != label || rows[ id ][ x_right ] != label;
+            refined[ block_x ] = mixed;
+
+            int x = block_x * _factor;
+            int width = std::min( _factor, out_mask.cols - x );
+            memset( row_mask + x, refined[ block_x ], width );
+            memset( row_labels + x, label, width );
+        }
+
+        int y_last = std::min( ( block_y + 1 ) * _factor, out_mask.rows );
+        for( int y = block_y * _factor; y < y_last; ++y )
+        {
+            memcpy( out_mask.ptr<unsigned char>( y ), row_mask, out_mask.cols );
+            memcpy( out_classification.ptr<unsigned char>( y ), row_labels, out_mask.cols );
+        }
+    }
+}
+
+
+void had::PyramidClassifier::classify( const cv::Mat& image,
+                                             cv::Mat& out_classification )
+{
+    CV_Assert( image.type() == CV_8UC3 );
+    downsample( image, _factor, _means, _coarse_image, _lcm->getThreadPool() );
+    _coarse_lcm->classify( _coarse_image, _coarse_classification );
+
+    // The mask and the classification are written entirely, block by block,
+    // and then the refined blocks are classified again
+    _mask.create( image.size(), CV_8UC1 );
+    out_classification.create( image.size(), CV_8UC1 );
+    _refined.resize( _coarse_classification.rows * _coarse_classification.cols );
+    ThreadPool::runRange( _lcm->getThreadPool(),
+                          0,
+                          _coarse_classification.rows,
+                          boost::bind( &PyramidClassifier::prepareBlockRows,
+                                       this,
+                                       boost::ref( _mask ),
+                                       boost::ref( out_classification ),
+                                       _1,
+                                       _2 ) );
+
+    int nb_refined = 0;
+    for( unsigned int id = 0; id < _refined.size(); ++id )
+        nb_refined += _refined[ id ];
+    _nb_blocks += _refined.size();
+    _nb_blocks_refined += nb_refined;
+
+    if( nb_refined > 0 )
+        _lcm->classify( image, _mask, out_classification );
+}
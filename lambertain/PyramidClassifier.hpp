@@ -0,0 +1,194 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_PYRAMID_CLASSIFIER_HPP
+#define HAD_PYRAMID_CLASSIFIER_HPP
+
+#include <vector>
+using std::vector;
+
+#include <cv.h>
+
+#include "LCM.hpp"
+#include "DistortionKernels.hpp"
+#include "ThreadPool.hpp"
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Coarse-to-fine classifier, which classifies at full resolution only
+* near the boundaries between labels.
+*
+* The frame is first reduced by a factor, each pixel of the coarse frame
+* being the mean of a block of factor x factor pixels (see downsample()), and
+* classified with a coarse model trained on frames reduced the same way. A
+* block whose coarse label differs from the label of one of its 8 neighbours
+* is then classified again at full resolution with the full model; the other
+* blocks take their coarse label for all their pixels.
+*
+* The output has the full resolution, and the labels near the boundaries of
+* the objects are the ones of the full model. Inside the uniform areas, the
+* isolated pixels that the full model would label differently, like the false
+* detections caused by noise, are lost: benchmark measures the fraction of
+* the labels that differ. If the full model updates itself (see
+* MultipleLCM::setUpdateRate()), it is only updated with the refined blocks.
+*/
+/* ----------------------------------------------------------------------------*/
+class PyramidClassifier
+{
+public:
+    static const int MAX_FACTOR = 16;  //!< Largest reduction factor.
+
+private:
+    LCM*                  _lcm;                     //!< Model of the full frames (not owned).
+    LCM*                  _coarse_lcm;              //!< Model of the coarse frames (not owned).
+    int                   _factor;                  //!< Width and height of the blocks, in pixels.
+
+    cv::Mat               _coarse_image;            //!< Last coarse frame (CV_8UC3).
+    cv::Mat               _coarse_classification;   //!< Labels of the last coarse frame (CV_8UC1).
+    cv::Mat               _mask;                    //!< Mask of the pixels of the refined blocks of the last frame (CV_8UC1).
+    vector<unsigned char> _refined;                 //!< For each block of the last frame, row by row, whether it was refined.
+    vector<unsigned char> _means;                   //!< Rounded mean of each sum of the values of a full block, see computeMeans().
+    long long             _nb_blocks;               //!< Number of blocks seen since the last reset.
+    long long             _nb_blocks_refined;       //!< Number of blocks classified at full resolution since the last reset.
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Reduce a band of rows of blocks, see downsample().
+    *
+    * @param kernel Kernel used to sum the rows of the blocks.
+    * @param means Rounded mean of each sum of the values of a full block.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static void downsampleRows( const cv::Mat&                image,
+                                      int                     factor,
+                                      AccumulateKernel        kernel,
+                                const vector<unsigned char>& means,
+                                      cv::Mat&                out_image,
+                                      int                     y_begin,
+                                      int                     y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Compute the rounded mean of each sum of the values of a full
+    * block, which is looked up rather than divided.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static void computeMeans( int factor, vector<unsigned char>& out_means );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Reduce a frame by a factor, see downsample(), with the means of
+    * the factor already computed by computeMeans().
+    */
+    /* ----------------------------------------------------------------------------*/
+    static void downsample( const cv::Mat&                image,
+                                  int                     factor,
+                            const vector<unsigned char>& means,
+                                  cv::Mat&                out_image,
+                                  ThreadPool*             pool );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Select the blocks of a band of rows of blocks to refine, prepare
+    * the mask of their pixels, and give their coarse label to all the pixels
+    * of the blocks.
+    *
+    * @param out_mask Mask of the pixels to classify at full resolution,
+    * already allocated.
+    * @param out_classification Classification of the frame, already
+    * allocated.
+    * @param y_begin First row of blocks of the band.
+    * @param y_end Row of blocks after the last row of the band.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void prepareBlockRows( cv::Mat& out_mask,
+                           cv::Mat& out_classification,
+                           int      y_begin,
+                           int      y_end );
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor.
+    *
+    * @param lcm Trained model of the full frames, which must outlive the
+    * classifier.
+    * @param coarse_lcm Model trained on the same frames reduced by
+    * downsample() with the same factor, which must outlive the classifier.
+    * @param factor Width and height of the blocks, in pixels (ex: 4), up to
+    * MAX_FACTOR.
+    */
+    /* ----------------------------------------------------------------------------*/
+    PyramidClassifier( LCM* lcm,
+                       LCM* coarse_lcm,
+                       int  factor = 4 );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Reduce a frame by a factor: each pixel of the reduced frame is the
+    * rounded mean of a block of factor x factor pixels, clipped to the frame.
+    *
+    * @param image Input image (8-bit 3-channel image, CV_8UC3).
+    * @param factor Width and height of the blocks, in pixels, up to
+    * MAX_FACTOR.
+    * @param out_image Reduced image (8-bit 3-channel image, CV_8UC3), of
+    * ceil( cols / factor ) x ceil( rows / factor ) pixels, which must not be
+    * the input image.
+    * @param pool Thread pool used to reduce by bands of rows (NULL to use the
+    * calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    static void downsample( const cv::Mat&    image,
+                                  int         factor,
+                                  cv::Mat&    out_image,
+                                  ThreadPool* pool = NULL );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Classify a frame.
+    *
+    * @param image Input image (8-bit 3-channel image, CV_8UC3), of the size of
+    * the full model.
+    * @param out_classification Computed classification image (8-bit 1-channel
+    * image, CV_8UC1), of the size of the image.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void classify( const cv::Mat& image,
+                         cv::Mat& out_classification );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Clear the counters of blocks.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void reset();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of blocks seen since the construction or the last
+    * call to reset().
+    */
+    /* ----------------------------------------------------------------------------*/
+    long long getNbBlocks() const { return _nb_blocks; }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of blocks classified at full resolution since the
+    * construction or the last call to reset().
+    */
+    /* ----------------------------------------------------------------------------*/
+    long long getNbBlocksRefined() const { return _nb_blocks_refined; }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the fraction of the blocks classified at full resolution, in
+    * [0, 1].
+    */
+    /* ----------------------------------------------------------------------------*/
+    double getRefinedRatio() const { return _nb_blocks > 0 ? (double) _nb_blocks_refined / _nb_blocks : 0; }
+};
+
+}
+
+#endif // HAD_PYRAMID_CLASSIFIER_HPP
@@ -0,0 +1,133 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <cstring>
+#include <algorithm>
+
+#include "QuantileSelector.hpp"
+
+had::QuantileSelector::QuantileSelector( float detection_rate )
+: _detection_rate( detection_rate ), _pass( 0 ), _nb_values( 0 ), _coarse( 1 << 16, 0 )
+{
+    _values[ 0 ] = 0;
+    _values[ 1 ] = 0;
+}
+
+
+unsigned int had::QuantileSelector::toKey( float value )
+{
+    // Flip all the bits of negative values, and only the sign bit of positive
+    // values, so that the keys compare like the floats they come from.
+    unsigned int bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+    return ( bits & 0x80000000u ) ? ~bits : ( bits | 0x80000000u );
+}
+
+
+float had::QuantileSelector::fromKey( unsigned int key )
+{
+    unsigned int bits = ( key & 0x80000000u ) ? ( key & 0x7FFFFFFFu ) : ~key;
+    float value;
+    memcpy( &value, &bits, sizeof( value ) );
+    return value;
+}
+
+
+unsigned int had::QuantileSelector::findBin( const vector<Count>& histogram, Count* io_rank )
+{
+    for( unsigned int bin = 0; bin < histogram.size(); ++bin )
+    {
+        if( *io_rank < histogram[ bin ] )
+            return bin;
+        *io_rank -= histogram[ bin ];
+    }
+
+    // Not reached as long as the rank is lower than the number of values
+    return histogram.size() - 1;
+}
+
+
+void had::QuantileSelector::add( const float* values, int nb_values )
+{
+    if( _pass == 0 )
+    {
+        for( int i = 0; i < nb_values; ++i )
+            ++_coarse[ toKey( values[ i ] ) >> 16 ];
+        _nb_values += nb_values;
+    }
+    else if( _pass == 1 )
+    {
+        for( int i = 0; i < nb_values; ++i )
+        {
+            unsigned int key = toKey( values[ i ] );
+            unsigned int bin = key >> 16;
+            if( bin == _bins[ 0 ] ) ++_fine[ 0 ][ key & 0xFFFF ];
+            if( bin == _bins[ 1 ] ) ++_fine[ 1 ][ key & 0xFFFF ];
+        }
+    }
+}
+
+
+had::QuantileSelector had::QuantileSelector::split() const
+{
+    QuantileSelector partial( *this );
+    partial._nb_values = 0;
+    std::fill( partial._coarse.begin(), partial._coarse.end(), 0 );
+    std::fill( partial._fine[ 0 ].begin(), partial._fine[ 0 ].end(), 0 );
+    std::fill( partial._fine[ 1 ].begin(), partial._fine[ 1 ].end(), 0 );
+    return partial;
+}
+
+
+void had::QuantileSelector::merge( const QuantileSelector& partial )
+{
+    if( _pass == 0 )
+    {
+        for( unsigned int bin = 0; bin < _coarse.size(); ++bin )
+            _coarse[ bin ] += partial._coarse[ bin ];
+        _nb_values += partial._nb_values;
+    }
+    else if( _pass == 1 )
+    {
+        for( int id = 0; id < 2; ++id )
+            for( unsigned int bin = 0; bin < _fine[ id ].size(); ++bin )
+                _fine[ id ][ bin ] += partial._fine[ id ][ bin ];
+    }
+}
+
+
+void had::QuantileSelector::endPass()
+{
+    if( _pass == 0 )
+    {
+        if( _nb_values == 0 )
+        {
+            // Empty distribution: nothing to select
+            _pass = 2;
+            return;
+        }
+
+        // Same ranks as when sorting the values, see Horprasert et al., 1999, Section 4.3
+        float ranks[ 2 ] = { ( 1 - _detection_rate ) * (float) _nb_values,
+                             _detection_rate * (float) _nb_values };
+        for( int id = 0; id < 2; ++id )
+        {
+            _ranks[ id ] = ranks[ id ] > 0 ? (Count) ranks[ id ] : 0;
+            if( _ranks[ id ] >= _nb_values ) _ranks[ id ] = _nb_values - 1;
+            _bins[ id ] = findBin( _coarse, &_ranks[ id ] );
+            _fine[ id ].assign( 1 << 16, 0 );
+        }
+
+        _coarse.clear();
+        ++_pass;
+    }
+    else if( _pass == 1 )
+    {
+        for( int id = 0; id < 2; ++id )
+        {
+            unsigned int low = findBin( _fine[ id ], &_ranks[ id ] );
+            _values[ id ] = fromKey( ( _bins[ id ] << 16 ) | low );
+            _fine[ id ].clear();
+        }
+        ++_pass;
+    }
+}
@@ -0,0 +1,150 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_QUANTILE_SELECTOR_HPP
+#define HAD_QUANTILE_SELECTOR_HPP
+
+#include <vector>
+using std::vector;
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/** 
+* @brief Exact selection of the thresholds of a distribution streamed in
+* several passes, with a memory footprint independent of its size.
+*
+* The thresholds are the values at ranks (1 - detection_rate) * n and
+* detection_rate * n of the sorted distribution of n values, which is what
+* sorting all the values would give, but without ever storing them.
+*
+* Each float value is mapped to a 32-bit key with the same ordering. The first
+* pass counts the values in a histogram of the high 16 bits of the keys, which
+* gives the total number of values and the bins holding the two requested
+* ranks. The second pass counts the values of these two bins only, in
+* histograms of the low 16 bits of the keys, which gives the exact keys at the
+* requested ranks. The caller feeds the same values in each pass, as long as
+* needsPass() returns true:
+*
+* @code
+* QuantileSelector selector( detection_rate );
+* while( selector.needsPass() )
+* {
+*     for( ... each chunk of values ... )
+*         selector.add( values, nb_values );
+*     selector.endPass();
+* }
+* @endcode
+*/
+/* ----------------------------------------------------------------------------*/
+class QuantileSelector
+{
+private:
+    typedef unsigned long long Count;
+
+    float         _detection_rate;  //!< Detection rate (ex: .95 means 95%)
+    int           _pass;            //!< Index of the current pass.
+    Count         _nb_values;       //!< Number of values in the distribution.
+    vector<Count> _coarse;          //!< Histogram of the high 16 bits of the keys.
+    vector<Count> _fine[ 2 ];       //!< Histograms of the low 16 bits of the keys, for the left and right bins.
+    unsigned int  _bins[ 2 ];       //!< High 16 bits of the left and right keys.
+    Count         _ranks[ 2 ];      //!< Ranks of the left and right values, inside their bin after the first pass.
+    float         _values[ 2 ];     //!< Selected left and right values.
+
+    static unsigned int toKey( float value );
+    static float fromKey( unsigned int key );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Find the bin of a histogram that contains the value at a given rank.
+    * 
+    * @param histogram Histogram.
+    * @param io_rank Rank of the value in the whole histogram as input, and rank
+    * of the value inside of the found bin as output.
+    * 
+    * @return Index of the bin.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static unsigned int findBin( const vector<Count>& histogram, Count* io_rank );
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Constructor.
+    * 
+    * @param detection_rate Detection rate (ex: 95% is .95).
+    */
+    /* ----------------------------------------------------------------------------*/
+    explicit QuantileSelector( float detection_rate );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Check whether another pass over the values is needed.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool needsPass() const { return _pass < 2; }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Feed values of the distribution to the current pass.
+    * 
+    * @param values Array of values.
+    * @param nb_values Number of values in the array.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void add( const float* values, int nb_values );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Create an empty selector for a part of the values of the current
+    * pass, so that several threads can count values at the same time.
+    *
+    * The counts of the partial selectors are added back with merge(). Counts
+    * are integers, so the result does not depend on how the values were split.
+    */
+    /* ----------------------------------------------------------------------------*/
+    QuantileSelector split() const;
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Add the counts of a partial selector created by split().
+    * 
+    * @param partial Partial selector, fed with values of the current pass.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void merge( const QuantileSelector& partial );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Finish the current pass, once all the values have been fed.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void endPass();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the number of values in the distribution (known after the
+    * first pass).
+    */
+    /* ----------------------------------------------------------------------------*/
+    Count getNbValues() const { return _nb_values; }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the value at rank (1 - detection_rate) * n (known after the
+    * last pass).
+    */
+    /* ----------------------------------------------------------------------------*/
+    float getLeft() const { return _values[ 0 ]; }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the value at rank detection_rate * n (known after the last
+    * pass).
+    */
+    /* ----------------------------------------------------------------------------*/
+    float getRight() const { return _values[ 1 ]; }
+};
+
+}
+
+#endif // HAD_QUANTILE_SELECTOR_HPP
@@ -0,0 +1,232 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <cmath>
+
+#include <boost/bind.hpp>
+
+#include "QuantizedLCM.hpp"
+
+namespace {
+
+// Round a value to a 16-bit unsigned fixed-point value with a number of
+// fractional bits, saturating the values out of range
+boost::uint16_t quantize( float value, int shift )
+{
+    return (boost::uint16_t) std::max( 0, std::min( 65535, cvRound( ldexp( (double) value, shift ) ) ) );
+}
+
+}
+
+const int had::QuantizedLCM::MEAN_SHIFT;
+const int had::QuantizedLCM::MAX_SHIFT;
+
+
+had::QuantizedLCM::QuantizedLCM( const MultipleLCM& model,
+                                 ThreadPool*        pool )
+: LCM( model._detection_rate, pool )
+{
+    CV_Assert( ! model._coefficients.empty() );
+    _threshold_cdist_squared = model._threshold_cdist_squared;
+    _threshold_bdist_left    = model._threshold_bdist_left;
+    _threshold_bdist_right   = model._threshold_bdist_right;
+
+    setKernelISA( detectKernelISA() );
+
+    cv::Size size = model._mean.size();
+    _values.resize( NB_QUANTIZED_VALUES );
+    for( int id = 0; id < NB_QUANTIZED_VALUES; ++id )
+        _values[ id ] = cv::Mat( size, CV_16U );
+    _exponents.resize( NB_QUANTIZED_EXPONENTS );
+    for( int id = 0; id < NB_QUANTIZED_EXPONENTS; ++id )
+        _exponents[ id ] = cv::Mat( size, CV_8U );
+    parallelRows( 0,
+                  size.height,
+                  boost::bind( &QuantizedLCM::quantizeRows, this, boost::cref( model ), _1, _2 ) );
+}
+
+
+had::QuantizedLCM::QuantizedLCM( const boost::shared_ptr<ModelFile>& file,
+                                 ThreadPool*                         pool )
+: LCM( file, pool )
+{
+    if( file->getHeader().type != MODEL_QUANTIZED )
+        CV_Error( CV_StsBadArg, "the model file does not hold a QuantizedLCM" );
+
+    cv::Size size( file->getHeader().cols, file->getHeader().rows );
+    _values.resize( NB_QUANTIZED_VALUES );
+    for( int id = 0; id < NB_QUANTIZED_VALUES; ++id )
+        _values[ id ] = file->getBlock( Q_BLOCK_VALUES + id, 1, size, CV_16U );
+    _exponents.resize( NB_QUANTIZED_EXPONENTS );
+    for( int id = 0; id < NB_QUANTIZED_EXPONENTS; ++id )
+        _exponents[ id ] = file->getBlock( Q_BLOCK_EXPONENTS + id, 1, size, CV_8U );
+
+    // The units are built from the bits of the exponents, so a corrupted file
+    // must not be able to give them out of range
+    bool valid = true;
+    for( int id = 0; id < NB_QUANTIZED_EXPONENTS; ++id )
+    {
+        for( int y = 0; y < size.height; ++y )
+        {
+            const unsigned char* row = _exponents[ id ].ptr<unsigned char>( y );
+            for( int x = 0; x < size.width; ++x )
+                valid = valid && row[ x ] <= MAX_SHIFT;
+        }
+    }
+    if( ! valid )
+        CV_Error( CV_StsBadArg, "the model file has invalid fixed-point shifts" );
+    setKernelISA( detectKernelISA() );
+}
+
+
+int had::QuantizedLCM::getShift( float max_value )
+{
+    int shift = MAX_SHIFT;
+    while( shift > 0 && ldexp( (double) max_value, shift ) > 65535 )
+        --shift;
+    return shift;
+}
+
+
+void had::QuantizedLCM::quantizeRows( const MultipleLCM& model,
+                                            int          y_begin,
+                                            int          y_end )
+{
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        for( int x = 0; x < model._mean.cols; ++x )
+        {
+            const cv::Vec3f& brightness = model._brightness.at<cv::Vec3f>( y, x );
+            int exponent = getShift( std::max( brightness[ 0 ], std::max( brightness[ 1 ], brightness[ 2 ] ) ) );
+            _exponents[ QEXPONENT_BRIGHTNESS ].at<unsigned char>( y, x ) = (unsigned char) exponent;
+            for( int id = 0; id < 3; ++id )
+            {
+                _values[ QVALUE_BRIGHTNESS + id ].at<boost::uint16_t>( y, x ) = quantize( brightness[ id ], exponent );
+                _values[ QVALUE_MEAN + id ].at<boost::uint16_t>( y, x ) = quantize( model._mean.at<cv::Vec3f>( y, x )[ id ], MEAN_SHIFT );
+            }
+
+            float scale[ 3 ];
+            for( int id = 0; id < 3; ++id )
+                scale[ id ] = model._coefficients[ COEF_SCALE + id ].at<float>( y, x );
+            exponent = getShift( std::max( scale[ 0 ], std::max( scale[ 1 ], scale[ 2 ] ) ) );
+            _exponents[ QEXPONENT_SCALE ].at<unsigned char>( y, x ) = (unsigned char) exponent;
+            for( int id = 0; id < 3; ++id )
+                _values[ QVALUE_SCALE + id ].at<boost::uint16_t>( y, x ) = quantize( scale[ id ], exponent );
+
+            float inv_bdist_variation = model._coefficients[ COEF_INV_BDIST_VARIATION ].at<float>( y, x );
+            exponent = getShift( inv_bdist_variation );
+            _exponents[ QEXPONENT_INV_BDIST_VARIATION ].at<unsigned char>( y, x ) = (unsigned char) exponent;
+            _values[ QVALUE_INV_BDIST_VARIATION ].at<boost::uint16_t>( y, x ) = quantize( inv_bdist_variation, exponent );
+        }
+    }
+}
+
+
+void had::QuantizedLCM::setKernelISA( KernelISA isa )
+{
+    KernelISA supported = detectKernelISA();
+    _kernel_isa = isa > supported ? supported : isa;
+    _kernel = getQuantizedDistortionKernel( _kernel_isa );
+}
+
+
+void had::QuantizedLCM::classifyRows( const ClassificationBatch& batch,
+                                            int                  y_begin,
+                                            int                  y_end )
+{
+    classifyRowsOf<QuantizedLCM>( batch, y_begin, y_end );
+}
+
+
+void had::QuantizedLCM::computeNormalizedDistortionsRow( const cv::Mat& image,
+                                                               int      y,
+                                                               int      x_begin,
+                                                               int      x_end,
+                                                               float*   out_bdist_norm,
+                                                               float*   out_cdist_norm_squared )
+{
+    // See Horprasert et al., 1999, Eqs. 5, 6, 9 and 10
+    // The row is processed in runs short enough for the de-interleaved
+    // pixels to stay in the L1 cache.
+    const int size_run = 256;
+    float pixels[ 3 ][ size_run ];
+
+    const unsigned char* row_image = image.ptr<unsigned char>( y );
+    QuantizedDistortionRow row;
+    row.unit_mean = getShiftUnit( MEAN_SHIFT );
+    for( int x_start = x_begin; x_start < x_end; x_start += size_run )
+    {
+        row.nb_pixels = std::min( size_run, x_end - x_start );
+        for( int x = 0; x < row.nb_pixels; ++x )
+        {
+            const unsigned char* pixel = row_image + 3 * ( x_start + x );
+            pixels[ 0 ][ x ] = pixel[ 0 ];
+            pixels[ 1 ][ x ] = pixel[ 1 ];
+            pixels[ 2 ][ x ] = pixel[ 2 ];
+        }
+
+        for( int id = 0; id < 3; ++id )
+            row.pixel[ id ] = pixels[ id ];
+        for( int id = 0; id < NB_QUANTIZED_VALUES; ++id )
+            row.values[ id ] = _values[ id ].ptr<boost::uint16_t>( y ) + x_start;
+        for( int id = 0; id < NB_QUANTIZED_EXPONENTS; ++id )
+            row.exponents[ id ] = _exponents[ id ].ptr<boost::uint8_t>( y ) + x_start;
+        row.out_bdist_norm         = out_bdist_norm + x_start;
+        row.out_cdist_norm_squared = out_cdist_norm_squared + x_start;
+
+        _kernel( row );
+    }
+}
+
+
+void had::QuantizedLCM::computeNormalizedDistortions( const cv::Mat& image,
+                                                            cv::Mat& out_bdist_norm,
+                                                            cv::Mat& out_cdist_norm_squared )
+{
+    // See Horprasert et al., 1999, Eqs. 9 and 10
+    out_bdist_norm.create( image.size(), CV_32F );
+    out_cdist_norm_squared.create( image.size(), CV_32F );
+    parallelRows( 0,
+                  image.rows,
+                  boost::bind( &QuantizedLCM::computeNormalizedDistortionsRows,
+                               this,
+                               boost::cref( image ),
+                               boost::ref( out_bdist_norm ),
+                               boost::ref( out_cdist_norm_squared ),
+                               _1,
+                               _2 ) );
+}
+
+
+void had::QuantizedLCM::computeNormalizedDistortions( const vector<cv::Mat>& images,
+                                                            cv::Mat& out_bdist_norm,
+                                                            cv::Mat& out_cdist_norm_squared )
+{
+    // See Horprasert et al., 1999, Eqs. 9 and 10
+    int cols = images[ 0 ].cols;
+    int rows = images[ 0 ].rows;
+    out_bdist_norm.create( rows, cols * images.size(), CV_32F );
+    out_cdist_norm_squared.create( rows, cols * images.size(), CV_32F );
+    for( unsigned int id_image = 0; id_image < images.size(); ++id_image )
+    {
+        cv::Mat bdist_image = out_bdist_norm.colRange( id_image * cols, ( id_image + 1 ) * cols );
+        cv::Mat cdist_image = out_cdist_norm_squared.colRange( id_image * cols, ( id_image + 1 ) * cols );
+        parallelRows( 0,
+                      rows,
+                      boost::bind( &QuantizedLCM::computeNormalizedDistortionsRows,
+                                   this,
+                                   boost::cref( images[ id_image ] ),
+                                   boost::ref( bdist_image ),
+                                   boost::ref( cdist_image ),
+                                   _1,
+                                   _2 ) );
+    }
+}
+
+
+had::ModelType had::QuantizedLCM::getModelBlocks( vector<cv::Mat>& out_blocks ) const
+{
+    out_blocks.clear();
+    out_blocks.insert( out_blocks.end(), _values.begin(), _values.end() );
+    out_blocks.insert( out_blocks.end(), _exponents.begin(), _exponents.end() );
+    return MODEL_QUANTIZED;
+}
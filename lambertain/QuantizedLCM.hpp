@@ -0,0 +1,177 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_QUANTIZED_LCM_HPP
+#define HAD_QUANTIZED_LCM_HPP
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+using std::vector;
+#include <string>
+using std::string;
+
+#include <boost/cstdint.hpp>
+
+#include <cv.h>
+#include <highgui.h>
+
+#include "LCM.hpp"
+#include "DistortionKernels.hpp"
+#include "MultipleLCM.hpp"
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Multiple image Lambertain Color Model stored in fixed point.
+*
+* The model is converted from a trained MultipleLCM: only the values used for
+* classification are kept, each one as a 16-bit unsigned fixed-point value. A
+* pixel of the model then takes 23 bytes instead of the 84 of a MultipleLCM
+* (44 for the statistics and 40 for the coefficients), and the classification
+* reads about half as much memory.
+*
+* The mean has 8 fractional bits. The brightness varies like the inverse of
+* the mean, and the scale and the inverse of the brightness distortion
+* variation by several orders of magnitude between pixels, so the three have
+* their own number of fractional bits in each pixel: a single number of bits
+* for the whole plane of the scale, limited by its largest value, makes 5% of
+* the labels of dataset/ differ when trained on 4 frames. The brightness
+* distortion is computed exactly with integers, from the 16-bit brightness and
+* the 8-bit pixels, and the rest of the computation is the one of MultipleLCM,
+* in float.
+*
+* The labels can differ from the ones of the float model for the pixels whose
+* distortions are within the rounding error of a threshold: on dataset/, 0.044%
+* of them when trained on 4 frames and 0.001% on 16 frames. benchmark measures
+* the fraction of differing labels, and fails above 0.1%. The model cannot be
+* updated by classify().
+*/
+/* ----------------------------------------------------------------------------*/
+class QuantizedLCM: public LCM
+{
+    friend class LCM;  // Calls the row functions without virtual dispatch, see LCM::classifyRowsOf().
+
+private:
+    static const int MEAN_SHIFT = 8;    //!< Number of fractional bits of the mean.
+    static const int MAX_SHIFT  = 30;   //!< Maximum number of fractional bits of the other values.
+
+    vector<cv::Mat>           _values;          //!< 16-bit planes of the model (CV_16U, see QuantizedValue).
+    vector<cv::Mat>           _exponents;       //!< Per-pixel numbers of fractional bits (CV_8U, see QuantizedExponent).
+
+    KernelISA                 _kernel_isa;      //!< Instruction set of the distortion kernel.
+    QuantizedDistortionKernel _kernel;          //!< Distortion kernel used by computeNormalizedDistortionsRow().
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the largest number of fractional bits, up to MAX_SHIFT, with
+    * which a value fits in 16 bits.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static int getShift( float max_value );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Quantize a band of rows of a float model.
+    *
+    * @param model Float model.
+    * @param y_begin First row of the band.
+    * @param y_end Row after the last row of the band.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void quantizeRows( const MultipleLCM& model,
+                             int          y_begin,
+                             int          y_end );
+
+    virtual void computeNormalizedDistortions( const vector<cv::Mat>& images,
+                                                     cv::Mat& out_bdist_norm,
+                                                     cv::Mat& out_cdist_norm_squared );
+
+    virtual void computeNormalizedDistortions( const cv::Mat& image,
+                                                     cv::Mat& out_bdist_norm,
+                                                     cv::Mat& out_cdist_norm_squared );
+
+protected:
+    virtual ModelType getModelBlocks( vector<cv::Mat>& out_blocks ) const;
+
+    virtual int getModelPixelSize() const { return NB_QUANTIZED_VALUES * sizeof( boost::uint16_t ) + NB_QUANTIZED_EXPONENTS * sizeof( boost::uint8_t ); }
+
+    virtual void classifyRows( const ClassificationBatch& batch,
+                                     int                  y_begin,
+                                     int                  y_end );
+
+    virtual void computeNormalizedDistortionsRow( const cv::Mat& image,
+                                                        int      y,
+                                                        int      x_begin,
+                                                        int      x_end,
+                                                        float*   out_bdist_norm,
+                                                        float*   out_cdist_norm_squared );
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor. Quantize a trained model.
+    *
+    * The number of fractional bits of each pixel is the largest one for which
+    * its values fit in 16 bits, the mean having MEAN_SHIFT.
+    * The detection rate and the thresholds are the ones of the float model.
+    *
+    * @param model Trained model.
+    * @param pool Thread pool used to quantize and classify by bands of rows
+    * (NULL to use the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    QuantizedLCM( const MultipleLCM& model,
+                  ThreadPool*        pool = NULL );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor of a model loaded from a file, see LCM::load().
+    *
+    * @param file Model file, of type MODEL_QUANTIZED.
+    * @param pool Thread pool used to classify by bands of rows (NULL to use
+    * the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    QuantizedLCM( const boost::shared_ptr<ModelFile>& file,
+                  ThreadPool*                         pool = NULL );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Destructor.
+    */
+    /* ----------------------------------------------------------------------------*/
+    virtual ~QuantizedLCM() {}
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Select the instruction set of the distortion kernel.
+    *
+    * By default, the most capable instruction set supported by the CPU is used.
+    * All the kernels give bit-identical results, so this is only useful for
+    * benchmarking and testing.
+    * 
+    * @param isa Instruction set. If it is not supported by the CPU, the most
+    * capable supported instruction set below it is used instead.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void setKernelISA( KernelISA isa );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the instruction set of the distortion kernel in use.
+    */
+    /* ----------------------------------------------------------------------------*/
+    KernelISA getKernelISA() const { return _kernel_isa; }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the size of the frames of the model, see LCM::getSize().
+    */
+    /* ----------------------------------------------------------------------------*/
+    virtual cv::Size getSize() const { return _values.empty() ? cv::Size() : _values[ 0 ].size(); }
+};
+
+}
+
+#endif // HAD_QUANTIZED_LCM_HPP
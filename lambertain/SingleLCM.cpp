@@ -1,15 +1,108 @@
 // (c)2010 - Emmanuel Goossaert
 // Under GNU License 3.0
+#include <boost/bind.hpp>
+
 #include "SingleLCM.hpp"
 
-void had::SingleLCM::computeModelMeanStdDev( const cv::Mat& image,
-                                             const cv::Mat& mask )
+const int had::SingleLCM::TRAINING_CHUNK;
+
+void had::SingleLCM::countPixelsRows( const cv::Mat&     mask,
+                                            vector<int>& out_nb_pixels,
+                                            int          y_begin,
+                                            int          y_end )
+{
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        const unsigned char* row_mask = mask.ptr<unsigned char>( y );
+        int nb_pixels = 0;
+        for( int x = 0; x < mask.cols; ++x )
+            nb_pixels += row_mask[ x ] != 0;
+        out_nb_pixels[ y ] = nb_pixels;
+    }
+}
+
+
+void had::SingleLCM::gatherPixelsRows( const cv::Mat&     image,
+                                       const cv::Mat&     mask,
+                                       const vector<int>& offsets,
+                                             cv::Mat&     out_pixels,
+                                             int          y_begin,
+                                             int          y_end )
+{
+    for( int y = y_begin; y < y_end; ++y )
+    {
+        const unsigned char* row_image = image.ptr<unsigned char>( y );
+        const unsigned char* row_mask = mask.ptr<unsigned char>( y );
+        unsigned char* pixels = out_pixels.ptr<unsigned char>( 0 ) + 3 * offsets[ y ];
+        for( int x = 0; x < image.cols; ++x )
+        {
+            if( ! row_mask[ x ] )
+                continue;
+
+            pixels[ 0 ] = row_image[ 3 * x ];
+            pixels[ 1 ] = row_image[ 3 * x + 1 ];
+            pixels[ 2 ] = row_image[ 3 * x + 2 ];
+            pixels += 3;
+        }
+    }
+}
+
+
+void had::SingleLCM::gatherPixels( const cv::Mat&          image,
+                                   const cv::Mat&          mask,
+                                         cv::Mat&          out_pixels,
+                                         vector<cv::Mat>&  out_chunks )
+{
+    CV_Assert( image.type() == CV_8UC3 && mask.type() == CV_8UC1 && image.size() == mask.size() );
+
+    // The pixels are counted per row first, so that each row knows where its
+    // pixels go and the rows can be copied in parallel, in the order of the
+    // image.
+    vector<int> offsets( image.rows + 1, 0 );
+    parallelRows( 0,
+                  image.rows,
+                  boost::bind( &SingleLCM::countPixelsRows,
+                               this,
+                               boost::cref( mask ),
+                               boost::ref( offsets ),
+                               _1,
+                               _2 ) );
+
+    int nb_pixels = 0;
+    for( int y = 0; y <= image.rows; ++y )
+    {
+        int nb_pixels_row = offsets[ y ];
+        offsets[ y ] = nb_pixels;
+        nb_pixels += nb_pixels_row;
+    }
+    if( nb_pixels == 0 )
+        CV_Error( CV_StsBadArg, "the mask does not hold any training pixel" );
+
+    out_pixels = cv::Mat( 1, nb_pixels, CV_8UC3 );
+    parallelRows( 0,
+                  image.rows,
+                  boost::bind( &SingleLCM::gatherPixelsRows,
+                               this,
+                               boost::cref( image ),
+                               boost::cref( mask ),
+                               boost::cref( offsets ),
+                               boost::ref( out_pixels ),
+                               _1,
+                               _2 ) );
+
+    out_chunks.clear();
+    for( int x = 0; x < nb_pixels; x += TRAINING_CHUNK )
+        out_chunks.push_back( out_pixels.colRange( x, std::min( x + TRAINING_CHUNK, nb_pixels ) ) );
+}
+
+
+void had::SingleLCM::computeModelMeanStdDev( const cv::Mat& pixels )
 {
     // See Horprasert et al., 1999, Sections 4.1 and 7
     // See Horprasert et al., 1999, Eq. 4
     
     // Pre-compute the brightness denominator for future calculations
-    cv::meanStdDev( image, _mean, _stddev, mask );
+    cv::meanStdDev( pixels, _mean, _stddev );
     for( int id = 0; id < 3; ++id )
         if( _stddev[ id ] == 0 ) _stddev[ id ] = 1;
 
@@ -26,126 +119,278 @@ void had::SingleLCM::computeModel( const cv::Mat& image,
                                    const cv::Mat& mask )
 {
     // See Horprasert et al., 1999, Section 4.1
-    computeModelMeanStdDev( image, mask );
-    computeVariations( image, mask );
+    // Consider only the pixels in the training regions, which is the
+    // modification of Yacoob and Davis, 2006, to the model developed by
+    // Horprasert et al., 1999. They are gathered once, and all the passes of
+    // the training only read them.
+    HAD_STATS_LOCAL( stats );
+    HAD_STAGE_CLOCK( stats );
+    cv::Mat pixels;
+    vector<cv::Mat> chunks;
+    gatherPixels( image, mask, pixels, chunks );
+    computeModelMeanStdDev( pixels );
+    computeVariations( chunks );
+    computeCoefficients();
+    HAD_STAGE_SPLIT( STAGE_TRAINING );
+    HAD_COUNT( stats, COUNTER_TRAINING_FRAMES, 1 );
+    HAD_STATS_MERGE( stats );
 
-    if( _trace )
-    {
-        std::cerr << "mean: B=" << _mean[ 0 ] << " G=" << _mean[ 1 ] << " R=" << _mean[ 2 ] << std::endl;
-        std::cerr << "stddev: B=" << _stddev[ 0 ] << " G=" << _stddev[ 1 ] << " R=" << _stddev[ 2 ] << std::endl;
-        showImage( "lcm mask", mask * 255, 1, 0 );
-    }
-
-    cv::Mat bdist_norm, cdist_norm;
-    computeNormalizedDistortions( image, bdist_norm, cdist_norm );
-
-    selectThresholds( _detection_rate,
-                      bdist_norm,
-                      cdist_norm,
-                      &_threshold_cdist,
-                      &_threshold_bdist_left,
-                      &_threshold_bdist_right
-                    );
+    selectThresholds( chunks );
 }
 
 
-float had::SingleLCM::computeBrightnessDistortion( const cv::Mat& image,
-                                                              int y,
-                                                              int x )
+void had::SingleLCM::computeVariationsRows( const vector<cv::Mat>& chunks,
+                                                  vector<double>&  out_bdist_sums,
+                                                  vector<double>&  out_cdist_sums,
+                                                  int              id_begin,
+                                                  int              id_end )
 {
-    return LCM::computeBrightnessDistortion( image.at<cv::Vec3b>( y, x ),
-                                             _brightness );
-}
-
+    vector<float> bdist( TRAINING_CHUNK );
+    vector<float> cdist_squared( TRAINING_CHUNK );
+    for( int id = id_begin; id < id_end; ++id )
+    {
+        // With variations of 1, the normalized distortions are bdist - 1 and
+        // the squared chromaticity distortion
+        int nb_pixels = chunks[ id ].cols;
+        computeNormalizedDistortionsRow( chunks[ id ], 0, 0, nb_pixels, &bdist[ 0 ], &cdist_squared[ 0 ] );
 
-float had::SingleLCM::computeChromacityDistortion( const cv::Mat& image,
-                                                              int y,
-                                                              int x,
-                                                              float bdist )
-{
-    return LCM::computeChromacityDistortion( image.at<cv::Vec3b>( y, x ),
-                                             _mean,
-                                             _stddev,
-                                             bdist );
+        double bdist_sum = 0;
+        double cdist_sum = 0;
+        for( int x = 0; x < nb_pixels; ++x )
+        {
+            bdist_sum += bdist[ x ] * bdist[ x ];
+            cdist_sum += cdist_squared[ x ];
+        }
+        out_bdist_sums[ id ] = bdist_sum;
+        out_cdist_sums[ id ] = cdist_sum;
+    }
 }
 
 
-void had::SingleLCM::computeVariations( const cv::Mat& image,
-                                                   const cv::Mat& mask )
+void had::SingleLCM::computeVariations( const vector<cv::Mat>& chunks )
 {
     // See Horprasert et al., 1999, Section 4.1
     // See Yacoob and Davis, 2006, Section 2.2
-    CV_Assert( image.type() == CV_8UC3 && mask.type() == CV_8UC1 && image.size() == mask.size() );
+    _bdist_variation = 1;
+    _cdist_variation = 1;
+    computeCoefficients();
 
-    float bdist_variation = 0;
-    float cdist_variation = 0;
+    // The sums are computed per chunk, possibly in parallel, and then added
+    // in the order of the chunks, so that the variations do not depend on the
+    // number of threads.
+    vector<double> bdist_sums( chunks.size(), 0 );
+    vector<double> cdist_sums( chunks.size(), 0 );
+    parallelRows( 0,
+                  chunks.size(),
+                  boost::bind( &SingleLCM::computeVariationsRows,
+                               this,
+                               boost::cref( chunks ),
+                               boost::ref( bdist_sums ),
+                               boost::ref( cdist_sums ),
+                               _1,
+                               _2 ) );
 
+    double bdist_variation = 0;
+    double cdist_variation = 0;
     int nb_pixels = 0;
-    for( int y = 0; y < image.rows; ++y )
+    for( unsigned int id = 0; id < chunks.size(); ++id )
     {
-        for( int x = 0; x < image.cols; ++x )
-        {
-            // Consider only the pixels in the training regions, which is the modification
-            // of Yacoob and Davis, 2006, to the model developed by Horprasert et al., 1999.
-            if( ! mask.at<unsigned char>( y, x ) )
-                continue;
-
-            float bdist_current = computeBrightnessDistortion( image, y, x );
-            float cdist_current = computeChromacityDistortion( image, y, x, bdist_current );
-            bdist_variation += ( bdist_current - 1 ) * ( bdist_current - 1 );
-            cdist_variation += cdist_current * cdist_current;
-            ++nb_pixels;
-        }
+        bdist_variation += bdist_sums[ id ];
+        cdist_variation += cdist_sums[ id ];
+        nb_pixels += chunks[ id ].cols;
     }
 
-    if( nb_pixels > 0 )
-    {
-        // See Horprasert et al., 1999, Eqs. 7 and 8
-        _bdist_variation = sqrt( bdist_variation / (float) nb_pixels );
-        _cdist_variation = sqrt( cdist_variation / (float) nb_pixels );
-    }
-    else
-    {
-        // Set to 1 to avoid error when dividing by these variations
-        _bdist_variation = 1;
-        _cdist_variation = 1;
-    }
+    // See Horprasert et al., 1999, Eqs. 7 and 8
+    _bdist_variation = sqrt( bdist_variation / nb_pixels );
+    _cdist_variation = sqrt( cdist_variation / nb_pixels );
+}
 
-    if( _trace )
+
+void had::SingleLCM::computeCoefficients()
+{
+    // See Horprasert et al., 1999, Section 7
+    // Like the standard deviation, a null variation is replaced by 1 to avoid
+    // a division by zero.
+    float bdist_variation = _bdist_variation != 0 ? _bdist_variation : 1;
+    float cdist_variation = _cdist_variation != 0 ? _cdist_variation : 1;
+
+    for( int id = 0; id < 3; ++id )
     {
-        std::cerr << "nb pixels: " << nb_pixels << " "
-                  << "bdist_var: " << _bdist_variation << " "
-                  << "cdist_var: " << _cdist_variation << " "
-                  << std::endl;
+        float scale = 1.0f / ( (float) _stddev[ id ] * cdist_variation );
+        _coefficients[ COEF_BRIGHTNESS + id ] = _brightness[ id ];
+        _coefficients[ COEF_SCALE + id ] = scale;
+        _coefficients[ COEF_MEAN_SCALED + id ] = (float) _mean[ id ] * scale;
     }
+    _coefficients[ COEF_INV_BDIST_VARIATION ] = 1.0f / bdist_variation;
 }
 
 
 void had::SingleLCM::computeNormalizedDistortions( const vector<cv::Mat>& images,
                                                    cv::Mat& out_bdist_norm,
-                                                   cv::Mat& out_cdist_norm )
+                                                   cv::Mat& out_cdist_norm_squared )
+{
+    computeNormalizedDistortions( images[ 0 ], out_bdist_norm, out_cdist_norm_squared );
+}
+
+
+void had::SingleLCM::classifyRows( const ClassificationBatch& batch,
+                                         int                  y_begin,
+                                         int                  y_end )
+{
+    classifyRowsOf<SingleLCM>( batch, y_begin, y_end );
+}
+
+
+void had::SingleLCM::computeNormalizedDistortionsRow( const cv::Mat& image,
+                                                            int      y,
+                                                            int      x_begin,
+                                                            int      x_end,
+                                                            float*   out_bdist_norm,
+                                                            float*   out_cdist_norm_squared )
 {
-    computeNormalizedDistortions( images[ 0 ], out_bdist_norm, out_cdist_norm );
+    // See Horprasert et al., 1999, Eqs. 5, 6, 9 and 10, with the coefficients
+    // of Section 7. The computations are the same as computeDistortionsPixel().
+    const float* coef = _coefficients;
+    const unsigned char* row_image = image.ptr<unsigned char>( y );
+    for( int x = x_begin; x < x_end; ++x )
+    {
+        float b = row_image[ 3 * x ];
+        float g = row_image[ 3 * x + 1 ];
+        float r = row_image[ 3 * x + 2 ];
+
+        float bdist = b * coef[ COEF_BRIGHTNESS ] + g * coef[ COEF_BRIGHTNESS + 1 ] + r * coef[ COEF_BRIGHTNESS + 2 ];
+        float cb = b * coef[ COEF_SCALE     ] - bdist * coef[ COEF_MEAN_SCALED     ];
+        float cg = g * coef[ COEF_SCALE + 1 ] - bdist * coef[ COEF_MEAN_SCALED + 1 ];
+        float cr = r * coef[ COEF_SCALE + 2 ] - bdist * coef[ COEF_MEAN_SCALED + 2 ];
+
+        out_bdist_norm[ x ] = ( bdist - 1 ) * coef[ COEF_INV_BDIST_VARIATION ];
+        out_cdist_norm_squared[ x ] = cb * cb + cg * cg + cr * cr;
+    }
 }
 
 
 void had::SingleLCM::computeNormalizedDistortions( const cv::Mat& image,
                                                    cv::Mat& out_bdist_norm,
-                                                   cv::Mat& out_cdist_norm )
+                                                   cv::Mat& out_cdist_norm_squared )
 {
     // See Horprasert et al., 1999, Eq. 9 and 10
-   
-    out_bdist_norm = cv::Mat( image.size(), CV_32F );
-    out_cdist_norm = cv::Mat( image.size(), CV_32F );
-    for( int y = 0; y < image.rows; ++y )
+    out_bdist_norm.create( image.size(), CV_32F );
+    out_cdist_norm_squared.create( image.size(), CV_32F );
+    parallelRows( 0,
+                  image.rows,
+                  boost::bind( &SingleLCM::computeNormalizedDistortionsRows,
+                               this,
+                               boost::cref( image ),
+                               boost::ref( out_bdist_norm ),
+                               boost::ref( out_cdist_norm_squared ),
+                               _1,
+                               _2 ) );
+}
+
+
+void had::SingleLCM::buildLookupTable( int nb_bits )
+{
+    CV_Assert( nb_bits >= 1 && nb_bits <= 8 );
+    clearLookupTable();
+
+    // Each row of the table holds the labels of all the values of R for one
+    // pair of values of B and G
+    int nb_values = 1 << nb_bits;
+    _lookup_table = cv::Mat( nb_values * nb_values, nb_values, CV_8UC1 );
+    parallelRows( 0,
+                  _lookup_table.rows,
+                  boost::bind( &SingleLCM::buildLookupTableRows, this, nb_bits, _1, _2 ) );
+    _lookup_bits = nb_bits;
+}
+
+
+void had::SingleLCM::buildLookupTableRows( int nb_bits, int y_begin, int y_end )
+{
+    // The labels are computed like those of an image whose pixels are the
+    // colors at the center of the cells
+    int shift = 8 - nb_bits;
+    int center = ( 1 << shift ) >> 1;
+    cv::Mat colors( 1, _lookup_table.cols, CV_8UC3 );
+    vector<float> bdist_norm( _lookup_table.cols );
+    vector<float> cdist_norm_squared( _lookup_table.cols );
+
+    for( int y = y_begin; y < y_end; ++y )
     {
-        for( int x = 0; x < image.cols; ++x )
+        unsigned char* row_colors = colors.ptr<unsigned char>( 0 );
+        for( int x = 0; x < _lookup_table.cols; ++x )
         {
-            float bdist_current = computeBrightnessDistortion( image, y, x );
-            float cdist_current = computeChromacityDistortion( image, y, x,  bdist_current );
-            out_bdist_norm.at<float>( y, x ) = (bdist_current - 1) / _bdist_variation;
-            out_cdist_norm.at<float>( y, x ) = cdist_current / _cdist_variation;
+            row_colors[ 3 * x     ] = ( ( y >> nb_bits ) << shift ) | center;
+            row_colors[ 3 * x + 1 ] = ( ( y & ( _lookup_table.cols - 1 ) ) << shift ) | center;
+            row_colors[ 3 * x + 2 ] = ( x << shift ) | center;
         }
+        computeNormalizedDistortionsRow( colors, 0, 0, colors.cols, &bdist_norm[ 0 ], &cdist_norm_squared[ 0 ] );
+        labelPixels( &bdist_norm[ 0 ], &cdist_norm_squared[ 0 ], _lookup_table.cols, _lookup_table.ptr<unsigned char>( y ) );
     }
 }
 
+
+void had::SingleLCM::clearLookupTable()
+{
+    _lookup_table = cv::Mat();
+    _lookup_bits = 0;
+}
+
+
+bool had::SingleLCM::lookupLabelsRow( const cv::Mat&       image,
+                                            int            y,
+                                            int            x_begin,
+                                            int            x_end,
+                                            unsigned char* out_labels )
+{
+    if( _lookup_bits == 0 )
+        return false;
+
+    // The index of a color is the concatenation of the high bits of B, G and R
+    int nb_bits = _lookup_bits;
+    int shift = 8 - nb_bits;
+    const unsigned char* table = _lookup_table.ptr<unsigned char>( 0 );
+    const unsigned char* row_image = image.ptr<unsigned char>( y );
+    for( int x = x_begin; x < x_end; ++x )
+    {
+        int b = row_image[ 3 * x     ] >> shift;
+        int g = row_image[ 3 * x + 1 ] >> shift;
+        int r = row_image[ 3 * x + 2 ] >> shift;
+        out_labels[ x ] = table[ ( ( ( b << nb_bits ) | g ) << nb_bits ) | r ];
+    }
+    return true;
+}
+
+
+had::SingleLCM::SingleLCM( const boost::shared_ptr<ModelFile>& file,
+                           ThreadPool*                         pool )
+: LCM( file, pool ), _lookup_bits( 0 )
+{
+    if( file->getHeader().type != MODEL_SINGLE )
+        CV_Error( CV_StsBadArg, "the model file does not hold a SingleLCM" );
+
+    // The model is only a few values, which are copied
+    for( int id = 0; id < 3; ++id )
+    {
+        _mean[ id ]       = file->getBlock( BLOCK_MEAN, 3, cv::Size( 1, 1 ) ).at<cv::Vec3f>( 0, 0 )[ id ];
+        _stddev[ id ]     = file->getBlock( BLOCK_STDDEV, 3, cv::Size( 1, 1 ) ).at<cv::Vec3f>( 0, 0 )[ id ];
+        _brightness[ id ] = file->getBlock( BLOCK_BRIGHTNESS, 3, cv::Size( 1, 1 ) ).at<cv::Vec3f>( 0, 0 )[ id ];
+    }
+    _bdist_variation = file->getBlock( BLOCK_BDIST_VARIATION, 1, cv::Size( 1, 1 ) ).at<float>( 0, 0 );
+    _cdist_variation = file->getBlock( BLOCK_CDIST_VARIATION, 1, cv::Size( 1, 1 ) ).at<float>( 0, 0 );
+    for( int id = 0; id < NB_COEFFICIENTS; ++id )
+        _coefficients[ id ] = file->getBlock( BLOCK_COEFFICIENTS + id, 1, cv::Size( 1, 1 ) ).at<float>( 0, 0 );
+}
+
+
+had::ModelType had::SingleLCM::getModelBlocks( vector<cv::Mat>& out_blocks ) const
+{
+    out_blocks.clear();
+    out_blocks.push_back( cv::Mat( 1, 1, CV_32FC3, _mean ) );
+    out_blocks.push_back( cv::Mat( 1, 1, CV_32FC3, _stddev ) );
+    out_blocks.push_back( cv::Mat( 1, 1, CV_32FC3, _brightness ) );
+    out_blocks.push_back( cv::Mat( 1, 1, CV_32F, cv::Scalar( _bdist_variation ) ) );
+    out_blocks.push_back( cv::Mat( 1, 1, CV_32F, cv::Scalar( _cdist_variation ) ) );
+    for( int id = 0; id < NB_COEFFICIENTS; ++id )
+        out_blocks.push_back( cv::Mat( 1, 1, CV_32F, cv::Scalar( _coefficients[ id ] ) ) );
+    return MODEL_SINGLE;
+}
@@ -14,6 +14,7 @@ using std::string;
 #include <highgui.h>
 
 #include "LCM.hpp"
+#include "DistortionKernels.hpp"
 
 namespace had {
 
@@ -27,7 +28,10 @@ namespace had {
 /* ----------------------------------------------------------------------------*/
 class SingleLCM: public LCM
 {
+    friend class LCM;  // Calls the row functions without virtual dispatch, see LCM::classifyRowsOf().
+
 private:
+    static const int TRAINING_CHUNK = 4096;  //!< Number of training pixels processed together, see gatherPixels().
 
     cv::Scalar _mean;             //!< Mean of the background pixels in the model.
     cv::Scalar _stddev;           //!< Standard deviation of the background pixels in the model.
@@ -35,25 +39,73 @@ private:
     float      _bdist_variation;  //!< Brightness distortion variation
     float      _cdist_variation;  //!< Chromacity distortion variation
 
+    float      _coefficients[ NB_COEFFICIENTS ]; //!< Coefficients used for classification (see DistortionCoefficient).
+
+    cv::Mat    _lookup_table;     //!< Label of each quantized color, empty if not built (see buildLookupTable()).
+    int        _lookup_bits;      //!< Number of bits per channel of the colors in _lookup_table.
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Count the training pixels of each row of a band of rows of the
+    * mask, see gatherPixels().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void countPixelsRows( const cv::Mat&     mask,
+                                vector<int>& out_nb_pixels,
+                                int          y_begin,
+                                int          y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Copy the training pixels of a band of rows, see gatherPixels().
+    *
+    * @param offsets Index in the buffer of the first training pixel of each
+    * row.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void gatherPixelsRows( const cv::Mat&     image,
+                           const cv::Mat&     mask,
+                           const vector<int>& offsets,
+                                 cv::Mat&     out_pixels,
+                                 int          y_begin,
+                                 int          y_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Gather the pixels in the mask, in the order of the image, into a
+    * compact buffer that the training reads instead of the image.
+    * 
+    * @param image Input image (8-bit 3-channel image, CV_8UC3).
+    * @param mask Input mask (8-bit 1-channel image, CV_8UC1), which must hold
+    * at least one training pixel.
+    * @param out_pixels Training pixels (1-row 8-bit 3-channel image, CV_8UC3).
+    * @param out_chunks Views of the consecutive chunks of TRAINING_CHUNK
+    * pixels of out_pixels, the last one possibly shorter, which are
+    * processed in parallel like the rows of an image.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void gatherPixels( const cv::Mat&          image,
+                       const cv::Mat&          mask,
+                             cv::Mat&          out_pixels,
+                             vector<cv::Mat>&  out_chunks );
+
     /* ----------------------------------------------------------------------------*/
     /** 
-    * @brief Compute the mean and standard deviation of an image, only using
-    * the pixels in the mask.
+    * @brief Compute the mean and standard deviation of the training pixels.
     *
     * See Horprasert et al., 1999, Sections 4.1 and 7
     * See Horprasert et al., 1999, Eq. 4
     * 
-    * @param image Input image (8-bit 3-channel image, CV_8UC3).
-    * @param mask Input mask (8-bit 1-channel image, CV_8UC1).
+    * @param pixels Training pixels, see gatherPixels().
     */
     /* ----------------------------------------------------------------------------*/
-    void computeModelMeanStdDev( const cv::Mat& image,
-                                 const cv::Mat& mask );
+    void computeModelMeanStdDev( const cv::Mat& pixels );
 
     /* ----------------------------------------------------------------------------*/
     /** 
     * @brief Compute the Lambertain Color Model based on an image and using only the
-    * pixels in the mask as training background pixels.
+    * pixels in the mask as training background pixels. The thresholds are
+    * selected on the training pixels too.
     *
     * See Horprasert et al., 1999, Section 4.1
     * 
@@ -66,35 +118,80 @@ private:
 
     /* ----------------------------------------------------------------------------*/
     /** 
-    * @brief Compute the variations of the brightness and chromaticity distributions.
+    * @brief Compute the variations of the brightness and chromaticity
+    * distributions of the training pixels, once the mean, standard deviation
+    * and brightness are known.
     *
     * See Horprasert et al., 1999, Section 4.1
     * See Yacoob and Davis, 2006, Section 2.2
     * 
-    * @param image Input image (8-bit 3-channel image, CV_8UC3).
-    * @param mask Input mask (8-bit 1-channel image, CV_8UC1).
+    * @param chunks Chunks of the training pixels, see gatherPixels().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computeVariations( const vector<cv::Mat>& chunks );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Compute the sums of squared distortions of a range of chunks, see
+    * computeVariations().
+    * 
+    * @param chunks Chunks of the training pixels, see gatherPixels().
+    * @param out_bdist_sums Sum of the squared brightness distortions of each chunk.
+    * @param out_cdist_sums Sum of the squared chromaticity distortions of each chunk.
+    * @param id_begin First chunk of the range.
+    * @param id_end Chunk after the last chunk of the range.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void computeVariationsRows( const vector<cv::Mat>& chunks,
+                                      vector<double>&  out_bdist_sums,
+                                      vector<double>&  out_cdist_sums,
+                                      int              id_begin,
+                                      int              id_end );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Bake the coefficients used for classification from the mean, standard
+    * deviation, brightness and variations of the model.
+    *
+    * See Horprasert et al., 1999, Section 7
     */
     /* ----------------------------------------------------------------------------*/
-    void computeVariations( const cv::Mat& image,
-                            const cv::Mat& mask );
+    void computeCoefficients();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Compute a band of rows of the lookup table, see buildLookupTable().
+    */
+    /* ----------------------------------------------------------------------------*/
+    void buildLookupTableRows( int nb_bits, int y_begin, int y_end );
 
     virtual void computeNormalizedDistortions( const cv::Mat& image,
                                                      cv::Mat& out_bdist_norm,
-                                                     cv::Mat& out_cdist_norm );
+                                                     cv::Mat& out_cdist_norm_squared );
 
     virtual void computeNormalizedDistortions( const vector<cv::Mat>& image,
                                                      cv::Mat& out_bdist_norm,
-                                                     cv::Mat& out_cdist_norm );
+                                                     cv::Mat& out_cdist_norm_squared );
 
 protected:
-    virtual float computeBrightnessDistortion( const cv::Mat& image,
-                                               int y,
-                                               int x );
-
-    virtual float computeChromacityDistortion( const cv::Mat& image,
-                                               int y,
-                                               int x,
-                                               float bdist );
+    virtual ModelType getModelBlocks( vector<cv::Mat>& out_blocks ) const;
+
+    virtual void classifyRows( const ClassificationBatch& batch,
+                                     int                  y_begin,
+                                     int                  y_end );
+
+    virtual void computeNormalizedDistortionsRow( const cv::Mat& image,
+                                                        int      y,
+                                                        int      x_begin,
+                                                        int      x_end,
+                                                        float*   out_bdist_norm,
+                                                        float*   out_cdist_norm_squared );
+
+    virtual bool lookupLabelsRow( const cv::Mat&       image,
+                                        int            y,
+                                        int            x_begin,
+                                        int            x_end,
+                                        unsigned char* out_labels );
 public:
     /* ----------------------------------------------------------------------------*/
     /** 
@@ -104,13 +201,15 @@ public:
     * @param detection_rate Detection rate (ex: 95% is .95).
     * @param regions Vector of rectangles used to indicate which areas are used
     * as training background pixels.
+    * @param pool Thread pool used to train and classify by bands of rows
+    * (NULL to use the calling thread only).
     */
     /* ----------------------------------------------------------------------------*/
     SingleLCM( const cv::Mat&          image, 
                const float             detection_rate,
                const vector<cv::Rect>& regions,
-               const bool              trace = false )
-    : LCM( detection_rate, trace )
+               ThreadPool*             pool = NULL )
+    : LCM( detection_rate, pool ), _lookup_bits( 0 )
     {
         cv::Mat mask( image.size(), CV_8UC1, cv::Scalar( 0 ) );
         fillRectangles( mask, regions, cv::Scalar( 1 ) );
@@ -125,23 +224,70 @@ public:
     * @param detection_rate Detection rate (ex: 95% is .95).
     * @param mask Mask used to indicate which pixels are used as training
     * background pixels (8-bit 1-channel image, CV_8UC1).
+    * @param pool Thread pool used to train and classify by bands of rows
+    * (NULL to use the calling thread only).
     */
     /* ----------------------------------------------------------------------------*/
     SingleLCM( const cv::Mat& image, 
                const float    detection_rate,
                const cv::Mat& mask,
-               const bool     trace = false )
-    : LCM( detection_rate, trace )
+               ThreadPool*    pool = NULL )
+    : LCM( detection_rate, pool ), _lookup_bits( 0 )
     {
         computeModel( image, mask );
     }
 
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Constructor of a model loaded from a file, see LCM::load().
+    * 
+    * @param file Model file, of type MODEL_SINGLE.
+    * @param pool Thread pool used to classify by bands of rows (NULL to use
+    * the calling thread only).
+    */
+    /* ----------------------------------------------------------------------------*/
+    SingleLCM( const boost::shared_ptr<ModelFile>& file,
+               ThreadPool*                         pool = NULL );
+
     /* ----------------------------------------------------------------------------*/
     /** 
     * @brief Destructor.
     */
     /* ----------------------------------------------------------------------------*/
     virtual ~SingleLCM() {}
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Precompute the labels of all the colors, so that classify() only
+    * looks up the label of each pixel.
+    *
+    * The model is the same for all the pixels, so the label of a pixel only
+    * depends on its color. With 8 bits per channel, the table holds the 2^24
+    * colors (16 MB) and gives exactly the same labels as the distortions.
+    * With fewer bits, the colors are quantized: each cell of the table holds
+    * the label of the color at its center, and the table is 2^( 3 * nb_bits )
+    * bytes, small enough to stay in the cache (32 KB with 5 bits).
+    * 
+    * @param nb_bits Number of bits per channel, from 1 to 8.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void buildLookupTable( int nb_bits = 8 );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Release the lookup table, so that classify() computes the
+    * distortions again.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void clearLookupTable();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the number of bits per channel of the lookup table, or 0 if it
+    * has not been built.
+    */
+    /* ----------------------------------------------------------------------------*/
+    int getLookupTableBits() const { return _lookup_bits; }
 };
 
 }
@@ -0,0 +1,209 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include <highgui.h>
+
+#include "StreamService.hpp"
+
+had::StreamService::StreamService( ThreadPool*           pool,
+                                   const ResultCallback& callback,
+                                   int                   capacity )
+: _pool( pool ), _callback( callback ), _capacity( capacity > 0 ? capacity : 1 ), _nb_running( 0 )
+{
+    CV_Assert( pool != NULL );
+}
+
+
+had::StreamService::~StreamService()
+{
+    vector<string> ids = getStreamIds();
+    for( unsigned int id = 0; id < ids.size(); ++id )
+        removeStream( ids[ id ] );
+
+    boost::mutex::scoped_lock lock( _mutex );
+    while( _nb_running > 0 )
+        _idle.wait( lock );
+}
+
+
+void had::StreamService::addStream( const string& id, const boost::shared_ptr<LCM>& lcm )
+{
+    CV_Assert( lcm );
+    StreamPtr stream( new Stream );
+    stream->id = id;
+    stream->lcm = lcm;
+    stream->busy = false;
+    stream->removed = false;
+    stream->nb_classified = 0;
+    stream->nb_dropped = 0;
+
+    boost::mutex::scoped_lock lock( _mutex );
+    CV_Assert( _streams.find( id ) == _streams.end() );
+    _streams[ id ] = stream;
+}
+
+
+bool had::StreamService::removeStream( const string& id )
+{
+    StreamPtr stream;
+    std::deque<Frame> dropped;
+    {
+        boost::mutex::scoped_lock lock( _mutex );
+        StreamMap::iterator found = _streams.find( id );
+        if( found == _streams.end() )
+            return false;
+
+        stream = found->second;
+        _streams.erase( found );
+        stream->removed = true;
+        stream->nb_dropped += stream->frames.size();
+        dropped.swap( stream->frames );
+        _ready.erase( std::remove( _ready.begin(), _ready.end(), stream ), _ready.end() );
+        _idle.notify_all();
+    }
+
+    // The callback is called without the lock, so that it can use the service
+    for( unsigned int id_frame = 0; id_frame < dropped.size(); ++id_frame )
+        notify( id, dropped[ id_frame ], cv::Mat() );
+    return true;
+}
+
+
+bool had::StreamService::hasStream( const string& id )
+{
+    boost::mutex::scoped_lock lock( _mutex );
+    return _streams.find( id ) != _streams.end();
+}
+
+
+vector<string> had::StreamService::getStreamIds()
+{
+    boost::mutex::scoped_lock lock( _mutex );
+    vector<string> ids;
+    for( StreamMap::const_iterator stream = _streams.begin(); stream != _streams.end(); ++stream )
+        ids.push_back( stream->first );
+    return ids;
+}
+
+
+bool had::StreamService::submit( const string& id, const Frame& frame )
+{
+    Frame dropped;
+    bool drop = false;
+    {
+        boost::mutex::scoped_lock lock( _mutex );
+        StreamMap::iterator found = _streams.find( id );
+        if( found == _streams.end() )
+            return false;
+
+        // A stream is in the ready queue if it is not busy and has frames
+        Stream& stream = *found->second;
+        if( stream.frames.size() >= _capacity )
+        {
+            dropped = stream.frames.front();
+            stream.frames.pop_front();
+            ++stream.nb_dropped;
+            drop = true;
+        }
+        else if( stream.frames.empty() && ! stream.busy )
+        {
+            _ready.push_back( found->second );
+        }
+        stream.frames.push_back( frame );
+        dispatch();
+    }
+
+    if( drop )
+        notify( id, dropped, cv::Mat() );
+    return true;
+}
+
+
+void had::StreamService::dispatch()
+{
+    while( _nb_running < _pool->getNbThreads() && ! _ready.empty() )
+    {
+        StreamPtr stream = _ready.front();
+        _ready.pop_front();
+        if( stream->removed || stream->frames.empty() )
+            continue;
+
+        Frame frame = stream->frames.front();
+        stream->frames.pop_front();
+        stream->busy = true;
+        ++_nb_running;
+        _pool->submit( boost::bind( &StreamService::classifyNext, this, stream, frame ) );
+    }
+}
+
+
+void had::StreamService::classifyNext( StreamPtr stream, Frame frame )
+{
+    // The errors of a frame, like a size that does not match the model, only
+    // drop this frame
+    cv::Mat classification;
+    try
+    {
+        if( frame.image.empty() && ! frame.name.empty() )
+            frame.image = cv::imread( frame.name );
+        if( ! frame.image.empty() )
+            stream->lcm->classify( frame.image, classification );
+    }
+    catch( ... )
+    {
+        classification = cv::Mat();
+    }
+    notify( stream->id, frame, classification );
+
+    boost::mutex::scoped_lock lock( _mutex );
+    if( classification.empty() )
+        ++stream->nb_dropped;
+    else
+        ++stream->nb_classified;
+
+    // The stream goes behind the other ready streams
+    stream->busy = false;
+    if( ! stream->removed && ! stream->frames.empty() )
+        _ready.push_back( stream );
+    --_nb_running;
+    dispatch();
+    _idle.notify_all();
+}
+
+
+void had::StreamService::notify( const string& id, const Frame& frame, const cv::Mat& classification )
+{
+    // An exception must neither end the thread of the pool nor skip the
+    // bookkeeping of classifyNext(), which would leave wait() blocked
+    try
+    {
+        _callback( id, frame, classification );
+    }
+    catch( ... )
+    {
+    }
+}
+
+
+void had::StreamService::wait()
+{
+    boost::mutex::scoped_lock lock( _mutex );
+    while( _nb_running > 0 || ! _ready.empty() )
+        _idle.wait( lock );
+}
+
+
+bool had::StreamService::getCounters( const string& id, long long* out_nb_classified, long long* out_nb_dropped )
+{
+    boost::mutex::scoped_lock lock( _mutex );
+    StreamMap::iterator found = _streams.find( id );
+    if( found == _streams.end() )
+        return false;
+
+    *out_nb_classified = found->second->nb_classified;
+    *out_nb_dropped = found->second->nb_dropped;
+    return true;
+}
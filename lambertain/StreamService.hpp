@@ -0,0 +1,230 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_STREAM_SERVICE_HPP
+#define HAD_STREAM_SERVICE_HPP
+
+#include <deque>
+#include <map>
+#include <vector>
+using std::vector;
+#include <string>
+using std::string;
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <cv.h>
+
+#include "LCM.hpp"
+#include "ThreadPool.hpp"
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Classifier of the frames of many streams (ex: cameras), each one
+* with its own model, on a shared thread pool.
+*
+* Each stream has a queue of frames waiting to be classified. The streams
+* that have frames waiting are served in turn, one frame at a time: a stream
+* that has just been served goes behind all the others, so a busy stream
+* cannot delay the others by more than one frame per thread. The frames of a
+* stream are classified one after the other, in the order they were
+* submitted, so that a model which updates itself (see
+* MultipleLCM::setUpdateRate()) sees them in order; the frames of different
+* streams are classified in parallel, one per thread of the pool.
+*
+* The queues are bounded: when a frame is submitted to a full queue, the
+* oldest frame of the queue is dropped, so that a stream that cannot be
+* classified as fast as its frames arrive keeps up with the most recent ones.
+* Streams can be added and removed at any time.
+*/
+/* ----------------------------------------------------------------------------*/
+class StreamService
+{
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Frame of a stream.
+    */
+    /* ----------------------------------------------------------------------------*/
+    struct Frame
+    {
+        int     index;  //!< Index of the frame, chosen by the caller.
+        string  name;   //!< File of the frame, decoded by the thread that classifies it if image is empty.
+        cv::Mat image;  //!< Frame (8-bit 3-channel image, CV_8UC3).
+    };
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Function called once for each submitted frame, from the thread
+    * that classified it, with the stream, the frame, and its classification
+    * (8-bit 1-channel image, CV_8UC1). The classification is empty if the
+    * frame was dropped, if the stream was removed before it was classified,
+    * or if it could not be decoded or classified.
+    *
+    * The callback must not throw: it is called without the mutex of the
+    * service, and its exceptions are caught and ignored, so that the frame is
+    * still counted and the stream served again.
+    */
+    /* ----------------------------------------------------------------------------*/
+    typedef boost::function<void ( const string&, const Frame&, const cv::Mat& )> ResultCallback;
+
+private:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Model and queue of a stream.
+    */
+    /* ----------------------------------------------------------------------------*/
+    struct Stream
+    {
+        string                 id;              //!< Identifier of the stream.
+        boost::shared_ptr<LCM> lcm;             //!< Model of the stream.
+        std::deque<Frame>      frames;          //!< Frames waiting to be classified.
+        bool                   busy;            //!< True while a frame of the stream is classified.
+        bool                   removed;         //!< True once the stream has been removed.
+        long long              nb_classified;   //!< Number of frames classified.
+        long long              nb_dropped;      //!< Number of frames dropped, or that could not be decoded or classified.
+    };
+
+    typedef boost::shared_ptr<Stream>     StreamPtr;
+    typedef std::map<string, StreamPtr>   StreamMap;
+
+    ThreadPool*               _pool;          //!< Pool of the threads that classify the frames (not owned).
+    ResultCallback            _callback;      //!< Function called with the result of each frame.
+    size_t                    _capacity;      //!< Maximum number of frames waiting in the queue of a stream.
+    StreamMap                 _streams;       //!< Streams, by identifier.
+    std::deque<StreamPtr>     _ready;         //!< Streams that have frames waiting and are not busy, in the order they are served.
+    int                       _nb_running;    //!< Number of frames being classified.
+    boost::mutex              _mutex;         //!< Protects all the members above, and the streams.
+    boost::condition_variable _idle;          //!< Signaled when a frame has been classified.
+
+    StreamService( const StreamService& );
+    StreamService& operator=( const StreamService& );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Start classifying the frames of the ready streams, up to one per
+    * thread of the pool. Called with the mutex locked.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void dispatch();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Classify a frame of a stream, in a thread of the pool, and then
+    * let the stream be served again.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void classifyNext( StreamPtr stream, Frame frame );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Call the callback with the result of a frame, ignoring its
+    * exceptions. Called without the mutex locked.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void notify( const string& id, const Frame& frame, const cv::Mat& classification );
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Constructor.
+    *
+    * @param pool Pool of the threads that classify the frames, which must
+    * outlive the service. The models usually do not have a thread pool, so
+    * that each frame is classified by a single thread.
+    * @param callback Function called with the result of each frame.
+    * @param capacity Maximum number of frames waiting in the queue of a
+    * stream.
+    */
+    /* ----------------------------------------------------------------------------*/
+    StreamService( ThreadPool*           pool,
+                   const ResultCallback& callback,
+                   int                   capacity = 4 );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Destructor, which waits for the frames being classified, and
+    * drops the others.
+    */
+    /* ----------------------------------------------------------------------------*/
+    ~StreamService();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Add a stream.
+    *
+    * The models of the streams are distinct objects, as they are used in
+    * parallel. The models loaded from the same file share the memory of its
+    * planes (see LCM::load()).
+    *
+    * @param id Identifier of the stream, which must not be used by another
+    * stream.
+    * @param lcm Model of the stream.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void addStream( const string& id, const boost::shared_ptr<LCM>& lcm );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Remove a stream. Its frames waiting in the queue are dropped, and
+    * the result of the frame being classified, if any, is still given to the
+    * callback.
+    *
+    * @return False if there is no such stream, true otherwise.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool removeStream( const string& id );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Check whether a stream exists.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool hasStream( const string& id );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the identifiers of the streams.
+    */
+    /* ----------------------------------------------------------------------------*/
+    vector<string> getStreamIds();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Queue a frame of a stream, and return without waiting for its
+    * classification.
+    *
+    * @param id Identifier of the stream.
+    * @param frame Frame, whose image or file is of the size of the model.
+    *
+    * @return False if there is no such stream, in which case the frame is
+    * ignored, true otherwise.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool submit( const string& id, const Frame& frame );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Wait until all the frames submitted so far have been classified.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void wait();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the number of frames of a stream classified, and the number
+    * of frames dropped or that could not be classified.
+    *
+    * @return False if there is no such stream, true otherwise.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool getCounters( const string& id, long long* out_nb_classified, long long* out_nb_dropped );
+};
+
+}
+
+#endif // HAD_STREAM_SERVICE_HPP
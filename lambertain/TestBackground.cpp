@@ -3,6 +3,12 @@
 #include <iostream>
 #include <vector>
 using std::vector;
+#include <string>
+using std::string;
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 #include "cv.h"
 #include "highgui.h"
@@ -10,11 +16,366 @@ using std::vector;
 #include "had.h"
 
 
+// Frame, or classification of a frame, moving through the streaming pipeline
+struct Frame
+{
+    int     index;
+    cv::Mat image;
+};
+
+typedef had::BoundedQueue<Frame> FrameQueue;
+
+
+void decodeFrames( had::FrameSource* source, FrameQueue* out_frames )
+{
+    Frame frame;
+    frame.index = 0;
+    while( source->read( frame.image ) )
+    {
+        if( ! out_frames->push( frame ) )
+            break;
+        ++frame.index;
+    }
+    out_frames->close();
+}
+
+
+// Classify the frames with the model, or only their tiles that changed if
+// an incremental classifier is given, or coarse to fine if a pyramid
+// classifier is given
+void classifyFrames( had::LCM* lcm, had::IncrementalClassifier* incremental, had::PyramidClassifier* pyramid, FrameQueue* in_frames, FrameQueue* out_classifications )
+{
+    Frame frame, classification;
+    while( in_frames->pop( frame ) )
+    {
+        classification.index = frame.index;
+        classification.image = cv::Mat();
+        if( incremental )
+            incremental->classify( frame.image, classification.image );
+        else if( pyramid )
+            pyramid->classify( frame.image, classification.image );
+        else
+            lcm->classify( frame.image, classification.image );
+        if( ! out_classifications->push( classification ) )
+            break;
+    }
+    in_frames->close();
+    out_classifications->close();
+}
+
+
+// Write the classifications as images, or into a label file if one is given
+void encodeFrames( had::LCM* lcm, const string* output, int label_encoding, FrameQueue* in_classifications, int* out_nb_frames )
+{
+    // The label file is created with the size of the first classification
+    boost::scoped_ptr<had::LabelWriter> labels;
+    Frame classification;
+    cv::Mat image_classification;
+    while( in_classifications->pop( classification ) )
+    {
+        if( label_encoding >= 0 )
+        {
+            if( ! labels )
+                labels.reset( new had::LabelWriter( *output, classification.image.size(), label_encoding ) );
+            labels->write( classification.image );
+        }
+        else
+        {
+            lcm->classificationToImage( classification.image, image_classification );
+            cv::imwrite( had::FrameSource::formatSequence( *output, classification.index ), image_classification );
+        }
+        ++(*out_nb_frames);
+    }
+
+    if( labels )
+        std::cout << "Label file: " << *output << ", " << labels->getNbBytes() << " bytes" << std::endl;
+}
+
+
+// Options given before the mode and the positional arguments
+struct Options
+{
+    boost::scoped_ptr<had::ThreadPool> pool;    // Pool used to train and classify by bands of rows, if any
+    string                             load;    // Model file to load instead of training, if any
+    string                             save;    // Model file to save after training, if any
+    float                              update;  // Learning rate of the update of the model by the classification
+    string                             type;    // Kind of model trained: "multiple", "global" or "quantized"
+    int                                tolerance; // Tolerance of the change test of the tiles of a stream, -1 to classify all the tiles
+    int                                pyramid; // Reduction factor of the coarse frames of a stream, 1 to classify at full resolution only
+    int                                labels;  // Encoding of the label file of a stream (see had::LabelEncoding)
+};
+
+
+// Train a model online, so that the training frames are never all in memory.
+// The inputs are images, directories, wildcard patterns, image sequences or
+// videos, which are decoded in parallel while the model is trained.
+template<class Model>
+Model* trainModel( const Options& options, float detection_rate, int argc, char** argv, int first_arg )
+{
+    // Maximum number of training frames kept to select the thresholds
+    const int nb_threshold_frames = 32;
+
+    for( int i = first_arg; i < argc; ++i )
+        std::cout << "Training input: " << argv[ i ] << std::endl;
+
+    Model* lcm = new Model( detection_rate, nb_threshold_frames, options.pool.get() );
+    had::FrameLoader loader( vector<string>( argv + first_arg, argv + argc ) );
+    int nb_frames = 0;
+    cv::Mat image;
+    while( loader.read( image ) )
+    {
+        lcm->addFrame( image );
+        ++nb_frames;
+    }
+
+    if( nb_frames == 0 )
+    {
+        std::cerr << "ERROR: no training frames!" << std::endl;
+        exit( 1 );
+    }
+    std::cout << "Training frames: " << nb_frames << std::endl;
+    lcm->finalize();
+    return lcm;
+}
+
+
+// Train a model, or load it from a model file
+had::LCM* createModel( const Options& options, float detection_rate, int argc, char** argv, int first_arg )
+{
+    had::LCM* lcm = NULL;
+    if( ! options.load.empty() )
+    {
+        std::cout << "Model: " << options.load << std::endl;
+        lcm = had::LCM::load( options.load, options.pool.get() );
+    }
+    else if( options.type == "global" )
+    {
+        std::cout << "Model: global variance" << std::endl;
+        lcm = trainModel<had::GlobalVarianceLCM>( options, detection_rate, argc, argv, first_arg );
+    }
+    else if( options.type == "quantized" )
+    {
+        std::cout << "Model: quantized" << std::endl;
+        boost::scoped_ptr<had::MultipleLCM> lcm_float( trainModel<had::MultipleLCM>( options, detection_rate, argc, argv, first_arg ) );
+        lcm = new had::QuantizedLCM( *lcm_float, options.pool.get() );
+    }
+    else
+    {
+        lcm = trainModel<had::MultipleLCM>( options, detection_rate, argc, argv, first_arg );
+    }
+
+    if( ! options.save.empty() )
+    {
+        std::cout << "Saving model: " << options.save << std::endl;
+        lcm->save( options.save );
+    }
+
+    if( options.update > 0 )
+    {
+        had::MultipleLCM* lcm_multiple = dynamic_cast<had::MultipleLCM*>( lcm );
+        if( ! lcm_multiple )
+        {
+            std::cerr << "ERROR: only a multiple image model can be updated!" << std::endl;
+            exit( 1 );
+        }
+        std::cout << "Update rate: " << options.update << std::endl;
+        lcm_multiple->setUpdateRate( options.update );
+    }
+    return lcm;
+}
+
+
+int runStream( int argc, char** argv, const Options& options )
+{
+    // Maximum number of frames waiting between two stages of the pipeline
+    const int queue_capacity = 4;
+
+    float detection_rate = atof( argv[ 2 ] );
+    std::cout << "Detection rate: " << detection_rate << std::endl;
+
+    // The classifications are written into a label file if the output is
+    // one, or as images otherwise
+    string output = argv[ 3 ];
+    bool to_labels = output.size() > 4 && output.compare( output.size() - 4, 4, ".lbl" ) == 0;
+    if( ! to_labels && ! had::FrameSource::isSequencePattern( output ) )
+    {
+        std::cerr << "ERROR: the output must be an image sequence pattern, ex: out/class%04d.jpg, or a label file, ex: out/labels.lbl" << std::endl;
+        return 1;
+    }
+
+    had::FrameSource source( argv[ 4 ] );
+    if( ! source.isOpened() )
+    {
+        std::cerr << "ERROR: cannot open the input stream " << argv[ 4 ] << std::endl;
+        return 1;
+    }
+    std::cout << "Input stream: " << argv[ 4 ] << std::endl;
+
+    // The model is trained only once, and then used for all the frames
+    boost::scoped_ptr<had::LCM> lcm( createModel( options, detection_rate, argc, argv, 5 ) );
+    boost::scoped_ptr<had::IncrementalClassifier> incremental;
+    if( options.tolerance >= 0 )
+        incremental.reset( new had::IncrementalClassifier( lcm.get(), options.tolerance ) );
+
+    // The coarse model is reduced from the full one, trained or loaded
+    boost::scoped_ptr<had::LCM> lcm_coarse;
+    boost::scoped_ptr<had::PyramidClassifier> pyramid;
+    if( options.pyramid > 1 )
+    {
+        had::MultipleLCM* lcm_multiple = dynamic_cast<had::MultipleLCM*>( lcm.get() );
+        if( ! lcm_multiple || options.pyramid > had::PyramidClassifier::MAX_FACTOR )
+        {
+            std::cerr << "ERROR: the pyramid needs a multiple image model and a factor up to " << had::PyramidClassifier::MAX_FACTOR << "!" << std::endl;
+            return 1;
+        }
+        std::cout << "Pyramid factor: " << options.pyramid << std::endl;
+        lcm_coarse.reset( new had::MultipleLCM( *lcm_multiple, options.pyramid, options.pool.get() ) );
+        pyramid.reset( new had::PyramidClassifier( lcm.get(), lcm_coarse.get(), options.pyramid ) );
+    }
+
+    // Decoding, classification and encoding run as overlapping stages
+    FrameQueue frames( queue_capacity );
+    FrameQueue classifications( queue_capacity );
+    int nb_frames = 0;
+
+    double time_start = (double) cv::getTickCount();
+    boost::thread thread_decode( boost::bind( &decodeFrames, &source, &frames ) );
+    boost::thread thread_classify( boost::bind( &classifyFrames, lcm.get(), incremental.get(), pyramid.get(), &frames, &classifications ) );
+    encodeFrames( lcm.get(), &output, to_labels ? options.labels : -1, &classifications, &nb_frames );
+    thread_classify.join();
+    thread_decode.join();
+    double seconds = ( (double) cv::getTickCount() - time_start ) / cv::getTickFrequency();
+
+    std::cout << "Frames: " << nb_frames << " | "
+              << "Time: " << seconds << " s | "
+              << "Throughput: " << ( seconds > 0 ? nb_frames / seconds : 0 ) << " frames/s"
+              << std::endl;
+    if( incremental )
+        std::cout << "Skipped tiles: " << 100 * incremental->getSkippedRatio() << "%" << std::endl;
+    if( pyramid )
+        std::cout << "Refined blocks: " << 100 * pyramid->getRefinedRatio() << "%" << std::endl;
+    if( had::StageStats::isEnabled() )
+        lcm->getStats().print( std::cout );
+    std::cout << "Blue: foreground, Green: background, Red: shadow, Black: highlight" << std::endl;
+
+    return 0;
+}
+
+
 int main(int argc, char** argv)
 {
+    // Options, each one followed by its value:
+    //  --threads: number of threads used to train and classify by bands of
+    //    rows, 0 for one thread per core. Without it, everything runs in the
+    //    calling thread.
+    //  --load-model: model file to use instead of training a model.
+    //  --save-model: file in which the trained model is saved.
+    //  --update-rate: learning rate with which the background pixels of the
+    //    classified frames update the model, so that it follows slow lighting
+    //    changes in a stream.
+    //  --model-type: "multiple" (default) for a standard deviation and
+    //    variations per pixel, "global" for a single one for the whole image,
+    //    which is smaller and faster, but less accurate, "quantized" for a
+    //    multiple model stored in 16-bit fixed point.
+    //  --change-tolerance: in "--stream" mode, only classify again the tiles
+    //    of a frame whose mean absolute difference with the frame they were
+    //    last classified from is above this tolerance (ex: 8), and keep the
+    //    labels of the others.
+    //  --pyramid: in "--stream" mode, classify the frames reduced by this
+    //    factor (ex: 4) with a model reduced the same way, and classify at
+    //    full resolution only the blocks near the boundaries between labels.
+    //  --label-encoding: in "--stream" mode with a label file as output,
+    //    "packed" for two bits per label, "rle" for runs of labels, or "auto"
+    //    (default) for the smallest of both, frame by frame.
+    Options options;
+    options.update = 0;
+    options.type = "multiple";
+    options.tolerance = -1;
+    options.pyramid = 1;
+    options.labels = had::LABELS_AUTO;
+    while( argc >= 3 && string( argv[ 1 ] ).compare( 0, 2, "--" ) == 0 && string( argv[ 1 ] ) != "--stream" )
+    {
+        string option = argv[ 1 ];
+        if( option == "--threads" )
+        {
+            options.pool.reset( new had::ThreadPool( atoi( argv[ 2 ] ) ) );
+            std::cout << "Threads: " << options.pool->getNbThreads() << std::endl;
+        }
+        else if( option == "--load-model" )
+        {
+            options.load = argv[ 2 ];
+        }
+        else if( option == "--save-model" )
+        {
+            options.save = argv[ 2 ];
+        }
+        else if( option == "--update-rate" )
+        {
+            options.update = atof( argv[ 2 ] );
+        }
+        else if( option == "--model-type" )
+        {
+            options.type = argv[ 2 ];
+            if( options.type != "multiple" && options.type != "global" && options.type != "quantized" )
+            {
+                std::cerr << "ERROR: unknown model type " << options.type << std::endl;
+                exit( 1 );
+            }
+        }
+        else if( option == "--change-tolerance" )
+        {
+            options.tolerance = atoi( argv[ 2 ] );
+        }
+        else if( option == "--pyramid" )
+        {
+            options.pyramid = atoi( argv[ 2 ] );
+        }
+        else if( option == "--label-encoding" )
+        {
+            string encoding = argv[ 2 ];
+            if( encoding == "auto" )
+                options.labels = had::LABELS_AUTO;
+            else if( encoding == "packed" )
+                options.labels = had::LABELS_PACKED;
+            else if( encoding == "rle" )
+                options.labels = had::LABELS_RLE;
+            else
+            {
+                std::cerr << "ERROR: unknown label encoding " << encoding << std::endl;
+                exit( 1 );
+            }
+        }
+        else
+        {
+            std::cerr << "ERROR: unknown option " << option << std::endl;
+            exit( 1 );
+        }
+        argv[ 2 ] = argv[ 0 ];
+        argv += 2;
+        argc -= 2;
+    }
+
+    if( options.tolerance >= 0 && options.pyramid > 1 )
+    {
+        std::cerr << "ERROR: --change-tolerance and --pyramid cannot be combined!" << std::endl;
+        exit( 1 );
+    }
+
+    if( argc >= 2 && string( argv[ 1 ] ) == "--stream" )
+    {
+        if( argc < 5 )
+        {
+            std::cout << "usage: " << argv[0] << " [options] --stream " << "detection_rate out_pattern%04d.jpg|out_labels.lbl input_video_or_pattern%d.jpg training_image01.jpg training_directory training_video_or_pattern%d.jpg ..." << std::endl;
+            exit( 0 );
+        }
+        return runStream( argc, argv, options );
+    }
+
     if( argc < 4 )
     {
-        std::cout << "usage: " << argv[0] << " " << "detection_rate out_segmentation.jpg test_image.jpg training_image01.jpg training_image02.jpg ..." << std::endl;
+        std::cout << "usage: " << argv[0] << " " << "[options] detection_rate out_segmentation.jpg test_image.jpg training_image01.jpg training_directory training_video_or_pattern%d.jpg ..." << std::endl;
+        std::cout << "       " << argv[0] << " [options] --stream " << "detection_rate out_pattern%04d.jpg|out_labels.lbl input_video_or_pattern%d.jpg training_image01.jpg training_directory training_video_or_pattern%d.jpg ..." << std::endl;
+        std::cout << "options: --threads nb_threads | --save-model model.lcm | --load-model model.lcm (no training images needed) | --update-rate rate | --model-type multiple|global|quantized | --change-tolerance tolerance (with --stream) | --pyramid factor (with --stream) | --label-encoding auto|packed|rle (with --stream)" << std::endl;
         exit( 0 );
     }
 
@@ -24,18 +385,11 @@ int main(int argc, char** argv)
     cv::Mat image_test = cv::imread( argv[ 3 ] );
     std::cout << "Test image: " << argv[ 3 ] << std::endl;
 
-    vector<cv::Mat> images_training;
-    for( int i = 4; i < argc; ++i )
-    {
-        std::cout << "Training image: " << argv[ i ] << std::endl;
-        images_training.push_back( cv::imread( argv[ i ] ) );
-    }
-
-    had::MultipleLCM lcm( images_training, detection_rate );
+    boost::scoped_ptr<had::LCM> lcm( createModel( options, detection_rate, argc, argv, 4 ) );
 
     cv::Mat classification, image_classification;
-    lcm.classify( image_test, classification );
-    lcm.classificationToImage( classification, image_classification );
+    lcm->classify( image_test, classification );
+    lcm->classificationToImage( classification, image_classification );
     cv::imwrite( argv[ 2 ], image_classification );
 
     std::cout << "Blue: foreground, Green: background, Red: shadow, Black: highlight" << std::endl;
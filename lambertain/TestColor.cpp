@@ -14,7 +14,8 @@ int main(int argc, char** argv)
 {
     if( argc < 9 )
     {
-        std::cout << "usage: " << argv[0] << " " << "detection_rate out_segmentation.jpg out_region.jpg  image.jpg x y width height" << std::endl;
+        std::cout << "usage: " << argv[0] << " " << "detection_rate out_segmentation.jpg out_region.jpg  image.jpg x y width height [lookup_bits]" << std::endl;
+        std::cout << "lookup_bits: bits per channel (1 to 8) of a precomputed table of the labels of all the colors" << std::endl;
         exit( 0 );
     }
 
@@ -39,6 +40,11 @@ int main(int argc, char** argv)
     cv::imwrite( argv[ 3 ], image_rect );
 
     had::SingleLCM lcm( image, detection_rate, rectangles );
+    if( argc > 9 )
+    {
+        lcm.buildLookupTable( atoi( argv[ 9 ] ) );
+        std::cout << "Lookup table: " << lcm.getLookupTableBits() << " bits per channel" << std::endl;
+    }
 
     cv::Mat classification, image_classification;
     lcm.classify( image, classification );
@@ -0,0 +1,247 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+using std::vector;
+#include <string>
+using std::string;
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "cv.h"
+#include "highgui.h"
+
+#include "had.h"
+
+namespace fs = boost::filesystem;
+
+
+// Models of the streams, used by the callback to convert the
+// classifications, which is safe as the service does not use the model of a
+// stream while its callback runs
+struct Models
+{
+    std::map<string, boost::shared_ptr<had::LCM> > lcms;
+    boost::mutex                                   mutex;
+};
+
+
+// Write the classification of a frame, and remove the frame from work/
+void writeResult( const fs::path& spool, Models* models, const string& id, const had::StreamService::Frame& frame, const cv::Mat& classification )
+{
+    if( ! classification.empty() )
+    {
+        boost::shared_ptr<had::LCM> lcm;
+        {
+            boost::mutex::scoped_lock lock( models->mutex );
+            std::map<string, boost::shared_ptr<had::LCM> >::iterator found = models->lcms.find( id );
+            if( found != models->lcms.end() )
+                lcm = found->second;
+        }
+
+        if( lcm )
+        {
+            cv::Mat image;
+            lcm->classificationToImage( classification, image );
+            fs::path output = spool / id / "out" / ( fs::path( frame.name ).stem().string() + ".png" );
+            cv::imwrite( output.string(), image );
+        }
+    }
+    else
+    {
+        std::cerr << "WARNING: frame " << frame.name << " dropped" << std::endl;
+    }
+
+    boost::system::error_code error;
+    fs::remove( frame.name, error );
+}
+
+
+// Print the counters of a stream
+void printCounters( had::StreamService& service, const string& id )
+{
+    long long nb_classified = 0, nb_dropped = 0;
+    if( service.getCounters( id, &nb_classified, &nb_dropped ) )
+        std::cout << "Stream " << id << ": " << nb_classified << " frames classified, " << nb_dropped << " dropped" << std::endl;
+}
+
+
+// Add the streams whose directory has appeared, and remove the ones whose
+// directory or model has disappeared
+void updateStreams( had::StreamService& service, const fs::path& spool, Models& models, std::set<string>& failed )
+{
+    std::set<string> present;
+    fs::directory_iterator end;
+    for( fs::directory_iterator entry( spool ); entry != end; ++entry )
+    {
+        string id = entry->path().filename().string();
+        if( fs::is_directory( entry->status() ) && fs::exists( entry->path() / "model.lcm" ) )
+            present.insert( id );
+    }
+
+    vector<string> ids = service.getStreamIds();
+    for( unsigned int id = 0; id < ids.size(); ++id )
+    {
+        if( present.count( ids[ id ] ) == 0 )
+        {
+            printCounters( service, ids[ id ] );
+            service.removeStream( ids[ id ] );
+            boost::mutex::scoped_lock lock( models.mutex );
+            models.lcms.erase( ids[ id ] );
+            std::cout << "Stream " << ids[ id ] << " removed" << std::endl;
+        }
+    }
+
+    for( std::set<string>::const_iterator id = present.begin(); id != present.end(); ++id )
+    {
+        if( service.hasStream( *id ) || failed.count( *id ) > 0 )
+            continue;
+
+        // The streams have no thread pool: each frame is classified by one
+        // thread, and the pool of the service runs the streams in parallel
+        boost::shared_ptr<had::LCM> lcm;
+        try
+        {
+            lcm.reset( had::LCM::load( ( spool / *id / "model.lcm" ).string() ) );
+        }
+        catch( const cv::Exception& exception )
+        {
+            std::cerr << "ERROR: cannot load the model of stream " << *id << ": " << exception.what() << std::endl;
+            failed.insert( *id );
+            continue;
+        }
+
+        fs::create_directories( spool / *id / "work" );
+        fs::create_directories( spool / *id / "out" );
+        {
+            boost::mutex::scoped_lock lock( models.mutex );
+            models.lcms[ *id ] = lcm;
+        }
+        service.addStream( *id, lcm );
+        std::cout << "Stream " << *id << " added" << std::endl;
+    }
+
+    // A stream whose model failed to load is tried again once it has been
+    // removed and added back
+    for( std::set<string>::iterator id = failed.begin(); id != failed.end(); )
+    {
+        if( present.count( *id ) == 0 )
+            failed.erase( id++ );
+        else
+            ++id;
+    }
+}
+
+
+// Submit the new frames of all the streams, in the order of their names
+void submitFrames( had::StreamService& service, const fs::path& spool, std::map<string, int>& indexes )
+{
+    vector<string> ids = service.getStreamIds();
+    for( unsigned int id = 0; id < ids.size(); ++id )
+    {
+        fs::path input = spool / ids[ id ] / "in";
+        if( ! fs::is_directory( input ) )
+            continue;
+
+        vector<string> names;
+        fs::directory_iterator end;
+        for( fs::directory_iterator entry( input ); entry != end; ++entry )
+        {
+            string name = entry->path().filename().string();
+            if( fs::is_regular_file( entry->status() ) && had::FrameLoader::isImageFile( name ) )
+                names.push_back( name );
+        }
+        std::sort( names.begin(), names.end(), had::FrameLoader::lessNatural );
+
+        // The frames are moved to work/ so that they are submitted only once
+        for( unsigned int id_name = 0; id_name < names.size(); ++id_name )
+        {
+            fs::path work = spool / ids[ id ] / "work" / names[ id_name ];
+            boost::system::error_code error;
+            fs::rename( input / names[ id_name ], work, error );
+            if( error )
+                continue;
+
+            had::StreamService::Frame frame;
+            frame.index = indexes[ ids[ id ] ]++;
+            frame.name = work.string();
+            service.submit( ids[ id ], frame );
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    // Options, each one followed by its value:
+    //  --threads: number of threads classifying the frames, 0 for one per core.
+    //  --poll: time between two scans of the spool directory, in milliseconds.
+    //  --queue: maximum number of frames waiting per stream.
+    int nb_threads = 0;
+    int poll = 20;
+    int capacity = 4;
+    int first_arg = 1;
+    while( first_arg + 1 < argc && string( argv[ first_arg ] ).compare( 0, 2, "--" ) == 0 )
+    {
+        string option = argv[ first_arg ];
+        if( option == "--threads" )
+            nb_threads = atoi( argv[ first_arg + 1 ] );
+        else if( option == "--poll" )
+            poll = std::max( atoi( argv[ first_arg + 1 ] ), 1 );
+        else if( option == "--queue" )
+            capacity = std::max( atoi( argv[ first_arg + 1 ] ), 1 );
+        else
+        {
+            std::cerr << "ERROR: unknown option " << option << std::endl;
+            exit( 1 );
+        }
+        first_arg += 2;
+    }
+
+    if( first_arg + 1 != argc )
+    {
+        std::cout << "usage: " << argv[0] << " [--threads 0] [--poll 20] [--queue 4] spool_directory" << std::endl;
+        std::cout << "Each subdirectory spool_directory/id is a stream, with a model file id/model.lcm." << std::endl;
+        std::cout << "The frames moved into id/in are classified, and written as id/out/name.png." << std::endl;
+        std::cout << "The service stops when the file spool_directory/stop exists." << std::endl;
+        exit( 0 );
+    }
+
+    fs::path spool = argv[ first_arg ];
+    if( ! fs::is_directory( spool ) )
+    {
+        std::cerr << "ERROR: " << spool.string() << " is not a directory" << std::endl;
+        exit( 1 );
+    }
+
+    Models models;
+    std::set<string> failed;
+    std::map<string, int> indexes;
+    had::ThreadPool pool( nb_threads );
+    {
+        had::StreamService service( &pool, boost::bind( writeResult, spool, &models, _1, _2, _3 ), capacity );
+        std::cout << "Service: " << spool.string() << ", " << pool.getNbThreads() << " threads" << std::endl;
+
+        while( ! fs::exists( spool / "stop" ) )
+        {
+            updateStreams( service, spool, models, failed );
+            submitFrames( service, spool, indexes );
+            boost::this_thread::sleep( boost::posix_time::milliseconds( poll ) );
+        }
+
+        service.wait();
+        vector<string> ids = service.getStreamIds();
+        for( unsigned int id = 0; id < ids.size(); ++id )
+            printCounters( service, ids[ id ] );
+    }
+
+    return 0;
+}
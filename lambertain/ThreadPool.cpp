@@ -0,0 +1,236 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <cv.h>
+
+#include <boost/bind.hpp>
+
+#include "ThreadPool.hpp"
+
+namespace {
+
+// Range and completion counter shared by the chunks of a parallelFor()
+struct Batch
+{
+    const had::ThreadPool::RangeTask* task;
+    int                               begin;
+    int                               size;
+    int                               nb_chunks;
+    int                               remaining;
+    bool                              failed;       //!< A chunk has thrown
+    bool                              is_cv_error;  //!< The first exception was a cv::Exception
+    cv::Exception                     cv_error;     //!< First exception, if a cv::Exception
+    std::string                       error;        //!< Message of the first exception otherwise
+    boost::mutex                      mutex;
+    boost::condition_variable         done;
+};
+
+
+// Keep the first exception thrown by the chunks of a batch, to rethrow it
+// from parallelFor()
+void storeError( Batch* batch, const cv::Exception* cv_error, const char* error )
+{
+    boost::mutex::scoped_lock lock( batch->mutex );
+    if( batch->failed )
+        return;
+
+    batch->failed = true;
+    batch->is_cv_error = ( cv_error != NULL );
+    if( cv_error )
+        batch->cv_error = *cv_error;
+    else
+        batch->error = error;
+}
+
+
+// The task of a chunk only holds the batch and the index of the chunk, small
+// enough to be stored inside a boost::function
+void runChunk( Batch* batch, int id )
+{
+    // Chunk bounds spread the remainder of the division evenly
+    int begin = batch->begin + (int) ( (long long) batch->size * id / batch->nb_chunks );
+    int end   = batch->begin + (int) ( (long long) batch->size * ( id + 1 ) / batch->nb_chunks );
+
+    try
+    {
+        (*batch->task)( begin, end );
+    }
+    catch( const cv::Exception& e )
+    {
+        storeError( batch, &e, NULL );
+    }
+    catch( const std::exception& e )
+    {
+        storeError( batch, NULL, e.what() );
+    }
+    catch( ... )
+    {
+        storeError( batch, NULL, "unknown exception" );
+    }
+
+    boost::mutex::scoped_lock lock( batch->mutex );
+    if( --batch->remaining == 0 )
+        batch->done.notify_all();
+}
+
+}
+
+
+had::ThreadPool::ThreadPool( int nb_threads )
+: _first_task( 0 ), _nb_tasks( 0 ), _stop( false )
+{
+    if( nb_threads <= 0 )
+        nb_threads = boost::thread::hardware_concurrency();
+    if( nb_threads <= 0 )
+        nb_threads = 1;
+
+    for( int id = 0; id < nb_threads; ++id )
+        _threads.push_back( new boost::thread( boost::bind( &ThreadPool::work, this ) ) );
+}
+
+
+had::ThreadPool::~ThreadPool()
+{
+    {
+        boost::mutex::scoped_lock lock( _mutex );
+        _stop = true;
+        _task_available.notify_all();
+    }
+
+    for( unsigned int id = 0; id < _threads.size(); ++id )
+    {
+        _threads[ id ]->join();
+        delete _threads[ id ];
+    }
+}
+
+
+void had::ThreadPool::work()
+{
+    while( true )
+    {
+        Task task;
+        {
+            boost::mutex::scoped_lock lock( _mutex );
+            while( _nb_tasks == 0 && ! _stop )
+                _task_available.wait( lock );
+
+            if( _nb_tasks == 0 )
+                return;
+
+            popTask( task );
+        }
+        task();
+    }
+}
+
+
+bool had::ThreadPool::runPendingTask()
+{
+    Task task;
+    {
+        boost::mutex::scoped_lock lock( _mutex );
+        if( _nb_tasks == 0 )
+            return false;
+
+        popTask( task );
+    }
+    task();
+    return true;
+}
+
+
+void had::ThreadPool::pushTask( const Task& task )
+{
+    if( _nb_tasks == _tasks.size() )
+    {
+        // The tasks are moved to the beginning of a larger buffer, in order
+        vector<Task> tasks( std::max( 2 * _tasks.size(), (size_t) 16 ) );
+        for( size_t id = 0; id < _nb_tasks; ++id )
+            tasks[ id ].swap( _tasks[ ( _first_task + id ) % _tasks.size() ] );
+        _tasks.swap( tasks );
+        _first_task = 0;
+    }
+    _tasks[ ( _first_task + _nb_tasks ) % _tasks.size() ] = task;
+    ++_nb_tasks;
+}
+
+
+void had::ThreadPool::popTask( Task& out_task )
+{
+    // The slot is emptied, so that the task does not outlive its run
+    out_task.swap( _tasks[ _first_task ] );
+    _tasks[ _first_task ].clear();
+    _first_task = ( _first_task + 1 ) % _tasks.size();
+    --_nb_tasks;
+}
+
+
+void had::ThreadPool::submit( const Task& task )
+{
+    boost::mutex::scoped_lock lock( _mutex );
+    pushTask( task );
+    _task_available.notify_one();
+}
+
+
+void had::ThreadPool::parallelFor( int begin, int end, const RangeTask& task, int nb_chunks )
+{
+    int size = end - begin;
+    if( size <= 0 )
+        return;
+
+    if( nb_chunks <= 0 )
+        nb_chunks = 4 * getNbThreads();
+    if( nb_chunks > size )
+        nb_chunks = size;
+
+    if( nb_chunks == 1 )
+    {
+        task( begin, end );
+        return;
+    }
+
+    Batch batch;
+    batch.task        = &task;
+    batch.begin       = begin;
+    batch.size        = size;
+    batch.nb_chunks   = nb_chunks;
+    batch.remaining   = nb_chunks;
+    batch.failed      = false;
+    batch.is_cv_error = false;
+    {
+        boost::mutex::scoped_lock lock( _mutex );
+        for( int id = 0; id < nb_chunks; ++id )
+            pushTask( boost::bind( &runChunk, &batch, id ) );
+        _task_available.notify_all();
+    }
+
+    // Help with the queued tasks instead of just waiting
+    while( true )
+    {
+        {
+            boost::mutex::scoped_lock lock( batch.mutex );
+            if( batch.remaining == 0 )
+                break;
+        }
+
+        if( ! runPendingTask() )
+        {
+            boost::mutex::scoped_lock lock( batch.mutex );
+            while( batch.remaining > 0 )
+                batch.done.wait( lock );
+            break;
+        }
+    }
+
+    if( batch.failed )
+    {
+        if( batch.is_cv_error )
+            throw batch.cv_error;
+        throw std::runtime_error( batch.error );
+    }
+}
@@ -0,0 +1,167 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_THREAD_POOL_HPP
+#define HAD_THREAD_POOL_HPP
+
+#include <vector>
+using std::vector;
+
+#include <boost/function.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/** 
+* @brief Persistent pool of worker threads.
+*
+* The threads are created once and wait for tasks, so that a frame can be
+* split across all the cores without paying for thread creation every time.
+* parallelFor() splits a range of indexes (typically the rows of an image)
+* into contiguous chunks and blocks until all of them have been processed.
+* The calling thread processes queued tasks while it waits, so that a
+* parallelFor() can safely be issued from inside another task.
+*
+* The queue is a ring buffer that only grows, and the tasks of the chunks fit
+* in a boost::function without allocating, so that a parallelFor() does not
+* allocate once the queue has reached its largest size.
+*/
+/* ----------------------------------------------------------------------------*/
+class ThreadPool
+{
+public:
+    typedef boost::function<void ()>           Task;       //!< Independent unit of work.
+    typedef boost::function<void ( int, int )> RangeTask;  //!< Work on the range of indexes [begin, end).
+
+private:
+    vector<boost::thread*>    _threads;         //!< Worker threads.
+    vector<Task>              _tasks;           //!< Ring buffer of the tasks waiting for a thread.
+    size_t                    _first_task;      //!< Position of the oldest task in _tasks.
+    size_t                    _nb_tasks;        //!< Number of tasks waiting in _tasks.
+    bool                      _stop;            //!< If true, the workers exit when the queue is empty.
+    boost::mutex              _mutex;           //!< Protects the queue and _stop.
+    boost::condition_variable _task_available;  //!< Signaled when a task is queued or on stop.
+
+    ThreadPool( const ThreadPool& );
+    ThreadPool& operator=( const ThreadPool& );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Main loop of the worker threads.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void work();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Append a task to the queue, growing it if it is full. _mutex must
+    * be locked.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void pushTask( const Task& task );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Remove the oldest task of the queue, which must not be empty.
+    * _mutex must be locked.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void popTask( Task& out_task );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Run one queued task in the calling thread, if there is any.
+    * 
+    * @return True if a task was run.
+    */
+    /* ----------------------------------------------------------------------------*/
+    bool runPendingTask();
+
+public:
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Constructor.
+    * 
+    * @param nb_threads Number of worker threads. If 0, one thread per core is
+    * created.
+    */
+    /* ----------------------------------------------------------------------------*/
+    explicit ThreadPool( int nb_threads = 0 );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Destructor. Waits for the queued tasks to finish.
+    */
+    /* ----------------------------------------------------------------------------*/
+    ~ThreadPool();
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Get the number of worker threads.
+    */
+    /* ----------------------------------------------------------------------------*/
+    int getNbThreads() const { return _threads.size(); }
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Queue a task, which will be run by one of the worker threads.
+    * 
+    * @param task Task to run.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void submit( const Task& task );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Process a range of indexes in parallel, and wait for the end of the
+    * processing.
+    *
+    * The range is split into contiguous chunks, whose bounds only depend on the
+    * range and on nb_chunks: the way the work is divided does not depend on
+    * the number of threads or on their scheduling.
+    *
+    * If chunks throw, the first exception is rethrown once all the chunks are
+    * done: a cv::Exception as a copy of itself, any other exception as a
+    * std::runtime_error with the same message.
+    * 
+    * @param begin First index of the range.
+    * @param end Index after the last index of the range.
+    * @param task Task called once per chunk, with the bounds of the chunk.
+    * @param nb_chunks Maximum number of chunks. If 0, four chunks per thread
+    * are used, to balance the load.
+    */
+    /* ----------------------------------------------------------------------------*/
+    void parallelFor( int begin, int end, const RangeTask& task, int nb_chunks = 0 );
+
+    /* ----------------------------------------------------------------------------*/
+    /** 
+    * @brief Process a range of indexes with parallelFor() if there is a
+    * pool, or in the calling thread otherwise.
+    *
+    * The task is handed to the pool by reference, so that a boost::bind()
+    * expression, whatever its size, is not copied to the heap into a
+    * RangeTask.
+    * 
+    * @param pool Thread pool (NULL to use the calling thread only).
+    * @param begin First index of the range.
+    * @param end Index after the last index of the range.
+    * @param task Function called once per chunk, with the bounds of the chunk.
+    * @param nb_chunks Maximum number of chunks, see parallelFor().
+    */
+    /* ----------------------------------------------------------------------------*/
+    template<typename RangeFunction>
+    static void runRange( ThreadPool* pool, int begin, int end, const RangeFunction& task, int nb_chunks = 0 )
+    {
+        if( pool )
+            pool->parallelFor( begin, end, RangeTask( boost::cref( task ) ), nb_chunks );
+        else
+            task( begin, end );
+    }
+};
+
+}
+
+#endif // HAD_THREAD_POOL_HPP
@@ -0,0 +1,66 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#include <algorithm>
+
+#include <boost/thread/tss.hpp>
+
+#include "Workspace.hpp"
+
+namespace {
+
+// Workspace of each thread, deleted when the thread exits
+boost::thread_specific_ptr<had::Workspace> THREAD_WORKSPACE;
+
+}
+
+
+had::Workspace::Workspace()
+{
+    std::fill( _held, _held + NB_BUFFERS, false );
+}
+
+
+had::Workspace& had::Workspace::getThreadWorkspace()
+{
+    Workspace* workspace = THREAD_WORKSPACE.get();
+    if( ! workspace )
+    {
+        workspace = new Workspace;
+        THREAD_WORKSPACE.reset( workspace );
+    }
+    return *workspace;
+}
+
+
+unsigned char* had::Workspace::getBytes( Buffer buffer, size_t nb_bytes, StageStats* io_stats )
+{
+    // The buffers are never empty, so that the pointer is always valid
+    vector<unsigned char>& bytes = _buffers[ buffer ];
+    if( bytes.size() < nb_bytes || bytes.empty() )
+    {
+        bytes.resize( std::max( nb_bytes, (size_t) 1 ) );
+        if( io_stats )
+        {
+            HAD_COUNT( *io_stats, COUNTER_ALLOCATIONS, 1 );
+            HAD_COUNT( *io_stats, COUNTER_ALLOCATED_BYTES, bytes.size() );
+        }
+    }
+    return &bytes[ 0 ];
+}
+
+
+unsigned char* had::Workspace::hold( Buffer buffer, size_t nb_bytes, StageStats* io_stats )
+{
+    Workspace& workspace = getThreadWorkspace();
+    if( workspace._held[ buffer ] )
+        return NULL;
+
+    workspace._held[ buffer ] = true;
+    return workspace.getBytes( buffer, nb_bytes, io_stats );
+}
+
+
+void had::Workspace::release( Buffer buffer )
+{
+    getThreadWorkspace()._held[ buffer ] = false;
+}
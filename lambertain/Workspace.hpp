@@ -0,0 +1,122 @@
+// (c)2010 - Emmanuel Goossaert
+// Under GNU License 3.0
+#ifndef HAD_WORKSPACE_HPP
+#define HAD_WORKSPACE_HPP
+
+#include <vector>
+using std::vector;
+
+#include "Instrumentation.hpp"
+
+namespace had {
+
+/* ----------------------------------------------------------------------------*/
+/**
+* @brief Scratch buffers of the calling thread, reused from one frame to the
+* next.
+*
+* The functions that process a band of rows (like LCM::classifyRows()) take
+* their row buffers from the workspace of the thread that runs them instead
+* of allocating them: the buffers are allocated the first time a thread needs
+* them, grow with the size of the frames, and are never freed until the
+* thread exits. Once each thread has seen the largest frame, classifying a
+* frame does not allocate any buffer, whatever the number of models, as the
+* models that run on the same thread share its workspace.
+*
+* A buffer is only valid until the next call to get() for the same buffer on
+* the same thread. It must not be kept across a call to
+* ThreadPool::parallelFor(), as the calling thread runs other tasks while it
+* waits, which may use the same buffer. A buffer that must be kept across
+* parallelFor() is taken with hold() instead, and given back with release():
+* a task that runs meanwhile on the same thread and holds the same buffer
+* gets NULL, and uses a buffer of its own.
+*/
+/* ----------------------------------------------------------------------------*/
+class Workspace
+{
+public:
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Buffers of a workspace.
+    */
+    /* ----------------------------------------------------------------------------*/
+    enum Buffer
+    {
+        BUFFER_BDIST_NORM         = 0,  //!< Normalized brightness distortions of a row.
+        BUFFER_CDIST_NORM_SQUARED = 1,  //!< Squared normalized chromaticity distortions of a row.
+        BUFFER_TILE_SUMS          = 2,  //!< Sums of the differences of a row of tiles.
+        BUFFER_TILE_MAXS          = 3,  //!< Maxima of the differences of a row of tiles.
+        BUFFER_BLOCK_SUMS         = 4,  //!< Sums of the values of a row of blocks.
+        BUFFER_ROW_MASK           = 5,  //!< Mask of a row.
+        BUFFER_ROW_LABELS         = 6,  //!< Labels of a row.
+        BUFFER_REGIONS_MASK       = 7,  //!< Mask of the rectangles of LCM::classify(), of a whole image (see hold()).
+        NB_BUFFERS                = 8
+    };
+
+private:
+    vector<unsigned char> _buffers[ NB_BUFFERS ];   //!< Buffers, which only grow.
+    bool                  _held[ NB_BUFFERS ];      //!< True for the buffers taken with hold() and not released yet.
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get a buffer of at least a number of bytes.
+    */
+    /* ----------------------------------------------------------------------------*/
+    unsigned char* getBytes( Buffer buffer, size_t nb_bytes, StageStats* io_stats );
+
+public:
+    Workspace();
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get a buffer of the workspace of the calling thread.
+    *
+    * @param buffer Buffer to get.
+    * @param size Number of values of the buffer.
+    * @param io_stats Statistics counting the allocation of the buffer, if it
+    * has to grow (COUNTER_ALLOCATIONS and COUNTER_ALLOCATED_BYTES), NULL if
+    * the allocations are not counted.
+    *
+    * @return Buffer of at least size values, whose content is undefined.
+    */
+    /* ----------------------------------------------------------------------------*/
+    template<typename T>
+    static T* get( Buffer buffer, int size, StageStats* io_stats )
+    {
+        return (T*) getThreadWorkspace().getBytes( buffer, size * sizeof( T ), io_stats );
+    }
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Take a buffer of the workspace of the calling thread, which stays
+    * valid until release(), even across ThreadPool::parallelFor().
+    *
+    * @param buffer Buffer to take, which must not be used with get().
+    * @param nb_bytes Number of bytes of the buffer.
+    * @param io_stats Statistics counting the allocation of the buffer, as with
+    * get().
+    *
+    * @return Buffer of at least nb_bytes bytes, whose content is undefined, or
+    * NULL if it is already held on this thread.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static unsigned char* hold( Buffer buffer, size_t nb_bytes, StageStats* io_stats );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Give back a buffer taken with hold(), which returned a buffer.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static void release( Buffer buffer );
+
+    /* ----------------------------------------------------------------------------*/
+    /**
+    * @brief Get the workspace of the calling thread, created on first use.
+    */
+    /* ----------------------------------------------------------------------------*/
+    static Workspace& getThreadWorkspace();
+};
+
+}
+
+#endif // HAD_WORKSPACE_HPP
@@ -1,8 +1,24 @@
 #ifndef HAD_LIBRARY
 #define HAD_LIBRARY
 
+#include "QuantileSelector.hpp"
+#include "ThreadPool.hpp"
+#include "ModelFile.hpp"
+#include "LabelFile.hpp"
+#include "Instrumentation.hpp"
+#include "Workspace.hpp"
+#include "FrameStatistics.hpp"
 #include "LCM.hpp"
+#include "DistortionKernels.hpp"
 #include "SingleLCM.hpp"
 #include "MultipleLCM.hpp"
+#include "GlobalVarianceLCM.hpp"
+#include "QuantizedLCM.hpp"
+#include "IncrementalClassifier.hpp"
+#include "PyramidClassifier.hpp"
+#include "BoundedQueue.hpp"
+#include "FrameSource.hpp"
+#include "FrameLoader.hpp"
+#include "StreamService.hpp"
 
 #endif // HAD_LIBRARY
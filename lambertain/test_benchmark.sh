@@ -0,0 +1,2 @@
+#!/bin/sh
+./benchmark --threads 1,2,4,0 --frames 4,16 --resolutions dataset,720p,1080p,4k
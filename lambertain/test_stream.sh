@@ -0,0 +1,3 @@
+#!/bin/sh
+mkdir -p stream
+./background --stream .999999 stream/class%04d.jpg dataset/frame%d.jpg dataset/frame0.jpg dataset/frame1.jpg dataset/frame2.jpg dataset/frame3.jpg dataset/frame4.jpg dataset/frame5.jpg dataset/frame6.jpg dataset/frame7.jpg dataset/frame8.jpg dataset/frame9.jpg dataset/frame10.jpg dataset/frame11.jpg dataset/frame12.jpg dataset/frame13.jpg dataset/frame14.jpg dataset/frame15.jpg dataset/frame16.jpg dataset/frame17.jpg dataset/frame18.jpg dataset/frame19.jpg dataset/frame20.jpg dataset/frame21.jpg dataset/frame22.jpg dataset/frame23.jpg dataset/frame24.jpg dataset/frame25.jpg